@@ -0,0 +1,181 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// Ping decoding benchmark (raw ping -> gain compensated float array) :
+// - wrapper : generic loop through the PingMessage accessors (format checked
+//   for each row and sample),
+// - helpers : ping_data_to_array (same kernels, format resolved for each call),
+// - decoder : decode_ping (format resolved once, specialized kernel).
+// Results are written as JSON.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+#include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/PingDecoder.h>
+#include <oculus_driver/GainKernels.h>
+#include <oculus_driver/helpers.h>
+using namespace oculus;
+
+struct BenchmarkCase
+{
+    uint8_t  version;
+    uint8_t  sampleSize;
+    bool     gains;
+};
+
+template <class OculusPingResultType>
+Message::ConstPtr make_ping(const BenchmarkCase& c, uint16_t nBeams, uint16_t nRanges)
+{
+    const uint8_t dataSizes[] = {dataSize8Bit, dataSize16Bit, dataSize24Bit, dataSize32Bit};
+    std::size_t metadataSize = sizeof(OculusPingResultType) + nBeams*sizeof(int16_t);
+    std::size_t rowSize      = (c.gains ? 4 : 0) + c.sampleSize*nBeams;
+    std::vector<uint8_t> data(metadataSize + rowSize*nRanges);
+
+    OculusPingResultType ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = c.version;
+    header.payloadSize = data.size() - sizeof(header);
+    ping.fireMessage.flags = (c.gains ? 0x4 : 0) | (c.sampleSize == 2 ? 0x2 : 0);
+    ping.dataSize    = dataSizes[c.sampleSize - 1];
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = rowSize*nRanges;
+    ping.messageSize = data.size();
+    std::memcpy(data.data(), &ping, sizeof(ping));
+    for(std::size_t i = metadataSize; i < data.size(); i++) {
+        data[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    for(unsigned int r = 0; r < nRanges; r++) {
+        if(c.gains) {
+            uint32_t gain = 1 + r;
+            std::memcpy(data.data() + metadataSize + r*rowSize, &gain, sizeof(gain));
+        }
+    }
+    return Message::Create(data.size(), data.data());
+}
+
+// Decoding as done by the users of PingMessage.
+void decode_with_wrapper(const PingMessage& ping, std::vector<float>& dst)
+{
+    dst.resize(ping.bearing_count()*ping.range_count());
+    for(unsigned int r = 0; r < ping.range_count(); r++) {
+        const uint8_t* row = ping.ping_data() + ping.step()*r;
+        float gain = 1.0f;
+        if(ping.has_gains()) {
+            uint32_t rowGain;
+            std::memcpy(&rowGain, row, sizeof(rowGain));
+            gain = 1.0f / std::sqrt((float)rowGain);
+            row += 4;
+        }
+        for(unsigned int b = 0; b < ping.bearing_count(); b++) {
+            uint32_t value = 0;
+            std::memcpy(&value, row + ping.sample_size()*b, ping.sample_size());
+            dst[ping.bearing_count()*r + b] = gain * value;
+        }
+    }
+}
+
+void print_usage(const char* name)
+{
+    cout << "Usage : " << name << " [options]\n"
+         << "  --iterations <n>  Decoded pings for each case and method (default 200)\n"
+         << "  --beams <n>       Number of beams (default 512)\n"
+         << "  --ranges <n>      Number of ranges (default 1024)\n"
+         << "  --output <path>   JSON output file (default decode_benchmark.json)\n";
+}
+
+int main(int argc, char** argv)
+{
+    int         iterations = 200;
+    uint16_t    nBeams     = 512;
+    uint16_t    nRanges    = 1024;
+    std::string output     = "decode_benchmark.json";
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if(arg == "--iterations" && hasValue) iterations = std::stoi(argv[++i]);
+        else if(arg == "--beams" && hasValue)  nBeams     = std::stoi(argv[++i]);
+        else if(arg == "--ranges" && hasValue) nRanges    = std::stoi(argv[++i]);
+        else if(arg == "--output" && hasValue) output     = argv[++i];
+        else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    std::vector<BenchmarkCase> cases;
+    for(uint8_t version : {1, 2})
+    for(uint8_t sampleSize : {1, 2, 3, 4})
+    for(bool gains : {false, true}) {
+        cases.push_back(BenchmarkCase{version, sampleSize, gains});
+    }
+
+    // ns per sample
+    auto measure = [&](auto&& decode) {
+        decode(); // warm up
+        auto t0 = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; i++) {
+            decode();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(t1 - t0).count()
+             / ((double)iterations*nBeams*nRanges);
+    };
+
+    std::ostringstream oss;
+    oss << "{\n  \"beams\": " << nBeams << ",\n  \"ranges\": " << nRanges
+        << ",\n  \"simd\": \"" << simd_level_name(simd_level()) << "\",\n  \"cases\": [";
+    for(std::size_t i = 0; i < cases.size(); i++) {
+        const auto& c = cases[i];
+        auto msg = c.version == 2 ? make_ping<OculusSimplePingResult2>(c, nBeams, nRanges)
+                                  : make_ping<OculusSimplePingResult>(c, nBeams, nRanges);
+        auto ping = PingMessage::Create(msg);
+        std::vector<float> dst;
+
+        double wrapper = measure([&]() { decode_with_wrapper(*ping, dst); });
+        double decoder = measure([&]() { decode_ping(msg->data(), dst); });
+        oss << (i == 0 ? "\n" : ",\n")
+            << "    {\"version\": "      << (int)c.version
+            << ", \"sample_size\": "     << (int)c.sampleSize
+            << ", \"gains\": "           << (c.gains ? "true" : "false")
+            << ", \"ns_per_sample\": {\"wrapper\": " << wrapper;
+        dst.resize(nBeams*nRanges);
+        double helpers = measure([&]() { ping_data_to_array(dst.data(), msg->data()); });
+        oss << ", \"helpers\": " << helpers;
+        oss << ", \"decoder\": " << decoder
+            << "}, \"speedup_vs_wrapper\": " << wrapper / decoder << "}";
+    }
+    oss << "\n  ]\n}\n";
+
+    std::ofstream f(output);
+    f << oss.str();
+    cout << oss.str();
+
+    return 0;
+}
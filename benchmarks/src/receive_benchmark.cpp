@@ -0,0 +1,247 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+// End-to-end benchmark of the reception pipeline (SonarClient +
+// SonarDriver::handle_message + ping callbacks), fed by a SonarSimulator on
+// the loopback interface. Results are written as JSON.
+//
+// Latency is measured from the socket arrival of the first byte of a ping
+// (kernel timestamp if available, reception date otherwise) to the end of the
+// ping callback. Allocations are counted on the driver thread only. A ping
+// costs 2 of them : the PingMessage and its PingWrapper, both shared with the
+// callbacks (the Message itself comes from the MessagePool).
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+#include <oculus_driver/AsyncService.h>
+#include <oculus_driver/SonarDriver.h>
+#include <oculus_driver/SonarSimulator.h>
+using namespace oculus;
+
+static std::atomic<size_t> allocationCount(0);
+static thread_local bool   countAllocations = false;
+
+void* operator new(std::size_t size)
+{
+    if(countAllocations) allocationCount++;
+    if(void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+struct BenchmarkCase
+{
+    uint16_t nBeams;
+    uint16_t nRanges;
+    uint8_t  sampleSize;
+    bool     gains;
+};
+
+struct BenchmarkResult
+{
+    BenchmarkCase       params;
+    std::size_t         pingCount;
+    double              duration;
+    std::size_t         byteCount;
+    std::size_t         allocations;
+    std::vector<double> latencies; // micro-seconds
+};
+
+double percentile(std::vector<double>& values, double p)
+{
+    if(values.size() == 0) return 0.0;
+    std::size_t idx = std::min(values.size() - 1, (std::size_t)(p*values.size()));
+    std::nth_element(values.begin(), values.begin() + idx, values.end());
+    return values[idx];
+}
+
+void print_usage(const char* name)
+{
+    cout << "Usage : " << name << " [options]\n"
+         << "  --duration <s>    Measurement duration for each case (default 2)\n"
+         << "  --rate <n>        Sonar pingRate value (default : unthrottled)\n"
+         << "  --output <path>   JSON output file (default receive_benchmark.json)\n";
+}
+
+int main(int argc, char** argv)
+{
+    double      duration = 2.0;
+    int         pingRate = -1;
+    std::string output   = "receive_benchmark.json";
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if(arg == "--duration" && hasValue)    duration = std::stod(argv[++i]);
+        else if(arg == "--rate" && hasValue)   pingRate = std::stoi(argv[++i]);
+        else if(arg == "--output" && hasValue) output   = argv[++i];
+        else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    std::vector<BenchmarkCase> cases;
+    for(uint16_t nBeams : {256, 512})
+    for(uint16_t nRanges : {512, 1024})
+    for(uint8_t sampleSize : {1, 2})
+    for(bool gains : {false, true}) {
+        cases.push_back(BenchmarkCase{nBeams, nRanges, sampleSize, gains});
+    }
+
+    AsyncService simulatorService;
+    SonarSimulator simulator(simulatorService.io_service());
+    simulator.set_unthrottled(pingRate < 0);
+    simulatorService.start();
+
+    AsyncService driverService;
+    SonarDriver driver(driverService.io_service());
+    driver.enable_kernel_timestamps(true);
+
+    bool                     measuring = false; // driver thread only
+    std::atomic<std::size_t> pingCount(0);
+    std::atomic<std::size_t> byteCount(0);
+    std::atomic<std::size_t> matchingCount(0);
+    BenchmarkCase            current = cases[0];
+    std::vector<double>      latencies;
+    latencies.reserve(1 << 22);
+
+    driver.add_ping_callback([&](const PingMessage::ConstPtr& ping) {
+        countAllocations = true;
+        if(ping->bearing_count() != current.nBeams
+           || ping->range_count() != current.nRanges
+           || ping->sample_size() != current.sampleSize
+           || ping->has_gains()   != current.gains) {
+            return; // ping from a previous configuration
+        }
+        matchingCount++;
+        if(!measuring) return;
+
+        const auto& msg = *ping->message();
+        auto arrival = msg.has_kernel_timestamp() ? msg.kernel_timestamp() : msg.timestamp();
+        if(latencies.size() < latencies.capacity()) {
+            latencies.push_back(std::chrono::duration<double, std::micro>(
+                Message::TimeSource::now() - arrival).count());
+        }
+        pingCount++;
+        byteCount += msg.data().size();
+    });
+    driverService.start();
+
+    // Waiting for the connection.
+    while(!simulator.client_connected()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    std::vector<BenchmarkResult> results;
+    for(const auto& c : cases) {
+        driverService.io_service()->post([&current, c]() { current = c; });
+        simulatorService.io_service()->post([&]() { simulator.set_range_count(c.nRanges); });
+
+        auto config = default_ping_config();
+        config.pingRate = pingRate < 0 ? pingRateHighest : pingRate;
+        config.flags    = 0x1 | 0x8;
+        if(c.sampleSize == 2) config.flags |= 0x2;
+        if(c.gains)           config.flags |= 0x4;
+        if(c.nBeams == 512)   config.flags |= 0x40;
+
+        // Waiting for the new configuration to be effective.
+        matchingCount = 0;
+        driver.send_ping_config(config);
+        for(int i = 0; i < 50 && matchingCount == 0; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if(matchingCount == 0) {
+            cerr << "Could not configure the simulator" << endl;
+            return -1;
+        }
+
+        // The counters are reset and the measurement started on the driver
+        // thread. Waiting for it so the measured duration matches.
+        std::promise<std::chrono::steady_clock::time_point> started;
+        auto startedFuture = started.get_future();
+        driverService.io_service()->post([&]() {
+            latencies.clear();
+            pingCount = 0;
+            byteCount = 0;
+            allocationCount = 0;
+            measuring = true;
+            started.set_value(std::chrono::steady_clock::now());
+        });
+        auto t0 = startedFuture.get();
+        std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+
+        std::promise<BenchmarkResult> stopped;
+        auto stoppedFuture = stopped.get_future();
+        driverService.io_service()->post([&]() {
+            measuring = false;
+            BenchmarkResult result;
+            result.duration = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - t0).count();
+            result.pingCount   = pingCount;
+            result.byteCount   = byteCount;
+            result.allocations = allocationCount;
+            result.latencies   = latencies;
+            stopped.set_value(std::move(result));
+        });
+        auto result = stoppedFuture.get();
+        result.params = c;
+        results.push_back(result);
+    }
+
+    driverService.stop();
+    simulatorService.stop();
+
+    std::ostringstream oss;
+    oss << "{\n  \"duration\": " << duration
+        << ",\n  \"ping_rate\": \"" << (pingRate < 0 ? "unthrottled" : std::to_string(pingRate))
+        << "\",\n  \"cases\": [";
+    for(std::size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        double pings = std::max<double>(r.pingCount, 1.0);
+        oss << (i == 0 ? "\n" : ",\n")
+            << "    {\"beams\": "     << r.params.nBeams
+            << ", \"ranges\": "       << r.params.nRanges
+            << ", \"sample_size\": "  << (int)r.params.sampleSize
+            << ", \"gains\": "        << (r.params.gains ? "true" : "false")
+            << ", \"pings\": "        << r.pingCount
+            << ", \"pings_per_second\": " << r.pingCount / r.duration
+            << ", \"mb_per_second\": "    << 1.0e-6 * r.byteCount / r.duration
+            << ", \"allocations_per_ping\": " << r.allocations / pings
+            << ", \"latency_us\": {\"p50\": " << percentile(r.latencies, 0.5)
+            << ", \"p99\": "  << percentile(r.latencies, 0.99)
+            << ", \"p999\": " << percentile(r.latencies, 0.999) << "}}";
+    }
+    oss << "\n  ]\n}\n";
+
+    std::ofstream f(output);
+    f << oss.str();
+    cout << oss.str();
+
+    return 0;
+}
@@ -0,0 +1,369 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_ASYNC_DISPATCHER_H_
+#define _DEF_OCULUS_DRIVER_ASYNC_DISPATCHER_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace oculus {
+
+/**
+ * Bounded multi-producer multi-consumer lock-free queue.
+ *
+ * (Dmitry Vyukov's bounded MPMC queue). The capacity is rounded up to a power
+ * of 2. No allocation happens after construction.
+ */
+template <typename T>
+class BoundedQueue
+{
+    protected:
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T                        data;
+    };
+
+    std::unique_ptr<Cell[]> buffer_;
+    std::size_t             mask_;
+
+    alignas(64) std::atomic<std::size_t> enqueuePos_;
+    alignas(64) std::atomic<std::size_t> dequeuePos_;
+
+    public:
+
+    BoundedQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while(size < capacity) size *= 2;
+        buffer_ = std::unique_ptr<Cell[]>(new Cell[size]);
+        mask_   = size - 1;
+        for(std::size_t i = 0; i < size; i++) {
+            buffer_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos_.store(0, std::memory_order_relaxed);
+        dequeuePos_.store(0, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&)            = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    std::size_t capacity() const { return mask_ + 1; }
+    std::size_t size() const {
+        std::size_t enqueuePos = enqueuePos_.load(std::memory_order_relaxed);
+        std::size_t dequeuePos = dequeuePos_.load(std::memory_order_relaxed);
+        return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+    }
+
+    bool try_push(const T& data)
+    {
+        Cell* cell;
+        std::size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for(;;) {
+            cell = &buffer_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0) {
+                return false; // full
+            }
+            else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& data)
+    {
+        Cell* cell;
+        std::size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for(;;) {
+            cell = &buffer_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0) {
+                if(dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0) {
+                return false; // empty
+            }
+            else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        // Moving out of the cell so the queue does not keep a reference on
+        // the item (matters for pooled messages).
+        data = std::move(cell->data);
+        cell->data = T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+/**
+ * What to do when an item is pushed to a full subscriber queue.
+ */
+enum class DropPolicy
+{
+    DropOldest, // Removes the oldest pending item (default, keeps latency low)
+    DropNewest, // Discards the new item
+    Block       // Waits for the subscriber to make room (stalls the producer)
+};
+
+struct DispatchStats
+{
+    uint64_t    pushed;    // items given to the channel
+    uint64_t    dropped;   // items discarded because of the drop policy
+    uint64_t    processed; // items handed to the callback
+    std::size_t pending;   // items currently waiting in the queue
+};
+
+class AsyncDispatcher;
+
+/**
+ * A subscriber of the AsyncDispatcher. Items of a channel are processed in
+ * order, by at most one worker at a time.
+ */
+class DispatchChannelBase : public std::enable_shared_from_this<DispatchChannelBase>
+{
+    public:
+
+    friend class AsyncDispatcher;
+
+    using Ptr = std::shared_ptr<DispatchChannelBase>;
+
+    protected:
+
+    AsyncDispatcher*             dispatcher_;
+    std::atomic<bool>            scheduled_;
+    std::atomic<bool>            closed_;
+    std::atomic<std::thread::id> runner_;
+
+    // Live channel count of the dispatcher. Shared so the channel can be
+    // destroyed after the dispatcher.
+    std::shared_ptr<std::atomic<std::size_t>> channelCount_;
+
+    // Throws std::runtime_error if the dispatcher already has its maximum
+    // number of channels.
+    DispatchChannelBase(AsyncDispatcher* dispatcher);
+
+    void schedule();
+
+    // Processes (some of) the pending items. Called by a worker thread.
+    virtual void run() = 0;
+    virtual bool empty() const = 0;
+
+    public:
+
+    virtual ~DispatchChannelBase();
+    virtual DispatchStats stats() const = 0;
+
+    // Stops the channel. Waits for the callback to return if it is being
+    // called on another thread. The channel must be closed before being
+    // destroyed.
+    virtual void close();
+    bool is_closed() const { return closed_; }
+};
+
+template <typename T>
+class DispatchChannel : public DispatchChannelBase
+{
+    public:
+
+    using Ptr      = std::shared_ptr<DispatchChannel<T>>;
+    using Callback = std::function<void(const T&)>;
+
+    protected:
+
+    BoundedQueue<T> queue_;
+    Callback        callback_;
+    DropPolicy      policy_;
+
+    std::atomic<uint64_t> pushed_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> processed_;
+
+    // only used with DropPolicy::Block
+    std::mutex              blockMutex_;
+    std::condition_variable blockCv_;
+
+    virtual bool empty() const { return queue_.size() == 0; }
+
+    // At most one queue worth of items per call, so a busy channel does not
+    // keep a worker from the other channels.
+    virtual void run()
+    {
+        T item;
+        for(std::size_t count = 0;
+            count < queue_.capacity() && !closed_ && queue_.try_pop(item); count++)
+        {
+            if(policy_ == DropPolicy::Block) {
+                std::lock_guard<std::mutex> lock(blockMutex_);
+                blockCv_.notify_one();
+            }
+            callback_(item);
+            processed_++;
+            item = T();
+        }
+    }
+
+    public:
+
+    DispatchChannel(AsyncDispatcher* dispatcher, const Callback& callback,
+                    DropPolicy policy, std::size_t queueDepth) :
+        DispatchChannelBase(dispatcher),
+        queue_(queueDepth),
+        callback_(callback),
+        policy_(policy),
+        pushed_(0),
+        dropped_(0),
+        processed_(0)
+    {}
+
+    /**
+     * Queues an item for the subscriber. Returns false if the item was
+     * dropped (DropNewest policy, or closed channel). Never blocks unless the
+     * policy is DropPolicy::Block.
+     */
+    bool push(const T& item)
+    {
+        if(closed_) return false;
+        pushed_++;
+        switch(policy_) {
+            case DropPolicy::DropNewest:
+                if(!queue_.try_push(item)) {
+                    dropped_++;
+                    return false;
+                }
+                break;
+            case DropPolicy::Block:
+                if(!queue_.try_push(item)) {
+                    std::unique_lock<std::mutex> lock(blockMutex_);
+                    blockCv_.wait(lock, [&]() { return closed_ || queue_.try_push(item); });
+                    if(closed_) return false;
+                }
+                break;
+            case DropPolicy::DropOldest:
+            default:
+                while(!queue_.try_push(item)) {
+                    T oldest;
+                    if(queue_.try_pop(oldest)) {
+                        dropped_++;
+                    }
+                }
+                break;
+        }
+        this->schedule();
+        return true;
+    }
+
+    std::size_t capacity() const { return queue_.capacity(); }
+
+    virtual DispatchStats stats() const
+    {
+        return DispatchStats{pushed_, dropped_, processed_, queue_.size()};
+    }
+
+    virtual void close()
+    {
+        {
+            // Releasing a producer blocked in push().
+            std::lock_guard<std::mutex> lock(blockMutex_);
+            closed_ = true;
+            blockCv_.notify_all();
+        }
+        DispatchChannelBase::close();
+    }
+};
+
+/**
+ * Pool of worker threads running the subscriber callbacks outside of the
+ * reception thread.
+ *
+ * Each subscriber has its own bounded lock-free queue (a DispatchChannel) and
+ * drop policy. Pushing an item never allocates. A channel with pending items
+ * is scheduled on the pool once and is processed by a single worker at a time,
+ * so the callbacks of a subscriber are called in order and are never called
+ * concurrently. Waking up an idle worker takes a short lock.
+ */
+class AsyncDispatcher
+{
+    public:
+
+    friend class DispatchChannelBase;
+
+    protected:
+
+    // The ready queue keeps a reference on the scheduled channels so they
+    // stay alive while processed (copying a shared_ptr does not allocate).
+    // A channel is in the ready queue at most once and the number of live
+    // channels is capped to its capacity, so it never overflows.
+    std::vector<std::thread>               workers_;
+    BoundedQueue<DispatchChannelBase::Ptr> ready_;
+    std::mutex                             mutex_;
+    std::condition_variable                cv_;
+    std::condition_variable                closeCv_; // a closed channel was released
+    std::atomic<long>                      readyCount_; // incremented before the push
+    std::atomic<bool>                      running_;
+    std::shared_ptr<std::atomic<std::size_t>> channelCount_;
+
+    void schedule(DispatchChannelBase* channel);
+    void worker_loop();
+
+    public:
+
+    AsyncDispatcher(unsigned int workerCount = 1, std::size_t maxChannels = 256);
+    ~AsyncDispatcher();
+
+    AsyncDispatcher(const AsyncDispatcher&)            = delete;
+    AsyncDispatcher& operator=(const AsyncDispatcher&) = delete;
+
+    unsigned int worker_count() const { return workers_.size(); }
+    std::size_t  max_channels() const { return ready_.capacity(); }
+    std::size_t  channel_count() const { return *channelCount_; }
+
+    template <typename T>
+    typename DispatchChannel<T>::Ptr make_channel(
+        const typename DispatchChannel<T>::Callback& callback,
+        DropPolicy  policy     = DropPolicy::DropOldest,
+        std::size_t queueDepth = 16)
+    {
+        // Throws std::runtime_error if there are already max_channels()
+        // channels alive.
+        return std::make_shared<DispatchChannel<T>>(this, callback, policy, queueDepth);
+    }
+
+    void stop();
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_ASYNC_DISPATCHER_H_
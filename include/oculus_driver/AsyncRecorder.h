@@ -0,0 +1,166 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_ASYNC_RECORDER_H_
+#define _DEF_OCULUS_DRIVER_ASYNC_RECORDER_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/Compression.h>
+#include <oculus_driver/ThreadPool.h>
+
+namespace oculus {
+
+struct RecorderStats
+{
+    std::size_t queueDepth;    // number of full blocks waiting to be written
+    std::size_t bytesPending;  // bytes not written to disk yet
+    uint64_t    writtenBytes;
+    uint64_t    droppedItems;  // messages dropped because all blocks were full
+    uint64_t    writeErrors;
+
+    CompressionStats compression;      // sonar messages only
+    int              compressionLevel; // level used for the last block
+};
+
+/**
+ * Writes .oculus files (same format as Recorder) from a background thread.
+ *
+ * write() serializes the message items into a large preallocated block and
+ * returns immediately. Full blocks are handed to a writer thread which writes
+ * all the pending blocks with a single writev call. A partially filled block
+ * is handed to the writer after flushPeriod. If the disk does not keep up and
+ * all the blocks are full, incoming messages are dropped (and counted) so the
+ * caller (usually the io thread) is never blocked by a disk stall. The
+ * buffering capacity should hold several seconds of sonar data : by default
+ * the blocks are sized with block_size_for to absorb a BufferDuration (5s)
+ * stall at MaxDataRate (40MB/s), which is 8 blocks of 29MB. The blocks are
+ * allocated by the first open().
+ *
+ * With compression enabled (set_compression), each full block is compressed
+ * on a pool of worker threads (each sonar message item of the block is
+ * compressed, so the file stays readable by FileReader) and the blocks are
+ * still written in order. If the blocks pile up because compression does not
+ * keep up, the next blocks are compressed with the fastest level of the
+ * codec, then stored uncompressed, until the backlog is absorbed.
+ */
+class AsyncRecorder
+{
+    public:
+
+    using Duration = std::chrono::milliseconds;
+    using TimeStamp = Recorder::TimeStamp;
+
+    // 512 beams x 1024 ranges x 16 bits at 40Hz.
+    static constexpr double      MaxDataRate       = 40.0e6; // bytes per second
+    static constexpr double      BufferDuration    = 5.0;    // seconds
+    static constexpr std::size_t DefaultBlockCount = 8;
+
+    protected:
+
+    struct Block
+    {
+        std::vector<uint8_t> data;
+        std::size_t          size       = 0;
+        std::vector<uint8_t> output;         // data with compressed items
+        std::size_t          outputSize = 0; // 0 if data is written as is
+        bool                 ready      = true; // false while being compressed
+    };
+
+    std::size_t blockSize_;
+    std::string filename_;
+    std::atomic<int> fd_;
+    Duration    flushPeriod_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable writerCv_;
+    std::condition_variable flushedCv_;
+    std::vector<Block>      blocks_;
+    Block*                  current_;   // block being filled
+    std::vector<Block*>     free_;
+    std::deque<Block*>      full_;      // waiting to be written
+    std::size_t             inFlight_;  // bytes being written by the writer
+    bool                    accepting_; // false while closing
+    bool                    stopping_;
+    std::thread             writer_;
+
+    uint64_t writtenBytes_;
+    uint64_t droppedItems_;
+    uint64_t writeErrors_;
+
+    Codec                       codec_;
+    int                         compressionLevel_;
+    int                         lastLevel_;
+    std::unique_ptr<ThreadPool> compressionPool_;
+    CompressionStats            compressionStats_;
+
+    bool reserve(std::size_t size);
+    void push_full(Block* block);
+    void compress_block(Block* block, int level);
+    void writer_loop();
+    bool write_all(const std::vector<Block*>& blocks);
+
+    public:
+
+    // Block size needed to absorb a disk stall of the given duration (in
+    // seconds) while receiving dataRate bytes per second.
+    static std::size_t block_size_for(double duration,
+                                      double dataRate = MaxDataRate,
+                                      std::size_t blockCount = DefaultBlockCount);
+
+    AsyncRecorder(std::size_t blockSize  = block_size_for(BufferDuration),
+                  std::size_t blockCount = DefaultBlockCount,
+                  const Duration& flushPeriod = Duration(1000));
+    ~AsyncRecorder();
+
+    AsyncRecorder(const AsyncRecorder&) = delete;
+    AsyncRecorder& operator=(const AsyncRecorder&) = delete;
+
+    void open(const std::string& filename, bool force = false);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    std::size_t write(const Message& message);
+    std::size_t write(const Message::ConstPtr& message) {
+        return this->write(*message);
+    }
+
+    // Hands the current block to the writer thread and waits until
+    // everything was written.
+    void flush();
+
+    // Must be called while the recorder is closed. workerCount = 0 : one
+    // compression thread per hardware thread. Throws if the codec is not
+    // available in this build.
+    void set_compression(Codec codec, int level = DefaultCompressionLevel,
+                         unsigned int workerCount = 0);
+    Codec compression() const { return codec_; }
+
+    RecorderStats stats() const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_ASYNC_RECORDER_H_
@@ -0,0 +1,76 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_BATCH_DECODER_H_
+#define _DEF_OCULUS_DRIVER_BATCH_DECODER_H_
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/ThreadPool.h>
+
+namespace oculus {
+
+struct DecodedPing
+{
+    std::size_t           index; // index of the ping in the file
+    PingMessage::ConstPtr ping;
+    std::vector<float>    data;  // gain compensated, see get_ping_acoustic_data
+};
+
+/**
+ * Converts all the pings of a .oculus file to float arrays, in parallel.
+ *
+ * The pings are processed in batches of consecutive pings. Each batch is
+ * split in ranges using the positions given by the FileIndex, and each range
+ * is read from its own mapping of the file (MappedFileReader), decompressed
+ * and converted by a single task of the thread pool. Nothing is read in the
+ * calling thread. The results are given to the callback in file order, from
+ * the calling thread, while the workers decode the next batch.
+ */
+class BatchDecoder
+{
+    public:
+
+    using Callback = std::function<void(const DecodedPing&)>;
+
+    protected:
+
+    std::string filename_;
+    ThreadPool& pool_;
+    std::size_t batchSize_;
+
+    public:
+
+    BatchDecoder(const std::string& filename, ThreadPool& pool,
+                 std::size_t batchSize = 256);
+
+    // Returns the number of decoded pings.
+    std::size_t decode(const Callback& callback);
+
+    template <class OutputIt>
+    std::size_t decode_to(OutputIt out) {
+        return this->decode([&](const DecodedPing& ping) { *out++ = ping; });
+    }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_BATCH_DECODER_H_
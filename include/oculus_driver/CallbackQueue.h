@@ -21,6 +21,8 @@
 
 #include <functional>
 #include <unordered_map>
+#include <vector>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
@@ -34,6 +36,13 @@ class CallbackQueue
 {
     // Thread safe callback handler
     // /!\ call order not guarantied !
+    //
+    // Regular callbacks are stored in an immutable list which is replaced on
+    // each add_callback / remove_callback (copy-on-write). call() iterates on
+    // the current list without locking nor allocating. Each list counts its
+    // users (being the current list, and each call() iterating on it) and is
+    // deleted by the last one, so a replaced list is freed as soon as the
+    // call() reading it returns.
 
     public:
 
@@ -46,6 +55,7 @@ class CallbackQueue
     using CallbackId    = unsigned int;
     using CallbackT     = std::function<void(ArgTypes...)>;
     using CallbackDict  = std::unordered_map<CallbackId, CallbackT>;
+    using CallbackList  = std::vector<std::pair<CallbackId, CallbackT>>;
 
     // deleted functions to prevent copy
     CallbackQueue(const CallbackQueue&) = delete;
@@ -53,17 +63,42 @@ class CallbackQueue
 
     protected:
     
-    CallbackDict       callbacks_;
-    mutable std::mutex mutex_;
+    struct SharedList {
+        CallbackList              callbacks;
+        std::atomic<unsigned int> refs;
+        SharedList(const CallbackList& other = CallbackList()) :
+            callbacks(other), refs(1)
+        {}
+    };
+
+    // A call() may have loaded callbacks_ but not incremented the list refs
+    // yet. It is then counted in entering_[epoch_] so a writer can wait for
+    // it before releasing a replaced list.
+    std::atomic<SharedList*>  callbacks_;
+    std::atomic<unsigned int> epoch_;
+    std::atomic<unsigned int> entering_[2];
+    mutable std::mutex        mutex_; // serializes writers
 
     CallbackDict            singleShots_;
     std::mutex              sShotsMutex_;
     std::condition_variable sShotsCv_;
     bool                    sShotsCalled_;
+    std::atomic<bool>       hasSingleShots_;
+
+    SharedList* acquire();
+    static void release(SharedList* list);
+    void publish(SharedList* callbacks);
 
     public:
 
-    CallbackQueue() {}
+    CallbackQueue() :
+        callbacks_(new SharedList()),
+        epoch_(0),
+        entering_{0, 0},
+        sShotsCalled_(false),
+        hasSingleShots_(false)
+    {}
+    ~CallbackQueue();
 
     CallbackId add_callback(const CallbackT& callback);
     bool remove_callback(CallbackId index);
@@ -73,17 +108,85 @@ class CallbackQueue
     void call(ArgTypes... args);
 };
 
+template <class ...ArgTypes>
+CallbackQueue<ArgTypes...>::~CallbackQueue()
+{
+    release(callbacks_.load());
+}
+
+/**
+ * Takes a reference on the current callback list (to be released with
+ * release()).
+ */
+template <class ...ArgTypes>
+typename CallbackQueue<ArgTypes...>::SharedList* CallbackQueue<ArgTypes...>::acquire()
+{
+    for(;;) {
+        unsigned int epoch = epoch_.load();
+        entering_[epoch]++;
+        // If the epoch changed, a writer may already be past its wait on
+        // entering_[epoch] : trying again with the new epoch.
+        if(epoch_.load() != epoch) {
+            entering_[epoch]--;
+            continue;
+        }
+        SharedList* list = callbacks_.load();
+        list->refs++;
+        entering_[epoch]--;
+        return list;
+    }
+}
+
+template <class ...ArgTypes>
+void CallbackQueue<ArgTypes...>::release(SharedList* list)
+{
+    if(--list->refs == 0) {
+        delete list;
+    }
+}
+
+/**
+ * Replaces the current callback list (mutex_ is expected to be locked).
+ */
+template <class ...ArgTypes>
+void CallbackQueue<ArgTypes...>::publish(SharedList* callbacks)
+{
+    SharedList* replaced = callbacks_.exchange(callbacks);
+
+    // A call() which loaded the replaced list before the exchange may not
+    // have taken its reference yet. Such a call() is counted in
+    // entering_[epoch] : switching the epoch and waiting for it. This is only
+    // a few instructions in call(), no callback is called in between (so a
+    // callback can add or remove callbacks without deadlocking).
+    unsigned int epoch = epoch_.load();
+    epoch_ = 1 - epoch;
+    while(entering_[epoch].load() != 0) {
+        std::this_thread::yield();
+    }
+    release(replaced);
+}
+
 template <class ...ArgTypes>
 typename CallbackQueue<ArgTypes...>::CallbackId 
 CallbackQueue<ArgTypes...>::add_callback(const CallbackT& callback)
 {
     const std::lock_guard<std::mutex> lock(mutex_); // will release mutex when out of scope
 
+    const CallbackList& current = callbacks_.load()->callbacks;
+    auto used = [&](CallbackId id) {
+        for(const auto& item : current) {
+            if(item.first == id) return true;
+        }
+        return false;
+    };
+
     // finding index value not already used
-    CallbackId newId = callbacks_.size();
-    for(; callbacks_.find(newId) != callbacks_.end(); newId++);
+    CallbackId newId = current.size();
+    for(; used(newId); newId++);
 
-    callbacks_[newId] = callback;
+    auto callbacks = new SharedList(current);
+    callbacks->callbacks.push_back(std::make_pair(newId, callback));
+    this->publish(callbacks);
     return newId;
 }
 
@@ -91,7 +194,21 @@ template <class ...ArgTypes>
 bool CallbackQueue<ArgTypes...>::remove_callback(CallbackId index)
 {
     const std::lock_guard<std::mutex> lock(mutex_); // will release mutex when out of scope
-    return callbacks_.erase(index) > 0;
+
+    const CallbackList& current = callbacks_.load()->callbacks;
+    auto callbacks = new SharedList();
+    callbacks->callbacks.reserve(current.size());
+    for(const auto& item : current) {
+        if(item.first != index) {
+            callbacks->callbacks.push_back(item);
+        }
+    }
+    if(callbacks->callbacks.size() == current.size()) {
+        delete callbacks;
+        return false;
+    }
+    this->publish(callbacks);
+    return true;
 }
 
 template <class ...ArgTypes>
@@ -109,6 +226,7 @@ bool CallbackQueue<ArgTypes...>::add_single_shot(const CallbackT& callback,
     CallbackId callbackId = singleShots_.size();
     for(; singleShots_.find(callbackId) != singleShots_.end(); callbackId++);
     singleShots_[callbackId] = callback;
+    hasSingleShots_ = true;
     
     if(timeoutMillis < 0) {
         // infinite wait
@@ -126,28 +244,33 @@ bool CallbackQueue<ArgTypes...>::add_single_shot(const CallbackT& callback,
 template <class ...ArgTypes>
 void CallbackQueue<ArgTypes...>::call(ArgTypes... args)
 {
-    CallbackDict callbacks;
-    
     {
-        // Copying callbacks first allows to release the mutex while callbacks
-        // are called. This allows callbacks to modify this object (
-        // adding/removing callbacks...)  without creating deadlocks.
-        const std::lock_guard<std::mutex> lock(mutex_); // will release mutex when out of scope
-        callbacks = callbacks_;
-    }
-    
-    // calling regular callbacks
-    for(auto& item : callbacks) {
-        item.second(args...);
+        // The list read here won't be deleted before it is released.
+        // Callbacks can still modify this object (adding/removing
+        // callbacks...) without creating deadlocks.
+        struct ReaderGuard {
+            SharedList* list;
+            ReaderGuard(SharedList* l) : list(l) {}
+            ~ReaderGuard() { release(list); }
+        } guard(this->acquire());
+
+        // calling regular callbacks
+        for(auto& item : guard.list->callbacks) {
+            item.second(args...);
+        }
     }
 
-    // calling single shots
+    // calling single shots (only locking if there are some)
+    if(!hasSingleShots_) {
+        return;
+    }
     {
         std::unique_lock<std::mutex> lock(sShotsMutex_);
         for(auto& item : singleShots_) {
             item.second(args...);
         }
         singleShots_.clear();
+        hasSingleShots_ = false;
         sShotsCalled_ = true;
     }
 
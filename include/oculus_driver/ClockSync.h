@@ -0,0 +1,124 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_CLOCK_SYNC_H_
+#define _DEF_OCULUS_DRIVER_CLOCK_SYNC_H_
+
+#include <vector>
+#include <chrono>
+
+#include <oculus_driver/OculusMessage.h>
+
+namespace oculus {
+
+/**
+ * Online estimation of the relation between the sonar clock and the host clock.
+ *
+ * The sonar gives the date of each ping in its own clock (pingStartTime, see
+ * PingMessage::ping_start_time()). Each (sonar date, host reception date)
+ * pair is added with add_sample(). A linear model hostTime = offset + drift *
+ * sonarTime is fitted on the last samples with a least square regression.
+ * Samples whose residual is larger than outlierThreshold times the robust
+ * standard deviation of the residuals (estimated from the median absolute
+ * deviation) are rejected.
+ *
+ * The reception delays are positive, so the least square line goes through
+ * the mean delay. The final model is instead fitted on the lower envelope of
+ * the remaining samples (minimal delay regression) : it is the line below all
+ * the samples which minimizes the sum of the delays above it, i.e. the edge of
+ * their lower convex hull spanning the mean sonar date. Dates given by
+ * to_host_time() are therefore free of the network and scheduling jitter.
+ * They still include the minimal transmission delay, which cannot be
+ * observed.
+ *
+ * The unit of the sonar time does not matter since it is absorbed in the drift.
+ * If wrapPeriod is not 0, the sonar time is assumed to wrap around this value
+ * (the 32 bits pingStartTime of OculusSimplePingResult). Any other backward
+ * jump of the sonar time (a sonar reboot) resets the estimation.
+ */
+class ClockSync
+{
+    public:
+
+    using TimeSource = Message::TimeSource;
+    using TimePoint  = Message::TimePoint;
+
+    struct Sample {
+        double sonarTime; // relative to origin, wrap compensated
+        double hostTime;  // seconds since hostOrigin_
+    };
+
+    struct Estimate {
+        bool        valid;
+        double      offset;      // host seconds at sonar origin
+        double      drift;       // host seconds per sonar time unit
+        double      residualStd; // robust standard deviation of the residuals (s)
+        std::size_t inlierCount;
+    };
+
+    protected:
+
+    std::size_t windowSize_;
+    std::size_t minSamples_;
+    double      outlierThreshold_;
+    double      wrapPeriod_;
+
+    std::vector<Sample> samples_; // circular buffer
+    std::size_t         next_;
+    std::size_t         count_;
+
+    bool      hasOrigin_;
+    double    sonarOrigin_;
+    TimePoint hostOrigin_;
+    double    lastSonarTime_;
+    double    wrapOffset_;
+
+    Estimate estimate_;
+
+    // scratch buffers (preallocated to avoid allocations on each sample)
+    std::vector<double> residuals_;
+    std::vector<double> absResiduals_;
+    std::vector<char>   inliers_;
+    std::vector<std::size_t> hull_;
+
+    bool fit(const std::vector<char>* mask, double& offset, double& drift) const;
+    bool fit_lower_envelope(double& offset, double& drift);
+    void update_estimate();
+
+    public:
+
+    ClockSync(std::size_t windowSize       = 200,
+              double      outlierThreshold = 3.0,
+              std::size_t minSamples       = 10,
+              double      wrapPeriod       = 0.0);
+
+    void reset();
+    void set_wrap_period(double wrapPeriod);
+
+    void add_sample(double sonarTime, const TimePoint& hostStamp);
+
+    bool            valid()       const { return estimate_.valid; }
+    const Estimate& estimate()    const { return estimate_;       }
+    std::size_t     sample_count() const { return count_;         }
+
+    TimePoint to_host_time(double sonarTime) const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_CLOCK_SYNC_H_
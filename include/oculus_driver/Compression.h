@@ -0,0 +1,81 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_COMPRESSION_H_
+#define _DEF_OCULUS_DRIVER_COMPRESSION_H_
+
+#include <vector>
+#include <cstdint>
+#include <iosfwd>
+
+namespace oculus {
+
+/**
+ * Compression of the LogItem payloads (blueprint::LogItem::compression).
+ *
+ * QCompress is the format written by the Blueprint software (Qt qCompress : a
+ * 4 bytes big-endian uncompressed size followed by a zlib stream). LZ4 and
+ * Zstd are extensions of this driver (faster, not readable by ViewPoint).
+ * Each codec is only available if the library was found at build time (see
+ * codec_available).
+ */
+enum class Codec : uint16_t
+{
+    None      = 0,
+    QCompress = 1,
+    LZ4       = 2,
+    Zstd      = 3
+};
+
+// level < 0 : default level of the codec
+constexpr int DefaultCompressionLevel = -1;
+
+bool        codec_available(Codec codec);
+const char* codec_name(Codec codec);
+int         fastest_compression_level(Codec codec);
+
+/**
+ * Compresses size bytes from src into dst (resized to the compressed size).
+ * Returns false if the codec is not available or on failure.
+ */
+bool compress(Codec codec, const uint8_t* src, std::size_t size,
+              std::vector<uint8_t>& dst, int level = DefaultCompressionLevel);
+
+/**
+ * Decompresses size bytes from src into dst, which must hold originalSize
+ * bytes. Returns false if the codec is not available or if the data is not
+ * valid.
+ */
+bool decompress(Codec codec, const uint8_t* src, std::size_t size,
+                uint8_t* dst, std::size_t originalSize);
+
+struct CompressionStats
+{
+    uint64_t originalBytes   = 0;
+    uint64_t compressedBytes = 0;
+
+    double ratio() const { // original / compressed
+        return compressedBytes > 0 ? (double)originalBytes / compressedBytes : 1.0;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const CompressionStats& stats);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_COMPRESSION_H_
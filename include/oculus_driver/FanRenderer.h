@@ -0,0 +1,140 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_FAN_RENDERER_H_
+#define _DEF_OCULUS_DRIVER_FAN_RENDERER_H_
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include <oculus_driver/Oculus.h>
+#include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/ThreadPool.h>
+#include <oculus_driver/PingDecoder.h>
+
+namespace oculus {
+
+enum class Interpolation
+{
+    Nearest,
+    Bilinear, // in range and bearing index
+    Lanczos2  // separable 4x4 taps, sharper than Bilinear
+};
+
+/**
+ * Renders ping data to a cartesian (fan shaped) image, as
+ * image_from_ping_data, for live display.
+ *
+ * The geometry (pixel -> ping data index) does not depend on the acoustic
+ * data. It is computed once and reused as long as the number of beams and
+ * ranges, the range, the bearings and the output width do not change. Each
+ * frame is then only a gather of the ping data. The pixels outside of the fan
+ * point to a zero element appended to the ping data, so the gather has no
+ * branch.
+ *
+ * The output image has the same size and orientation as the one of
+ * image_from_ping_data (sonar at the bottom center, forward up). The ping
+ * data can be interpolated in the range and bearing dimensions. The
+ * interpolation weights are part of the pixel map, stored as fixed point
+ * values (WeightBits fractional bits). The gathers use AVX2 when the CPU
+ * supports it.
+ *
+ * The map computation, the ping data conversion and the gather can be split
+ * by rows on a ThreadPool (set_thread_pool).
+ */
+class FanRenderer
+{
+    public:
+
+    struct Geometry
+    {
+        uint16_t     nBeams;
+        uint16_t     nRanges;
+        double       range;
+        uint64_t     bearingsHash; // hash of the raw bearing data
+        unsigned int width;
+        unsigned int height;
+        Interpolation interpolation;
+
+        bool same_key(const Geometry& other) const {
+            return nBeams        == other.nBeams
+                && nRanges       == other.nRanges
+                && range         == other.range
+                && bearingsHash  == other.bearingsHash
+                && width         == other.width
+                && interpolation == other.interpolation;
+        }
+    };
+
+    static constexpr int WeightBits = 14;
+    // Images smaller than this are rendered on the calling thread only.
+    static constexpr std::size_t MinTaskPixels = 65536;
+
+    protected:
+
+    unsigned int          width_;
+    Interpolation         interpolation_;
+    Geometry              geometry_;
+    std::vector<float>    bearings_;
+    std::vector<float>    pingData_;  // acoustic data and zero padding
+    std::vector<uint32_t> pixelMap_;  // index in pingData_ of the first tap of each pixel
+    std::vector<int16_t>  weights_;   // bilinear : 2 per pixel, lanczos : 8 per pixel
+    unsigned int          mapUpdates_;
+    ThreadPool*           pool_;
+
+    template <class F> void for_rows(F&& f) const;
+    void update_map(const Geometry& geometry);
+    void update_map_rows(unsigned int firstRow, unsigned int lastRow);
+    void gather(float* dst, std::size_t begin, std::size_t end) const;
+
+    template <class OculusPingResultType>
+    std::pair<unsigned int, unsigned int> render(const OculusPingResultType& metadata,
+                                                 const PingFormat& format,
+                                                 const MessageData& pingData,
+                                                 std::vector<float>& imageData);
+
+    public:
+
+    FanRenderer(unsigned int width = 1024,
+                Interpolation interpolation = Interpolation::Nearest);
+
+    void set_width(unsigned int width) { width_ = width; }
+    unsigned int width() const { return width_; }
+    void set_interpolation(Interpolation interpolation) { interpolation_ = interpolation; }
+    Interpolation interpolation() const { return interpolation_; }
+
+    // The rows of the image are split between the threads of the pool
+    // (including the calling thread). nullptr : rendering on the calling
+    // thread only (default). The pool must outlive the renderer.
+    void set_thread_pool(ThreadPool* pool) { pool_ = pool; }
+
+    // Geometry of the last rendered image.
+    const Geometry& geometry() const { return geometry_; }
+    // Number of times the pixel map was computed (for diagnostics).
+    unsigned int map_updates() const { return mapUpdates_; }
+
+    // Returns the image size as a std::pair(width,height). Throws if pingData
+    // is not a ping or if its content does not fit in it.
+    std::pair<unsigned int, unsigned int> render(const MessageData& pingData,
+                                                 std::vector<float>& imageData);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_FAN_RENDERER_H_
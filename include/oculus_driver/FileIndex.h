@@ -0,0 +1,122 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_FILE_INDEX_H_
+#define _DEF_OCULUS_DRIVER_FILE_INDEX_H_
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include <oculus_driver/OculusMessage.h>
+
+namespace oculus {
+
+/**
+ * Index of the sonar messages (rt_oculusSonar items) of a .oculus file.
+ *
+ * The index is built by hopping from item header to item header (only the
+ * metadata of the pings is read) and can be saved as a sidecar file next to
+ * the recording (<file>.oculus.idx) so it is built only once. The sidecar is
+ * rebuilt if the recording size or creation date does not match.
+ *
+ * Messages are assumed to be recorded in chronological order (which is the
+ * case for files written by Recorder and AsyncRecorder).
+ */
+class FileIndex
+{
+    public:
+
+    using Ptr      = std::shared_ptr<FileIndex>;
+    using ConstPtr = std::shared_ptr<const FileIndex>;
+
+    using TimePoint = Message::TimePoint;
+
+    static constexpr uint32_t MagicNumber = 0x5844494f; // "OIDX"
+    static constexpr uint32_t Version     = 1;
+
+    // Fixed size layout, written as is in the sidecar file.
+    struct Entry
+    {
+        uint64_t offset;     // position of the item header in the file
+        int64_t  stamp;      // Message::timestamp(), nanoseconds since epoch
+        uint32_t pingId;     // 0 if not a ping
+        float    range;      // meters (or percent for V2 pings, see PingWrapper::range)
+        uint16_t messageId;
+        uint16_t nBeams;
+        uint16_t nRanges;
+        uint8_t  masterMode;
+        uint8_t  messageVersion;
+
+        bool      is_ping()   const { return messageId == messageSimplePingResult; }
+        TimePoint timestamp() const { return TimePoint(std::chrono::nanoseconds(stamp)); }
+    };
+    static_assert(sizeof(Entry) == 32, "Unexpected FileIndex::Entry layout");
+
+    struct SidecarHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fileSize;  // size of the indexed file
+        double   fileTime;  // LogHeader::time of the indexed file
+        uint64_t entryCount;
+    };
+
+    protected:
+
+    uint64_t                  fileSize_;
+    double                    fileTime_;
+    std::vector<Entry>        entries_;
+    std::vector<std::size_t>  pings_;     // indexes of the pings in entries_
+    std::vector<std::size_t>  byPingId_;  // indexes of the pings sorted by pingId
+
+    void update_lookups();
+
+    public:
+
+    FileIndex() : fileSize_(0), fileTime_(0.0) {}
+
+    static Ptr build(const std::string& filename);
+    static Ptr load(const std::string& indexFilename);
+    // Loads the sidecar if it is up to date, builds (and saves) it otherwise.
+    static Ptr load_or_build(const std::string& filename, bool save = true);
+
+    static std::string sidecar_filename(const std::string& filename) {
+        return filename + ".idx";
+    }
+
+    bool save(const std::string& indexFilename) const;
+    bool matches(const std::string& filename) const;
+
+    const std::vector<Entry>& entries() const { return entries_; }
+    const Entry& operator[](std::size_t idx) const { return entries_[idx]; }
+
+    std::size_t message_count() const { return entries_.size(); }
+    std::size_t ping_count()    const { return pings_.size();   }
+
+    // These return an index in entries(), or message_count() if not found.
+    std::size_t find_time(const TimePoint& stamp) const; // first message at or after stamp
+    std::size_t find_ping(uint32_t pingId) const;        // first ping with this id
+    std::size_t find_ping_index(std::size_t pingIndex) const { // n-th ping of the file
+        return pingIndex < pings_.size() ? pings_[pingIndex] : entries_.size();
+    }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_FILE_INDEX_H_
@@ -0,0 +1,143 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_FILE_PLAYER_H_
+#define _DEF_OCULUS_DRIVER_FILE_PLAYER_H_
+
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include <boost/asio.hpp>
+
+#include <oculus_driver/SonarDriver.h>
+#include <oculus_driver/MappedFileReader.h>
+
+namespace oculus {
+
+/**
+ * Plays a .oculus file into a SonarDriver, as if the messages were received
+ * from a sonar.
+ *
+ * The messages are given to SonarDriver::handle_message from the io_service
+ * of the driver, so all the driver callbacks (ping, config, message,
+ * asynchronous callbacks...) are called the same way as with a live sonar.
+ * The messages are paced following their recorded timestamp divided by the
+ * playback speed (or sent as fast as possible if the speed is 0). The
+ * messages keep their recorded timestamps.
+ *
+ * The control methods can be called from any thread, they are executed in
+ * the io_service. The handlers posted to the io_service do nothing once the
+ * player is destroyed, so it can be destroyed from any thread (including
+ * the io_service one) and whether the io_service is running or not.
+ */
+class FilePlayer
+{
+    public:
+
+    using IoServicePtr  = SonarDriver::IoServicePtr;
+    using Timer         = boost::asio::steady_timer;
+    using Clock         = std::chrono::steady_clock;
+    using TimePoint     = Message::TimePoint;
+    using EndCallback   = std::function<void()>;
+
+    protected:
+
+    // Shared with the posted handlers. alive is cleared by the destructor,
+    // the mutex makes sure no handler is running at that time.
+    struct Guard
+    {
+        std::recursive_mutex mutex;
+        bool                 alive = true;
+    };
+
+    std::shared_ptr<Guard> guard_;
+
+    SonarDriver&     driver_;
+    IoServicePtr     ioService_;
+    Timer            timer_;
+    MappedFileReader reader_;   // only accessed in the io_service
+    FileIndex::ConstPtr index_; // built in the constructor, read-only after
+
+    // only accessed in the io_service
+    Message::ConstPtr next_;
+    bool              playing_;
+    double            speed_;
+    bool              loop_;
+    Clock::time_point anchorTime_;  // host date at which anchorStamp_ is played
+    TimePoint         anchorStamp_;
+    uint64_t          generation_;  // invalidates the scheduled sends
+    EndCallback       endCallback_;
+
+    std::atomic<bool>     isPlaying_; // copies for the other threads
+    std::atomic<bool>     finished_;
+    std::atomic<uint64_t> playedCount_;
+
+    // Wraps a handler so it is only called while the player exists.
+    template <class F>
+    auto guarded(F f) {
+        std::weak_ptr<Guard> guard = guard_;
+        return [guard, f](auto&&... args) {
+            auto g = guard.lock();
+            if(!g) return;
+            std::lock_guard<std::recursive_mutex> lock(g->mutex);
+            if(g->alive) {
+                f(std::forward<decltype(args)>(args)...);
+            }
+        };
+    }
+
+    void reset_anchor();
+    void schedule_next();
+    void send_next(uint64_t generation, const boost::system::error_code& err);
+    void do_seek(const std::function<bool()>& seek);
+
+    public:
+
+    FilePlayer(SonarDriver& driver, const std::string& filename);
+    ~FilePlayer();
+
+    FilePlayer(const FilePlayer&)            = delete;
+    FilePlayer& operator=(const FilePlayer&) = delete;
+
+    void play();
+    void pause();
+    bool is_playing() const { return isPlaying_; }
+    bool finished()   const { return finished_;  }
+
+    // 1.0 : real time, 10.0 : ten times faster, 0.0 : as fast as possible.
+    void set_speed(double speed);
+    // Restarts from the beginning of the file when the end is reached.
+    void set_loop(bool loop);
+    // Called in the io_service when the end of the file is reached (without loop).
+    void set_end_callback(const EndCallback& callback);
+
+    void rewind() { this->seek_to_message(0); }
+    bool seek_to_message(std::size_t messageIndex);
+    bool seek_to_time(const TimePoint& stamp);
+    bool seek_to_ping(uint32_t pingId);
+
+    std::size_t message_count() const { return index_->message_count(); }
+    uint64_t    played_count() const { return playedCount_; }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_FILE_PLAYER_H_
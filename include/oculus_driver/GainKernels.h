@@ -0,0 +1,59 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_GAIN_KERNELS_H_
+#define _DEF_OCULUS_DRIVER_GAIN_KERNELS_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace oculus {
+
+/**
+ * Vectorized conversion of the raw ping samples to float with gain
+ * compensation (see ping_data_to_array).
+ *
+ * The instruction set is chosen at runtime from the ones supported by the
+ * CPU (NEON is always used when the library is built for ARM). It can be
+ * forced with set_simd_level for testing or benchmarking. All the levels give
+ * the exact same results.
+ */
+enum class SimdLevel
+{
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512,
+    NEON
+};
+
+const char* simd_level_name(SimdLevel level);
+bool        simd_level_supported(SimdLevel level);
+SimdLevel   best_simd_level();
+
+SimdLevel   simd_level();
+// Returns false (and does nothing) if the level is not supported.
+bool        set_simd_level(SimdLevel level);
+
+// dst[i] = gain * src[i]
+void scale_to_float(const uint8_t*  src, float* dst, std::size_t count, float gain);
+void scale_to_float(const uint16_t* src, float* dst, std::size_t count, float gain);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_GAIN_KERNELS_H_
@@ -0,0 +1,62 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_HEADER_SCANNER_H_
+#define _DEF_OCULUS_DRIVER_HEADER_SCANNER_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace oculus {
+
+/**
+ * Vectorized search of an OculusMessageHeader start in a byte buffer.
+ *
+ * These functions look for the OCULUS_CHECK_ID value (bytes 0x53 0x4f) and,
+ * if srcDeviceId is positive, for the srcDeviceId value which follows it.
+ *
+ * They return the offset of the first candidate position. If there is no
+ * candidate, the returned value is the number of bytes which can be safely
+ * discarded (the last bytes are not discarded since they may be the beginning
+ * of a candidate split between two receptions). The returned value is
+ * therefore also the number of skipped bytes.
+ *
+ * Candidates still have to be validated by the caller (payloadSize...).
+ */
+std::size_t find_header_candidate(const uint8_t* data, std::size_t size,
+                                  int srcDeviceId = -1);
+
+// Name of the implementation selected at runtime ("avx2", "sse2" or "scalar").
+const char* header_scanner_implementation();
+
+namespace detail {
+
+std::size_t find_header_candidate_scalar(const uint8_t* data, std::size_t size,
+                                         int srcDeviceId);
+#if defined(__x86_64__) || defined(__i386__)
+std::size_t find_header_candidate_sse2(const uint8_t* data, std::size_t size,
+                                       int srcDeviceId);
+std::size_t find_header_candidate_avx2(const uint8_t* data, std::size_t size,
+                                       int srcDeviceId);
+#endif
+
+} //namespace detail
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_HEADER_SCANNER_H_
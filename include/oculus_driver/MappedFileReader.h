@@ -0,0 +1,124 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_MAPPED_FILE_READER_H_
+#define _DEF_OCULUS_DRIVER_MAPPED_FILE_READER_H_
+
+#include <memory>
+#include <string>
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/FileIndex.h>
+
+namespace oculus {
+
+/**
+ * Reads .oculus files through a read-only memory mapping of the whole file.
+ *
+ * Unlike FileReader, the returned messages are not copied from the file :
+ * Message::bytes() is a view on the mapping, and each message keeps the
+ * mapping alive (it stays valid after the reader is closed or destroyed).
+ * Compressed items and items not aligned to MessageData::Alignment in the
+ * file are copied. Each call to
+ * read_next_message returns a new Message which can be kept by the caller.
+ *
+ * The kernel is told the file is read sequentially (madvise) and the next
+ * prefetchSize bytes are requested ahead of the read position, so the page
+ * faults are mostly served from the page cache.
+ */
+class MappedFileReader
+{
+    public:
+
+    static constexpr uint32_t FileMagicNumber = Recorder::FileMagicNumber;
+    static constexpr uint32_t ItemMagicNumber = Recorder::ItemMagicNumber;
+
+    using TimeStamp = Recorder::TimeStamp;
+
+    enum Advice {
+        AdviceNormal,
+        AdviceSequential, // aggressive read-ahead, pages dropped after use
+        AdviceRandom      // no read-ahead (seeking a lot)
+    };
+
+    // Unmapped when the last reference is released.
+    struct Mapping
+    {
+        const uint8_t* data;
+        std::size_t    size;
+
+        Mapping(const uint8_t* d, std::size_t s) : data(d), size(s) {}
+        ~Mapping();
+
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+    };
+
+    protected:
+
+    std::string                    filename_;
+    std::shared_ptr<const Mapping> mapping_;
+    blueprint::LogHeader           fileHeader_;
+    blueprint::LogItem             nextItem_; // type == 0 at end of file
+    std::size_t                    itemPosition_;
+    std::size_t                    prefetchSize_;
+    std::size_t                    prefetchedEnd_;
+    FileIndex::ConstPtr            index_;
+
+    void read_next_header(std::size_t position);
+    void check_next_payload() const;
+    void prefetch();
+
+    public:
+
+    MappedFileReader(const std::string& filename,
+                     Advice advice = AdviceSequential,
+                     std::size_t prefetchSize = 16*1024*1024);
+
+    void open(const std::string& filename, Advice advice = AdviceSequential);
+    void close()         { mapping_ = nullptr; }
+    bool is_open() const { return mapping_ != nullptr; }
+    void rewind();
+
+    void advise(Advice advice);
+
+    const blueprint::LogHeader& file_header() const { return fileHeader_; }
+    std::size_t file_size() const { return mapping_ ? mapping_->size : 0; }
+
+    std::size_t current_item_position() const { return itemPosition_; }
+
+    const blueprint::LogItem& next_item_header() const { return nextItem_; }
+    const uint8_t* next_item_data() const; // nullptr at end of file
+    std::size_t jump_item();
+    void seek_item(std::size_t position); // position from current_item_position
+
+    Message::ConstPtr     read_next_message();
+    PingMessage::ConstPtr read_next_ping();
+
+    // Same as FileReader.
+    const FileIndex& index();
+    void set_index(const FileIndex::ConstPtr& index) { index_ = index; }
+    std::size_t message_count() { return this->index().message_count(); }
+    bool seek_to_message(std::size_t messageIndex);
+    bool seek_to_time(const Message::TimePoint& stamp);
+    bool seek_to_ping(uint32_t pingId);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_MAPPED_FILE_READER_H_
@@ -0,0 +1,76 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_MESSAGE_POOL_H_
+#define _DEF_OCULUS_DRIVER_MESSAGE_POOL_H_
+
+#include <vector>
+#include <memory>
+
+#include <oculus_driver/OculusMessage.h>
+
+namespace oculus {
+
+/**
+ * Fixed capacity pool of preallocated Message buffers.
+ *
+ * The pool keeps a reference on each of its messages. A message is considered
+ * free when the pool holds the only reference to it, i.e. when every
+ * Message::ConstPtr handed to the users has been dropped. The data_ vector of a
+ * reused Message is only resized, so once the buffers have grown to the
+ * largest message size there is no more allocation on reception.
+ *
+ * acquire() is meant to be called from a single thread (the reception loop).
+ * Releasing a message (dropping the last ConstPtr) can happen from any thread.
+ *
+ * If all the messages are in use, acquire() allocates a new Message which is
+ * not part of the pool (the miss_count() is incremented so this can be
+ * detected and the pool capacity adjusted).
+ */
+class MessagePool
+{
+    public:
+
+    using Ptr      = std::shared_ptr<MessagePool>;
+    using ConstPtr = std::shared_ptr<const MessagePool>;
+
+    protected:
+
+    std::vector<Message::Ptr> messages_;
+    std::size_t               next_;
+    std::size_t               reservedSize_;
+    std::size_t               missCount_;
+
+    public:
+
+    MessagePool(std::size_t capacity = 16, std::size_t reservedSize = 0);
+
+    Message::Ptr acquire();
+    // Adds messages until the pool holds at least capacity messages. To be
+    // called from the thread calling acquire().
+    void grow(std::size_t capacity);
+
+    std::size_t capacity()      const { return messages_.size(); }
+    std::size_t reserved_size() const { return reservedSize_;    }
+    std::size_t miss_count()    const { return missCount_;       }
+    std::size_t available()     const;
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_MESSAGE_POOL_H_
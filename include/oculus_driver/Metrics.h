@@ -0,0 +1,141 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_METRICS_H_
+#define _DEF_OCULUS_DRIVER_METRICS_H_
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+namespace oculus {
+
+/**
+ * Summary of a LatencyHistogram. All durations are in microseconds.
+ */
+struct HistogramSnapshot
+{
+    uint64_t count;
+    double   min;
+    double   max;
+    double   mean;
+    double   p50;
+    double   p90;
+    double   p99;
+    double   p999;
+};
+
+/**
+ * Histogram of durations with a bounded relative error (HDR-style).
+ *
+ * Durations are recorded in nanoseconds in log-linear buckets : each power of
+ * two is split in 2^SubBucketBits buckets, giving a resolution of about 6%
+ * over the whole range. record() is lock-free and wait-free (except for the
+ * min/max update) and can be called concurrently with snapshot().
+ */
+class LatencyHistogram
+{
+    public:
+
+    static constexpr unsigned int SubBucketBits  = 4;
+    static constexpr unsigned int SubBucketCount = 1u << SubBucketBits;
+    static constexpr unsigned int MaxExponent    = 40; // ~18 minutes
+    static constexpr unsigned int BucketCount    =
+        (MaxExponent - SubBucketBits + 1) << SubBucketBits;
+
+    protected:
+
+    std::array<std::atomic<uint64_t>, BucketCount> buckets_;
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> min_;
+    std::atomic<uint64_t> max_;
+
+    static unsigned int bucket_index(uint64_t value);
+    static uint64_t     bucket_value(unsigned int index);
+
+    public:
+
+    LatencyHistogram() { this->reset(); }
+
+    void record(uint64_t nanoseconds);
+    template <class Rep, class Period>
+    void record(const std::chrono::duration<Rep,Period>& duration) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        this->record((uint64_t)(ns > 0 ? ns : 0));
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    void reset();
+    HistogramSnapshot snapshot() const;
+};
+
+/**
+ * Instrumentation of the reception pipeline of a SonarClient / SonarDriver.
+ */
+struct MetricsSnapshot
+{
+    HistogramSnapshot frameAssembly;    // first byte of a message -> message complete
+    HistogramSnapshot dispatch;         // message complete -> handle_message returned
+    HistogramSnapshot messageCallbacks; // execution time of each callback queue
+    HistogramSnapshot pingCallbacks;
+    HistogramSnapshot dummyCallbacks;
+    HistogramSnapshot configCallbacks;
+    HistogramSnapshot pingInterval;     // between the reception of two pings
+
+    uint64_t bytesReceived;
+    uint64_t messagesReceived;
+    uint64_t resyncCount;       // number of times the framer lost the stream
+    uint64_t skippedBytes;      // bytes discarded while resynchronizing
+    uint64_t reconnectCount;
+    uint64_t configRetryCount;  // config requests sent again without feedback
+};
+
+class DriverMetrics
+{
+    public:
+
+    LatencyHistogram frameAssembly;
+    LatencyHistogram dispatch;
+    LatencyHistogram messageCallbacks;
+    LatencyHistogram pingCallbacks;
+    LatencyHistogram dummyCallbacks;
+    LatencyHistogram configCallbacks;
+    LatencyHistogram pingInterval;
+
+    std::atomic<uint64_t> bytesReceived;
+    std::atomic<uint64_t> messagesReceived;
+    std::atomic<uint64_t> resyncCount;
+    std::atomic<uint64_t> skippedBytes;
+    std::atomic<uint64_t> reconnectCount;
+    std::atomic<uint64_t> configRetryCount;
+
+    DriverMetrics() { this->reset(); }
+
+    void reset();
+    MetricsSnapshot snapshot() const;
+};
+
+std::ostream& operator<<(std::ostream& os, const HistogramSnapshot& hist);
+std::ostream& operator<<(std::ostream& os, const MetricsSnapshot& metrics);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_METRICS_H_
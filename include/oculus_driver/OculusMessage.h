@@ -20,6 +20,8 @@
 #define _DEF_OCULUS_DRIVER_OCULUS_MESSAGE_H_
 
 #include <vector>
+#include <memory>
+#include <mutex>
 #include <chrono>
 #include <cstring>
 
@@ -31,6 +33,48 @@ namespace oculus {
 // Forward declaration for friend class declarations
 class SonarClient;
 class FileReader;
+class MappedFileReader;
+class MessagePool;
+
+/**
+ * Read-only view on the bytes of a Message (header included).
+ *
+ * The bytes are either owned by the Message or by a memory mapped file (see
+ * MappedFileReader). A MessageData is only valid while the Message it was
+ * taken from is alive. The view returned by Message::bytes() is aligned to
+ * at least Alignment bytes (the helpers read the samples, the gains and the
+ * bearings in place).
+ */
+class MessageData
+{
+    public:
+
+    static constexpr std::size_t Alignment = alignof(uint32_t);
+
+    protected:
+
+    const uint8_t* data_;
+    std::size_t    size_;
+
+    public:
+
+    MessageData() : data_(nullptr), size_(0) {}
+    MessageData(const uint8_t* data, std::size_t size) : data_(data), size_(size) {}
+    MessageData(const std::vector<uint8_t>& data) : data_(data.data()), size_(data.size()) {}
+
+    const uint8_t* data()  const { return data_;      }
+    std::size_t    size()  const { return size_;      }
+    bool           empty() const { return size_ == 0; }
+
+    const uint8_t* begin() const { return data_;         }
+    const uint8_t* end()   const { return data_ + size_; }
+    uint8_t operator[](std::size_t idx) const { return data_[idx]; }
+
+    bool operator==(const MessageData& other) const {
+        return size_ == other.size_ && (size_ == 0 || std::memcmp(data_, other.data_, size_) == 0);
+    }
+    bool operator!=(const MessageData& other) const { return !(*this == other); }
+};
 
 class Message
 {
@@ -38,9 +82,11 @@ class Message
 
     // Only the SonarClient and FileReader classes are able to modify this
     // type. This is to ensure consistency between the header_ and data_
-    // fields.
+    // fields. (The MessagePool only preallocates the data_ field).
     friend class SonarClient;
     friend class FileReader;
+    friend class MappedFileReader;
+    friend class MessagePool;
 
     using Ptr        = std::shared_ptr<Message>;
     using ConstPtr   = std::shared_ptr<const Message>;
@@ -51,26 +97,61 @@ class Message
     protected:
     
     TimePoint            timestamp_;
+    TimePoint            kernelTimestamp_; // Epoch if not available
     OculusMessageHeader  header_;
     std::vector<uint8_t> data_;
 
-    void update_from_header() {
-        timestamp_ = TimeSource::now();
+    // Bytes not owned by data_ (memory mapped file). The owner keeps them
+    // alive as long as this message (or a copy of it) exists.
+    MessageData                 externalData_;
+    std::shared_ptr<const void> externalOwner_;
+
+    // Copy of the external bytes, made on the first call to data().
+    struct ExternalCopy {
+        std::once_flag       once;
+        std::vector<uint8_t> data;
+    };
+    std::shared_ptr<ExternalCopy> externalCopy_;
+
+    void update_from_header(const TimePoint& stamp = TimeSource::now(),
+                            const TimePoint& kernelStamp = TimePoint()) {
+        timestamp_       = stamp;
+        kernelTimestamp_ = kernelStamp;
+        this->release_external_data();
         data_.resize(header_.payloadSize + sizeof(header_));
         *reinterpret_cast<OculusMessageHeader*>(data_.data()) = header_;
     }
     void update_from_data() {
+        this->release_external_data();
         header_ = *reinterpret_cast<const OculusMessageHeader*>(data_.data());
     }
     uint8_t* payload_handle() { return data_.data() + sizeof(header_); }
 
+    void set_external_data(const uint8_t* data, std::size_t size,
+                           const std::shared_ptr<const void>& owner) {
+        data_.clear();
+        externalData_  = MessageData(data, size);
+        externalOwner_ = owner;
+        externalCopy_  = std::make_shared<ExternalCopy>();
+        std::memcpy(&header_, data, sizeof(header_));
+    }
+    void release_external_data() {
+        externalData_ = MessageData();
+        externalOwner_.reset();
+        externalCopy_.reset();
+    }
+
     public:// have to leave constructors public for pybind11
 
     Message() { std::memset(&header_, 0, sizeof(header_)); }
     Message(const Message& other) :
         timestamp_(other.timestamp_),
+        kernelTimestamp_(other.kernelTimestamp_),
         header_(other.header_),
-        data_(other.data_)
+        data_(other.data_),
+        externalData_(other.externalData_),
+        externalOwner_(other.externalOwner_),
+        externalCopy_(other.externalCopy_)
     {}
 
     public:
@@ -97,8 +178,34 @@ class Message
     Ptr copy() const { return Create(*this); }
     
     const OculusMessageHeader&  header()    const { return header_;    }
-    const std::vector<uint8_t>& data()      const { return data_;      }
     const TimePoint&            timestamp() const { return timestamp_; }
+    const std::vector<uint8_t>& data()      const {
+        if(!externalOwner_) {
+            return data_;
+        }
+        // Mapped message : the bytes are copied on the first call. Use
+        // bytes() to read them in place.
+        std::call_once(externalCopy_->once, [this]() {
+            externalCopy_->data.assign(externalData_.begin(), externalData_.end());
+        });
+        return externalCopy_->data;
+    }
+
+    // View on the bytes, wherever they are stored (no copy).
+    MessageData bytes() const {
+        return externalOwner_ ? externalData_ : MessageData(data_);
+    }
+
+    // True if the bytes are a view on a memory mapped file (no copy was made).
+    bool is_mapped() const { return externalOwner_ != nullptr; }
+
+    // Reception date of the message as given by the kernel (only available if
+    // enabled with SonarClient::enable_kernel_timestamps, see there for what
+    // it measures exactly).
+    const TimePoint& kernel_timestamp()     const { return kernelTimestamp_; }
+    bool             has_kernel_timestamp() const {
+        return kernelTimestamp_.time_since_epoch().count() != 0;
+    }
     
     // getters below here are merely helpers to read the data.
     uint16_t message_id()      const { return header_.msgId;       }
@@ -136,6 +243,7 @@ class PingWrapper
     Message::ConstPtr           message()   const { return msg_;              }
     const OculusMessageHeader&  header()    const { return msg_->header();    }
     const std::vector<uint8_t>& data()      const { return msg_->data();      }
+    MessageData                 bytes()     const { return msg_->bytes();     }
     const TimePoint&            timestamp() const { return msg_->timestamp(); }
 
     uint32_t step() const {
@@ -157,6 +265,9 @@ class PingWrapper
 
     virtual uint32_t ping_index()          const = 0;
     virtual uint32_t ping_firing_date()    const = 0;
+    // Raw pingStartTime value in the sonar clock (unit depends on the
+    // message version, see ClockSync).
+    virtual double   ping_start_time()     const = 0;
     virtual double   range()               const = 0;
     virtual double   gain_percent()        const = 0;
     virtual double   frequency()           const = 0;
@@ -186,22 +297,29 @@ class PingWrapper1 : public PingWrapper
 
     public:
 
-    static Ptr Create(const Message::ConstPtr& msg) { return Ptr(new PingWrapper1(msg)); }
+    static Ptr Create(const Message::ConstPtr& msg) {
+        // The constructor is protected, make_shared needs a public one. The
+        // object and its reference count are allocated in a single block.
+        struct Shared : public PingWrapper1 {
+            Shared(const Message::ConstPtr& msg) : PingWrapper1(msg) {}
+        };
+        return std::make_shared<Shared>(msg);
+    }
 
     //virtual Ptr copy() const { return Create(this->msg_->copy()); } // not compiling
     virtual PingWrapper::Ptr copy() const { return Create(this->msg_->copy()); }
 
     const OculusSimplePingResult& metadata() const {
-        return *reinterpret_cast<const OculusSimplePingResult*>(this->msg_->data().data());
+        return *reinterpret_cast<const OculusSimplePingResult*>(this->msg_->bytes().data());
     }
 
     virtual uint16_t       range_count()   const { return this->metadata().nRanges; }
     virtual uint16_t       bearing_count() const { return this->metadata().nBeams;  }
     virtual const int16_t* bearing_data()  const {
-        return (const int16_t*)(this->data().data() + sizeof(this->metadata()));
+        return (const int16_t*)(this->bytes().data() + sizeof(this->metadata()));
     }
     virtual const uint8_t* ping_data() const {
-        return this->data().data() + this->metadata().imageOffset;
+        return this->bytes().data() + this->metadata().imageOffset;
     }
     virtual uint32_t ping_data_size() const { return this->metadata().imageSize; }
 
@@ -233,6 +351,7 @@ class PingWrapper1 : public PingWrapper
 
     virtual uint32_t ping_index()          const { return this->metadata().pingId;                  }
     virtual uint32_t ping_firing_date()    const { return this->metadata().pingStartTime;           }
+    virtual double   ping_start_time()     const { return this->metadata().pingStartTime;           }
     virtual double   range()               const { return this->metadata().fireMessage.range;       }
     virtual double   gain_percent()        const { return this->metadata().fireMessage.gainPercent; } 
     virtual double   frequency()           const { return this->metadata().frequency;               }
@@ -262,22 +381,28 @@ class PingWrapper2 : public PingWrapper
 
     public:
 
-    static Ptr Create(const Message::ConstPtr& msg) { return Ptr(new PingWrapper2(msg)); }
+    static Ptr Create(const Message::ConstPtr& msg) {
+        // See PingWrapper1::Create.
+        struct Shared : public PingWrapper2 {
+            Shared(const Message::ConstPtr& msg) : PingWrapper2(msg) {}
+        };
+        return std::make_shared<Shared>(msg);
+    }
 
     //virtual Ptr copy() const { return Create(this->msg_->copy()); } // not compiling
     virtual PingWrapper::Ptr copy() const { return Create(this->msg_->copy()); }
 
     const OculusSimplePingResult2& metadata() const {
-        return *reinterpret_cast<const OculusSimplePingResult2*>(this->msg_->data().data());
+        return *reinterpret_cast<const OculusSimplePingResult2*>(this->msg_->bytes().data());
     }
 
     virtual uint16_t       range_count()   const { return this->metadata().nRanges; }
     virtual uint16_t       bearing_count() const { return this->metadata().nBeams;  }
     virtual const int16_t* bearing_data()  const {
-        return (const int16_t*)(this->data().data() + sizeof(this->metadata()));
+        return (const int16_t*)(this->bytes().data() + sizeof(this->metadata()));
     }
     virtual const uint8_t* ping_data() const {
-        return this->data().data() + this->metadata().imageOffset;
+        return this->bytes().data() + this->metadata().imageOffset;
     }
     virtual uint32_t ping_data_size() const { return this->metadata().imageSize; }
 
@@ -312,6 +437,7 @@ class PingWrapper2 : public PingWrapper
 
     virtual uint32_t ping_index()        const { return this->metadata().pingId;                   }
     virtual uint32_t ping_firing_date()  const { return (uint32_t)this->metadata().pingStartTime;  }
+    virtual double ping_start_time()     const { return this->metadata().pingStartTime;            }
     virtual double range()               const { return this->metadata().fireMessage.rangePercent; }
     virtual double gain_percent()        const { return this->metadata().fireMessage.gainPercent;  } 
     virtual double frequency()           const { return this->metadata().frequency;                }
@@ -325,6 +451,9 @@ class PingMessage
 {
     public:
 
+    // The SonarDriver sets the acquisition date from its clock synchronization.
+    friend class SonarDriver;
+
     using Ptr      = std::shared_ptr<PingMessage>;
     using ConstPtr = std::shared_ptr<const PingMessage>;
 
@@ -346,16 +475,18 @@ class PingMessage
     protected:
 
     PingWrapper::ConstPtr pingData_;
+    TimePoint             acquisitionTimestamp_; // Epoch if not available
 
     public: // for pybind11
 
     PingMessage(const Message::ConstPtr& msg) :
-        pingData_(make_ping_wrapper(msg))
+        pingData_(make_ping_wrapper(msg)),
+        acquisitionTimestamp_()
     {}
 
     public:
 
-    static Ptr Create(const Message::ConstPtr& msg) { return Ptr(new PingMessage(msg)); }
+    static Ptr Create(const Message::ConstPtr& msg) { return std::make_shared<PingMessage>(msg); }
     static Ptr Create(unsigned int size, const uint8_t* data, 
                       const TimePoint& stamp = TimePoint())
     {
@@ -370,7 +501,17 @@ class PingMessage
     Message::ConstPtr           message()   const { return pingData_->message();   }
     const OculusMessageHeader&  header()    const { return pingData_->header();    }
     const std::vector<uint8_t>& data()      const { return pingData_->data();      }
+    MessageData                 bytes()     const { return pingData_->bytes();     }
     const TimePoint&            timestamp() const { return pingData_->timestamp(); }
+
+    // Date of the ping in host time, deduced from the sonar clock (see
+    // ClockSync). Falls back to the reception date if not available.
+    bool has_acquisition_timestamp() const {
+        return acquisitionTimestamp_.time_since_epoch().count() != 0;
+    }
+    const TimePoint& acquisition_timestamp() const {
+        return this->has_acquisition_timestamp() ? acquisitionTimestamp_ : this->timestamp();
+    }
     
     uint16_t       range_count()    const { return pingData_->range_count();   }
     uint16_t       bearing_count()  const { return pingData_->bearing_count(); }
@@ -379,10 +520,10 @@ class PingMessage
     uint32_t       step()           const { return pingData_->step();          }
     uint32_t       ping_data_size() const { return pingData_->ping_data_size();}
     uint32_t bearing_data_offset() const {
-        return ((const uint8_t*)this->bearing_data()) - this->data().data();
+        return ((const uint8_t*)this->bearing_data()) - this->bytes().data();
     }
     uint32_t ping_data_offset() const {
-        return this->ping_data() - this->data().data();
+        return this->ping_data() - this->bytes().data();
     }
     
     bool    has_gains()   const { return pingData_->has_gains();   }
@@ -391,6 +532,7 @@ class PingMessage
 
     uint32_t ping_index()          const { return pingData_->ping_index();          }
     uint32_t ping_firing_date()    const { return pingData_->ping_firing_date();    }
+    double   ping_start_time()     const { return pingData_->ping_start_time();     }
     double   range()               const { return pingData_->range();               }
     double   gain_percent()        const { return pingData_->gain_percent();        }
     double   frequency()           const { return pingData_->frequency();           }
@@ -0,0 +1,134 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_PING_DECODER_H_
+#define _DEF_OCULUS_DRIVER_PING_DECODER_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <type_traits>
+
+#include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/ThreadPool.h>
+
+namespace oculus {
+
+/**
+ * Layout of the acoustic data of a ping, resolved once from the ping
+ * metadata (message version, dataSize, gain flag and image size).
+ *
+ * The gain flag is only trusted for the version 1 messages. For version 2
+ * the presence of the gains is deduced from the image size.
+ */
+struct PingFormat
+{
+    uint8_t  version;     // message version (1 or 2)
+    uint8_t  sampleSize;  // 1, 2, 3 or 4 bytes, 0 if the format is invalid
+    bool     hasGains;    // 32 bits gain at the beginning of each row
+    uint16_t nBeams;
+    uint16_t nRanges;
+    uint32_t imageOffset;
+    uint32_t rowSize;     // bytes per range row, gain included
+
+    bool is_valid() const { return sampleSize > 0; }
+
+    // Throws if pingData is not a ping. The format is invalid if the sample
+    // size cannot be deduced or if the image does not fit in pingData.
+    static PingFormat resolve(const MessageData& pingData);
+};
+
+/**
+ * Converts the rows [firstRange, lastRange) of the ping image to float (gain
+ * compensated, dst[nBeams*rangeIndex + bearingIndex], same as
+ * ping_data_to_array).
+ *
+ * There is one kernel per sample size and gain presence, instantiated from a
+ * template, so the row loops have no branch on the format. The differences
+ * between message versions (metadata layout, how the gains are signaled) are
+ * handled by PingFormat.
+ */
+using PingKernel = void (*)(const PingFormat& format, const uint8_t* imageData,
+                            float* dst, unsigned int firstRange, unsigned int lastRange);
+
+// nullptr if the format is invalid.
+PingKernel select_ping_kernel(const PingFormat& format);
+
+/**
+ * Same as the kernels, for other destination types than float. The samples
+ * are converted directly into T with generic code (the float kernels use the
+ * SIMD gain kernels). The format is expected to be valid.
+ */
+template <unsigned int SampleSize>
+inline uint32_t load_ping_sample(const uint8_t* src)
+{
+    if constexpr(SampleSize == 1) {
+        return src[0];
+    }
+    else if constexpr(SampleSize == 3) {
+        return src[0] | (src[1] << 8) | (src[2] << 16);
+    }
+    else {
+        typename std::conditional<SampleSize == 2, uint16_t, uint32_t>::type value;
+        std::memcpy(&value, src, sizeof(value));
+        return value;
+    }
+}
+
+template <unsigned int SampleSize, typename T>
+inline void scale_ping_samples(const uint8_t* src, T* dst, std::size_t count, float gain)
+{
+    for(std::size_t i = 0; i < count; i++, src += SampleSize) {
+        // Same arithmetic as the float kernels.
+        dst[i] = gain * load_ping_sample<SampleSize>(src);
+    }
+}
+
+template <typename T>
+inline void decode_ping_rows_as(const PingFormat& format, const uint8_t* imageData,
+                                T* dst, unsigned int firstRange, unsigned int lastRange)
+{
+    std::size_t nBeams = format.nBeams;
+    for(unsigned int r = firstRange; r < lastRange; r++) {
+        const uint8_t* row = imageData + (std::size_t)format.rowSize*r;
+        float gain = 1.0f;
+        if(format.hasGains) {
+            uint32_t rowGain;
+            std::memcpy(&rowGain, row, sizeof(rowGain));
+            gain = 1.0f / std::sqrt((float)rowGain);
+            row += sizeof(rowGain);
+        }
+        switch(format.sampleSize) {
+            case 1: scale_ping_samples<1>(row, dst + nBeams*r, nBeams, gain); break;
+            case 2: scale_ping_samples<2>(row, dst + nBeams*r, nBeams, gain); break;
+            case 3: scale_ping_samples<3>(row, dst + nBeams*r, nBeams, gain); break;
+            case 4: scale_ping_samples<4>(row, dst + nBeams*r, nBeams, gain); break;
+            default: break;
+        }
+    }
+}
+
+// Resolves the format and converts the whole ping (on the pool threads if a
+// pool is given). Throws if the format is invalid.
+PingFormat decode_ping(const MessageData& pingData, std::vector<float>& dst,
+                       ThreadPool* pool = nullptr);
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_PING_DECODER_H_
@@ -0,0 +1,90 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_PREFETCH_READER_H_
+#define _DEF_OCULUS_DRIVER_PREFETCH_READER_H_
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include <oculus_driver/Recorder.h>
+
+namespace oculus {
+
+/**
+ * Reads a .oculus file ahead of the caller from a background thread.
+ *
+ * The reader thread fills a bounded queue of messages with large block reads
+ * (the stream buffer is bufferSize bytes), so the file I/O overlaps with the
+ * processing of the previous messages. This matters on network storage where
+ * each read has a large latency. Same interface as FileReader, except that
+ * the returned messages are never reused and can be kept by the caller.
+ */
+class PrefetchReader
+{
+    protected:
+
+    FileReader          reader_; // only used by the reader thread while running
+    FileIndex::ConstPtr index_;  // built before the thread starts, read-only after
+    std::size_t queueDepth_;
+
+    mutable std::mutex       mutex_;
+    std::condition_variable  notFull_;
+    std::condition_variable  notEmpty_;
+    std::deque<Message::Ptr> queue_;
+    bool                     endOfFile_;
+    bool                     stopping_;
+    std::exception_ptr       error_;
+    std::thread              thread_;
+
+    void start();
+    void stop();
+    void reader_loop();
+
+    public:
+
+    PrefetchReader(const std::string& filename,
+                   std::size_t queueDepth = 64,
+                   std::size_t bufferSize = 4*1024*1024);
+    ~PrefetchReader();
+
+    PrefetchReader(const PrefetchReader&)            = delete;
+    PrefetchReader& operator=(const PrefetchReader&) = delete;
+
+    const blueprint::LogHeader& file_header() const { return reader_.file_header(); }
+
+    // Blocks until a message was read. Returns nullptr at the end of the file.
+    // Rethrows the errors of the reader thread.
+    Message::ConstPtr     read_next_message();
+    PingMessage::ConstPtr read_next_ping();
+
+    void rewind();
+    std::size_t message_count() const { return index_->message_count(); }
+    bool seek_to_message(std::size_t messageIndex);
+    bool seek_to_time(const Message::TimePoint& stamp);
+    bool seek_to_ping(uint32_t pingId);
+
+    std::size_t queued() const; // number of messages ready to be read
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_PREFETCH_READER_H_
@@ -7,6 +7,9 @@
 #include <sstream>
 
 #include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/FileIndex.h>
+#include <oculus_driver/Compression.h>
+#include <oculus_driver/Trace.h>
 
 namespace oculus {
 
@@ -132,6 +135,11 @@ class Recorder
     std::string           filename_;
     mutable std::ofstream file_;
 
+    Codec                        codec_;
+    int                          compressionLevel_;
+    mutable std::vector<uint8_t> compressed_;
+    mutable CompressionStats     compressionStats_;
+
     public:
 
     Recorder();
@@ -147,6 +155,15 @@ class Recorder
     std::size_t write(const Message::ConstPtr& message) const {
         return this->write(*message);
     }
+
+    // Sonar messages are compressed with this codec (timestamps items are
+    // not). Throws if the codec is not available in this build.
+    void set_compression(Codec codec, int level = DefaultCompressionLevel);
+    Codec compression() const { return codec_; }
+    const CompressionStats& compression_stats() const { return compressionStats_; }
+
+    static blueprint::LogHeader make_file_header();
+    static blueprint::LogItem   make_item(uint16_t type, double time, uint32_t size);
 };
 
 class FileReader
@@ -163,10 +180,13 @@ class FileReader
     protected:
 
     std::string                filename_;
+    std::vector<char>          fileBuffer_;
     mutable std::ifstream      file_;
     mutable blueprint::LogItem nextItem_;
     mutable std::size_t        itemPosition_;
+    mutable std::vector<uint8_t> compressed_;
     blueprint::LogHeader       fileHeader_;
+    mutable FileIndex::ConstPtr index_;
 
     Message::Ptr message_;
 
@@ -174,7 +194,9 @@ class FileReader
 
     public:
 
-    FileReader(const std::string& filename);
+    // bufferSize : size of the stream buffer (0 for the default one). Large
+    // buffers make less (and larger) reads, useful on network storage.
+    FileReader(const std::string& filename, std::size_t bufferSize = 0);
     ~FileReader();
 
     void open(const std::string& filename);
@@ -190,12 +212,24 @@ class FileReader
     std::size_t read_next_item(uint8_t* dst) const; // data is assumed to have been reserved
                                                     // using size given in next_item_header
     std::size_t jump_item() const;
+    void seek_item(std::size_t position); // position from current_item_position
 
-    // These are for convenience
+    // These are for convenience. Compressed items are decompressed.
     std::size_t read_next_item(std::vector<uint8_t>& dst) const;
 
-    Message::ConstPtr     read_next_message() const;
+    Message::ConstPtr     read_next_message() const; // valid until the next read
+    bool                  read_next_message(Message& dst) const;
     PingMessage::ConstPtr read_next_ping()    const;
+
+    // Random access through the file index (loaded from the sidecar file or
+    // built on first use). The seek methods return false if the requested
+    // message does not exist (the read position is then unchanged).
+    const FileIndex& index() const;
+    void set_index(const FileIndex::ConstPtr& index) { index_ = index; }
+    std::size_t message_count() const { return this->index().message_count(); }
+    bool seek_to_message(std::size_t messageIndex);
+    bool seek_to_time(const Message::TimePoint& stamp);
+    bool seek_to_ping(uint32_t pingId);
 };
 
 } // namespace oculus
@@ -28,6 +28,7 @@
 #include <thread>
 #include <chrono>
 #include <type_traits>
+#include <atomic>
 
 #include <boost/asio.hpp>
 
@@ -37,6 +38,10 @@
 #include <oculus_driver/StatusListener.h>
 
 #include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/MessagePool.h>
+#include <oculus_driver/StreamFramer.h>
+#include <oculus_driver/Metrics.h>
+#include <oculus_driver/Trace.h>
 
 namespace oculus {
 
@@ -86,20 +91,45 @@ class SonarClient
     StatusListener statusListener_;
     unsigned int   statusCallbackId_;
 
+    // Each received message is read in a buffer taken from messagePool_. It
+    // is only reused once all the users dropped their reference on it, so
+    // messages can be kept or handed to other threads without a copy.
+    MessagePool  messagePool_;
     Message::Ptr message_;
 
+    // Incoming data is read in large chunks and split into messages here.
+    StreamFramer framer_;
+    uint64_t     reportedSkippedBytes_;
+
+    // If true, the reception date given by the kernel is retrieved with each
+    // chunk of data (see enable_kernel_timestamps()).
+    std::atomic<bool> kernelTimestamps_;
+
+    // Latencies and counters of the reception pipeline (see metrics()).
+    DriverMetrics metrics_;
+
     // helper stubs
     void checker_callback(const boost::system::error_code& err);
     void check_reception(const boost::system::error_code& err);
+    bool setup_kernel_timestamps();
+    void process_received_data(std::size_t receivedByteCount,
+                               const TimePoint& stamp,
+                               const TimePoint& kernelStamp = TimePoint());
 
     public:
 
     SonarClient(const IoServicePtr& ioService,
-                const Duration& checkerPeriod = boost::posix_time::seconds(1));
+                const Duration& checkerPeriod = boost::posix_time::seconds(1),
+                std::size_t messagePoolSize = 16);
+
+    const IoServicePtr& io_service() const { return ioService_; }
 
     bool is_valid(const OculusMessageHeader& header);
     bool connected() const;
 
+    bool enable_kernel_timestamps(bool enable = true);
+    bool kernel_timestamps_enabled() const { return kernelTimestamps_; }
+
     size_t send(const boost::asio::streambuf& buffer) const;
 
     // initialization states
@@ -111,10 +141,9 @@ class SonarClient
 
     // main loop begin
     void initiate_receive();
-    void header_received_callback(const boost::system::error_code err,
-                                  std::size_t receivedByteCount);
     void data_received_callback(const boost::system::error_code err,
                                 std::size_t receivedByteCount);
+    void data_available_callback(const boost::system::error_code err);
     
     // This is called regardless of the content of the message.
     // To be reimplemented in a subclass (does nothing by default).
@@ -124,6 +153,12 @@ class SonarClient
     TimeT time_since_last_message() const { return clock_.now<TimeT>(); }
 
     TimePoint last_header_stamp() const { return message_->timestamp(); }
+
+    const MessagePool&  message_pool() const { return messagePool_; }
+    const StreamFramer& framer()       const { return framer_;      }
+
+    MetricsSnapshot metrics() const { return metrics_.snapshot(); }
+    void reset_metrics() { metrics_.reset(); }
 };
 
 } //namespace oculus
@@ -19,14 +19,55 @@
 #ifndef _DEF_OCULUS_DRIVER_SONAR_DRIVER_H_
 #define _DEF_OCULUS_DRIVER_SONAR_DRIVER_H_
 
+#include <future>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include <exception>
+
 #include <oculus_driver/Oculus.h>
 #include <oculus_driver/utils.h>
 #include <oculus_driver/print_utils.h>
 #include <oculus_driver/CallbackQueue.h>
 #include <oculus_driver/SonarClient.h>
+#include <oculus_driver/ClockSync.h>
+#include <oculus_driver/AsyncDispatcher.h>
 
 namespace oculus {
 
+/**
+ * Parameters of SonarDriver::request_ping_config_async.
+ */
+struct ConfigRequestOptions
+{
+    using Duration = boost::posix_time::time_duration;
+
+    // The request fails if no matching feedback was received after deadline.
+    Duration     deadline    = boost::posix_time::seconds(10);
+    // The request is sent again if no matching feedback was received after
+    // retryPeriod, at most maxRetries times.
+    Duration     retryPeriod = boost::posix_time::milliseconds(500);
+    unsigned int maxRetries  = 20;
+};
+
+struct ConfigRequestTimeout : public std::exception {
+    const char* what() const throw() {
+        return "Deadline reached before getting a matching config feedback.";
+    }
+};
+
+struct ConfigRequestSendError : public std::exception {
+    const char* what() const throw() {
+        return "Could not send the config request to the sonar.";
+    }
+};
+
+struct ConfigRequestCancelled : public std::exception {
+    const char* what() const throw() {
+        return "SonarDriver destroyed before getting a matching config feedback.";
+    }
+};
+
 class SonarDriver : public SonarClient
 {
     public:
@@ -48,10 +89,21 @@ class SonarDriver : public SonarClient
     using TimeSource = SonarClient::TimeSource;
     using TimePoint  = typename std::invoke_result<decltype(&TimeSource::now)>::type;
 
+    using MessageChannel = DispatchChannel<Message::ConstPtr>;
+    using PingChannel    = DispatchChannel<PingMessage::ConstPtr>;
+    using DummyChannel   = DispatchChannel<OculusMessageHeader>;
+    using ConfigChannel  = DispatchChannel<std::pair<PingConfig, PingConfig>>;
+
     protected:
 
     PingConfig lastConfig_;
     uint8_t    lastPingRate_;
+    TimePoint  lastPingStamp_; // for the ping interval metrics
+
+    // Relation between the sonar clock and the host clock, used to set the
+    // PingMessage::acquisition_timestamp().
+    ClockSync  clockSync_;
+    uint16_t   clockSyncVersion_;
 
     // message callbacks will be called on every received message.
     // config callbacks will be called on (detectable) configuration changes.
@@ -60,14 +112,51 @@ class SonarDriver : public SonarClient
     CallbackQueue<const OculusMessageHeader&>           dummyCallbacks_;
     CallbackQueue<const PingConfig&, const PingConfig&> configCallbacks_;
 
+    // Asynchronous callbacks are called on the dispatcher worker threads
+    // instead of the reception thread. The dispatcher is created on the first
+    // asynchronous callback registration. The maps are indexed with the id of
+    // the regular callback feeding the channel.
+    unsigned int                                   dispatchWorkerCount_;
+    std::unique_ptr<AsyncDispatcher>               dispatcher_;
+    std::mutex                                     dispatchMutex_;
+    std::unordered_map<unsigned int, MessageChannel::Ptr> messageChannels_;
+    std::unordered_map<unsigned int, PingChannel::Ptr>    pingChannels_;
+    std::unordered_map<unsigned int, DummyChannel::Ptr>   dummyChannels_;
+    std::unordered_map<unsigned int, ConfigChannel::Ptr>  configChannels_;
+
+    // The message and ping channels keep pooled messages alive. The message
+    // pool is grown so it can still serve the reception when all of them are
+    // full (basePoolSize_ + the messages held by the channels).
+    std::size_t basePoolSize_;
+    std::size_t asyncHeldMessages_;
+
+    AsyncDispatcher& dispatcher();
+    void update_pool_capacity();
+
+    // State of a pending request_ping_config_async (defined in SonarDriver.cpp)
+    struct ConfigRequest;
+    std::mutex                                        configRequestsMutex_;
+    std::unordered_set<std::shared_ptr<ConfigRequest>> configRequests_; // pending
+    void config_request_start(const std::shared_ptr<ConfigRequest>& request);
+    void config_request_send(const std::shared_ptr<ConfigRequest>& request);
+    void config_request_retry(const std::shared_ptr<ConfigRequest>& request);
+    void config_request_complete(const std::shared_ptr<ConfigRequest>& request,
+                                 const PingConfig* feedback,
+                                 std::exception_ptr error = nullptr);
+    void cancel_config_requests();
+
     public:
 
     SonarDriver(const IoServicePtr& service,
-                const Duration& checkerPeriod = boost::posix_time::seconds(1));
+                const Duration& checkerPeriod = boost::posix_time::seconds(1),
+                std::size_t messagePoolSize = 16);
+    ~SonarDriver();
 
     bool send_ping_config(PingConfig config);
     PingConfig current_ping_config();
     PingConfig request_ping_config(PingConfig request);
+    std::future<PingConfig> request_ping_config_async(PingConfig request,
+        const ConfigRequestOptions& options = ConfigRequestOptions());
     PingConfig last_ping_config() const;
 
     // Stanby mode (saves current ping rate and set it to 0 on the sonar
@@ -77,6 +166,9 @@ class SonarDriver : public SonarClient
     virtual void on_connect();
     virtual void handle_message(const Message::ConstPtr& message);
 
+    const ClockSync& clock_sync() const { return clockSync_; }
+    void update_clock_sync(const PingMessage::Ptr& ping);
+
     /////////////////////////////////////////////
     // All remaining member function are related to callbacks and are merely
     // helpers to add callbacks.
@@ -91,6 +183,34 @@ class SonarDriver : public SonarClient
     bool remove_status_callback (unsigned int callbackId);
     bool remove_ping_callback   (unsigned int callbackId);
     bool remove_dummy_callback  (unsigned int callbackId);
+    bool remove_config_callback (unsigned int callbackId);
+
+    // Asynchronous callbacks. They are called on a pool of worker threads so
+    // a slow callback does not delay the reception. Each callback has its own
+    // queue of queueDepth messages and a policy deciding what to do when it
+    // is full. The remove_*_callback functions above also accept the id of an
+    // asynchronous callback.
+    void set_dispatch_worker_count(unsigned int workerCount);
+    unsigned int add_async_message_callback(const MessageCallback& callback,
+                                            DropPolicy  policy     = DropPolicy::DropOldest,
+                                            std::size_t queueDepth = 16);
+    unsigned int add_async_ping_callback(const PingCallback& callback,
+                                         DropPolicy  policy     = DropPolicy::DropOldest,
+                                         std::size_t queueDepth = 16);
+    unsigned int add_async_dummy_callback(const DummyCallback& callback,
+                                          DropPolicy  policy     = DropPolicy::DropOldest,
+                                          std::size_t queueDepth = 16);
+    unsigned int add_async_config_callback(const ConfigCallback& callback,
+                                           DropPolicy  policy     = DropPolicy::DropOldest,
+                                           std::size_t queueDepth = 16);
+    bool remove_async_message_callback(unsigned int callbackId);
+    bool remove_async_ping_callback   (unsigned int callbackId);
+    bool remove_async_dummy_callback  (unsigned int callbackId);
+    bool remove_async_config_callback (unsigned int callbackId);
+    DispatchStats async_message_callback_stats(unsigned int callbackId);
+    DispatchStats async_ping_callback_stats   (unsigned int callbackId);
+    DispatchStats async_dummy_callback_stats  (unsigned int callbackId);
+    DispatchStats async_config_callback_stats (unsigned int callbackId);
 
     // these are synchronous function which will wait for the next message
     bool wait_next_message();
@@ -26,6 +26,7 @@
 #include <oculus_driver/Oculus.h>
 #include <oculus_driver/CallbackQueue.h>
 #include <oculus_driver/Clock.h>
+#include <oculus_driver/Trace.h>
 
 namespace oculus {
 
@@ -0,0 +1,135 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_STREAM_FRAMER_H_
+#define _DEF_OCULUS_DRIVER_STREAM_FRAMER_H_
+
+#include <vector>
+#include <array>
+#include <functional>
+
+#include <oculus_driver/Oculus.h>
+#include <oculus_driver/OculusMessage.h>
+
+namespace oculus {
+
+/**
+ * Splits the TCP byte stream coming from the sonar into Oculus messages.
+ *
+ * Data is received in large chunks directly into a contiguous buffer (see
+ * write_handle() / commit()). Complete messages are then parsed in place with
+ * next_frame() / consume_frame(). The unparsed bytes are moved back to the
+ * beginning of the buffer only when there is not enough room left at the end
+ * of it, so the buffer behaves like a ring buffer which always exposes the
+ * current frame as a contiguous memory area.
+ *
+ * When the data at the current position is not a valid header, the framer
+ * resynchronizes by scanning for OCULUS_CHECK_ID at byte granularity (see
+ * find_header_candidate, the whole buffered data is scanned in one pass). A
+ * resynchronization can never get stuck on a partial frame because a header is
+ * only accepted if its payload size is plausible for its message type (see
+ * payload_limit()).
+ */
+class StreamFramer
+{
+    public:
+
+    using HeaderChecker = std::function<bool(const OculusMessageHeader&)>;
+    using TimeSource    = Message::TimeSource;
+    using TimePoint     = Message::TimePoint;
+
+    // Reception date of a chunk of data, indexed by its position in the stream.
+    // The kernelStamp is left to epoch when not available.
+    struct ChunkInfo {
+        uint64_t  offset;
+        TimePoint stamp;
+        TimePoint kernelStamp;
+    };
+
+    static constexpr std::size_t MinReadSize   = 65536;
+    static constexpr std::size_t MaxChunkCount = 256;
+
+    // Bounds of the messages sent by the sonars. The largest ping has 512
+    // beams of 32-bit samples with a gain per range (the ranges count is a
+    // generous upper bound). All the other messages are a few hundred bytes.
+    static constexpr std::size_t MaxPingBeams        = 512;
+    static constexpr std::size_t MaxPingRanges       = 4096;
+    static constexpr std::size_t MaxPingPayloadSize  = sizeof(OculusSimplePingResult2)
+        + MaxPingBeams*sizeof(int16_t)
+        + MaxPingRanges*(sizeof(uint32_t) + MaxPingBeams*sizeof(uint32_t));
+    static constexpr std::size_t MaxOtherPayloadSize = 65536;
+
+    static std::size_t payload_limit(uint16_t msgId);
+
+    protected:
+
+    std::vector<uint8_t> buffer_;
+    std::size_t          begin_;       // First byte not parsed yet.
+    std::size_t          end_;         // End of received data.
+    uint64_t             streamBegin_; // Stream position of buffer_[begin_].
+    std::size_t          maxPayloadSize_;
+    int                  srcDeviceId_;
+    HeaderChecker        checker_;
+
+    std::array<ChunkInfo, MaxChunkCount> chunks_;
+    std::size_t                          chunkBegin_;
+    std::size_t                          chunkCount_;
+
+    uint64_t skippedBytes_;
+    uint64_t resyncCount_;
+    bool     synchronized_;
+
+    bool header_valid(const OculusMessageHeader& header) const;
+    bool resync();
+    void drop_chunks();
+    const ChunkInfo& frame_chunk() const;
+
+    public:
+
+    StreamFramer(std::size_t capacity       = 1 << 20,
+                 std::size_t maxPayloadSize = MaxPingPayloadSize);
+
+    void set_header_checker(const HeaderChecker& checker) { checker_ = checker; }
+    // If set (>= 0), resynchronization only stops on headers from this device.
+    void set_source_device(int srcDeviceId) { srcDeviceId_ = srcDeviceId; }
+    void reset();
+
+    // Reception interface (to be filled by async_read_some).
+    uint8_t*    write_handle();
+    std::size_t write_capacity() const { return buffer_.size() - end_; }
+    void        commit(std::size_t byteCount,
+                       const TimePoint& stamp       = TimeSource::now(),
+                       const TimePoint& kernelStamp = TimePoint());
+
+    // Parsing interface.
+    const uint8_t* next_frame();
+    std::size_t    frame_size() const;
+    TimePoint      frame_stamp()        const { return this->frame_chunk().stamp;       }
+    TimePoint      frame_kernel_stamp() const { return this->frame_chunk().kernelStamp; }
+    void           consume_frame();
+
+    std::size_t buffered()         const { return end_ - begin_;     }
+    std::size_t capacity()         const { return buffer_.size();    }
+    std::size_t max_payload_size() const { return maxPayloadSize_;   }
+    uint64_t    skipped_bytes()    const { return skippedBytes_;     }
+    uint64_t    resync_count()     const { return resyncCount_;      }
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_STREAM_FRAMER_H_
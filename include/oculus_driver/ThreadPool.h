@@ -0,0 +1,154 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_THREAD_POOL_H_
+#define _DEF_OCULUS_DRIVER_THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <exception>
+
+namespace oculus {
+
+/**
+ * Fixed size pool of worker threads for CPU bound work (file decoding, image
+ * rendering...).
+ *
+ * Unlike the AsyncDispatcher, tasks are independent and are processed in no
+ * particular order.
+ */
+class ThreadPool
+{
+    public:
+
+    using Task = std::function<void()>;
+
+    protected:
+
+    std::vector<std::thread> workers_;
+    std::mutex               mutex_;
+    std::condition_variable  cv_;
+    std::deque<Task>         tasks_;
+    bool                     running_;
+
+    void worker_loop();
+
+    public:
+
+    // threadCount = 0 : one thread per hardware thread.
+    ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int thread_count() const { return workers_.size(); }
+
+    void post(Task task);
+
+    template <class F>
+    auto submit(F&& f) -> std::future<decltype(f())>
+    {
+        using ResultT = decltype(f());
+        auto task = std::make_shared<std::packaged_task<ResultT()>>(std::forward<F>(f));
+        auto res  = task->get_future();
+        this->post([task]() { (*task)(); });
+        return res;
+    }
+
+    /**
+     * Calls f(first, last) on sub-ranges of [begin, end) of at least grain
+     * elements, in parallel on the workers and on the calling thread. Returns
+     * when the whole range was processed. The first exception thrown by f is
+     * rethrown here.
+     */
+    template <class F>
+    void parallel_for(std::size_t begin, std::size_t end, F&& f, std::size_t grain = 1);
+};
+
+template <class F>
+void ThreadPool::parallel_for(std::size_t begin, std::size_t end, F&& f, std::size_t grain)
+{
+    if(begin >= end) {
+        return;
+    }
+    std::size_t count = end - begin;
+    // a few chunks per thread to balance uneven chunks
+    std::size_t chunkSize = std::max<std::size_t>(
+        grain, count / (4*(this->thread_count() + 1)));
+    std::size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if(chunkCount == 1 || this->thread_count() == 0) {
+        f(begin, end);
+        return;
+    }
+
+    // Shared with the helper tasks, which may outlive this call (they
+    // only find no more chunk to process).
+    struct State {
+        std::atomic<std::size_t> next;
+        std::atomic<std::size_t> done;
+        std::mutex               mutex;
+        std::condition_variable  cv;
+        std::exception_ptr       error;
+    };
+    auto state = std::make_shared<State>();
+    state->next = 0;
+    state->done = 0;
+
+    auto fn = &f;
+    auto run = [state, fn, begin, end, chunkSize, chunkCount]() {
+        for(std::size_t chunk = state->next++; chunk < chunkCount; chunk = state->next++) {
+            std::size_t first = begin + chunk*chunkSize;
+            try {
+                (*fn)(first, std::min(first + chunkSize, end));
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if(!state->error) state->error = std::current_exception();
+            }
+            if(++state->done == chunkCount) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    unsigned int helpers = std::min<std::size_t>(this->thread_count(), chunkCount - 1);
+    for(unsigned int i = 0; i < helpers; i++) {
+        this->post(run);
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&]() { return state->done == chunkCount; });
+    if(state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_THREAD_POOL_H_
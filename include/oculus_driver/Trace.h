@@ -0,0 +1,141 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_TRACE_H_
+#define _DEF_OCULUS_DRIVER_TRACE_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <iosfwd>
+
+namespace oculus {
+
+/**
+ * Timeline of the driver events, exported in the Chrome trace format (which
+ * can be opened in chrome://tracing or https://ui.perfetto.dev).
+ *
+ * Each thread records begin/end events in its own ring buffer (the oldest
+ * events are overwritten when full), so recording takes no lock. Recording
+ * only happens when the tracer is enabled at runtime. The instrumentation of
+ * the library itself (OCULUS_TRACE_SCOPE) is compiled only if the
+ * ENABLE_TRACING CMake option is set, and costs nothing otherwise.
+ */
+class Tracer
+{
+    public:
+
+    struct Event
+    {
+        const char* name;  // must have a static storage (string literal)
+        uint64_t    stamp; // nanoseconds (steady clock)
+        char        phase; // 'B' : begin, 'E' : end
+    };
+
+    static constexpr std::size_t BufferCapacity = 1 << 16; // events per thread
+
+    // Single producer ring buffer. The events are read by the exporting
+    // thread while the owning thread may still write in it.
+    struct ThreadBuffer
+    {
+        unsigned int          threadId;
+        std::vector<Event>    events;
+        std::atomic<uint64_t> head; // total number of events written
+
+        ThreadBuffer(unsigned int id) : threadId(id), events(BufferCapacity), head(0) {}
+
+        void push(const char* name, char phase, uint64_t stamp) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            Event& e = events[h & (BufferCapacity - 1)];
+            e.name  = name;
+            e.stamp = stamp;
+            e.phase = phase;
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    protected:
+
+    std::atomic<bool>                          enabled_;
+    mutable std::mutex                         mutex_;   // protects buffers_
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_; // kept after thread exit
+
+    Tracer() : enabled_(false) {}
+
+    ThreadBuffer* register_thread();
+
+    public:
+
+    static Tracer& instance();
+
+    void enable(bool enabled = true) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void record(const char* name, char phase);
+    void begin(const char* name) { if(this->enabled()) this->record(name, 'B'); }
+    void end  (const char* name) { if(this->enabled()) this->record(name, 'E'); }
+
+    void clear();
+    std::size_t event_count() const;
+
+    void write_chrome_trace(std::ostream& os) const;
+    bool write_chrome_trace(const std::string& filename) const;
+};
+
+/**
+ * Records a begin event on construction and the matching end event on
+ * destruction (if the tracer was enabled at construction).
+ */
+class TraceScope
+{
+    protected:
+
+    const char* name_;
+    bool        active_;
+
+    public:
+
+    TraceScope(const char* name) :
+        name_(name),
+        active_(Tracer::instance().enabled())
+    {
+        if(active_) Tracer::instance().record(name_, 'B');
+    }
+    ~TraceScope() {
+        if(active_) Tracer::instance().record(name_, 'E');
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+} //namespace oculus
+
+#define OCULUS_TRACE_CONCAT_IMPL(a, b) a##b
+#define OCULUS_TRACE_CONCAT(a, b) OCULUS_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef OCULUS_DRIVER_TRACING
+    #define OCULUS_TRACE_SCOPE(name) \
+        ::oculus::TraceScope OCULUS_TRACE_CONCAT(oculusTraceScope, __LINE__)(name)
+#else
+    #define OCULUS_TRACE_SCOPE(name)
+#endif
+
+#endif //_DEF_OCULUS_DRIVER_TRACE_H_
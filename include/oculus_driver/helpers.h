@@ -5,8 +5,14 @@
 #include <cmath>
 #include <fstream>
 #include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
 
 #include <oculus_driver/Oculus.h>
+#include <oculus_driver/OculusMessage.h>
+#include <oculus_driver/ThreadPool.h>
+#include <oculus_driver/PingDecoder.h>
 
 namespace oculus {
 
@@ -104,83 +110,118 @@ inline double get_range(const OculusSimplePingResult2& msg)
     return get_range(msg.fireMessage);
 }
 
+/**
+ * Converts the rows [firstRange, lastRange) of a ping with the decoding
+ * kernel of its format (see PingDecoder.h). Other destination types than
+ * float are converted directly with decode_ping_rows_as.
+ */
+template <typename T>
+inline void ping_rows_to_array(T* dst,
+                               const PingFormat& format,
+                               const MessageData& pingData,
+                               unsigned int firstRange,
+                               unsigned int lastRange)
+{
+    PingKernel kernel = select_ping_kernel(format);
+    if(!kernel) {
+        throw std::runtime_error("oculus::ping_data_to_array : invalid ping data format");
+    }
+    const uint8_t* imageData = pingData.data() + format.imageOffset;
+    if constexpr(std::is_same<T, float>::value) {
+        kernel(format, imageData, dst, firstRange, lastRange);
+    }
+    else {
+        decode_ping_rows_as(format, imageData, dst, firstRange, lastRange);
+    }
+}
+
 /**
  * This converts an OculusSimplePingResult to an array representing the data
  * after gain compensation (if those are present in the data).
  *
  * The dst data must have been previously reserved and must have at least
- * metadata.nBeams * metadata.nRanges elements.
+ * nBeams * nRanges elements.
  *
  * Data is encoded in row major format, a row being the set of bearing results
- * at a given range.
+ * at a given range (dst[nBeams*rangeIndex + bearingIndex]), with or without
+ * gains. All the sample sizes and both message versions are handled, the
+ * format being resolved from pingData by PingFormat::resolve (throws if it is
+ * invalid).
  *
- * OculusPingResultType is either a OculusSimplePingResult or an
- * OculusSimplePingResult2.
+ * Only the rows in [firstRange, lastRange) are converted.
+ */
+template <typename T>
+inline void ping_data_to_array(T* dst,
+                               const MessageData& pingData,
+                               unsigned int firstRange,
+                               unsigned int lastRange)
+{
+    ping_rows_to_array(dst, PingFormat::resolve(pingData), pingData, firstRange, lastRange);
+}
+template <typename T>
+inline void ping_data_to_array(T* dst, const MessageData& pingData)
+{
+    PingFormat format = PingFormat::resolve(pingData);
+    ping_rows_to_array(dst, format, pingData, 0, format.nRanges);
+}
+
+/**
+ * Same as above, the rows being split between the threads of the pool. Small
+ * pings are converted on the calling thread only.
+ */
+template <typename T>
+inline void ping_data_to_array(T* dst, const MessageData& pingData, ThreadPool& pool)
+{
+    constexpr std::size_t minTaskSize = 32768; // elements
+    PingFormat format = PingFormat::resolve(pingData);
+    pool.parallel_for(0, format.nRanges, [&](std::size_t first, std::size_t last) {
+        ping_rows_to_array(dst, format, pingData, first, last);
+    }, std::max<std::size_t>(1, minTaskSize / std::max<std::size_t>(format.nBeams, 1)));
+}
+
+/**
+ * Former signatures. The metadata is not used anymore : the format (and the
+ * ranges count) are read from pingData.
  */
 template <typename T, class OculusPingResultType>
+[[deprecated("the metadata is read from pingData, use ping_data_to_array(dst, pingData, ...)")]]
 inline void ping_data_to_array(T* dst,
-                               const OculusPingResultType& metadata,
-                               const std::vector<uint8_t>& pingData)
+                               const OculusPingResultType&,
+                               const MessageData& pingData,
+                               unsigned int firstRange,
+                               unsigned int lastRange)
 {
-    if(has_16bits_data(metadata)) {
-        auto data = (const uint16_t*)(pingData.data() + metadata.imageOffset);
-        if(has_gains(metadata)) {
-            // gain is sent
-            for(unsigned int h = 0; h < metadata.nRanges; h++) {
-                float gain = 1.0f / sqrt((float)((const uint32_t*)data)[0]);
-                data += 2;
-                for(int w = 0; w < metadata.nBeams; w++) {
-                    dst[metadata.nBeams*w + h] = gain * data[w];
-                }
-                data += metadata.nBeams;
-            }
-        }
-        else {
-            //gain was not sent
-            for(unsigned int i = 0; i < metadata.nBeams*metadata.nRanges; i++) {
-                dst[i] = data[i];
-            }
-        }
-    }
-    else {
-        auto data = (const uint8_t*)(pingData.data() + metadata.imageOffset);
-        if(has_gains(metadata)) {
-            // gain is sent
-            for(unsigned int h = 0; h < metadata.nRanges; h++) {
-                float gain = 1.0f / sqrt((float)((const uint32_t*)data)[0]);
-                data += 4;
-                for(int w = 0; w < metadata.nBeams; w++) {
-                    dst[metadata.nBeams*w + h] = gain * data[w];
-                }
-                data += metadata.nBeams;
-            }
-        }
-        else {
-            //gain was not sent
-            for(unsigned int i = 0; i < metadata.nBeams*metadata.nRanges; i++) {
-                dst[i] = data[i];
-            }
-        }
-    }
+    ping_data_to_array(dst, pingData, firstRange, lastRange);
 }
-inline std::vector<float> get_ping_acoustic_data(const std::vector<uint8_t>& pingData)
+template <typename T, class OculusPingResultType>
+[[deprecated("the metadata is read from pingData, use ping_data_to_array(dst, pingData)")]]
+inline void ping_data_to_array(T* dst,
+                               const OculusPingResultType&,
+                               const MessageData& pingData)
 {
-    auto header = *reinterpret_cast<const OculusMessageHeader*>(pingData.data());
-    if(header.msgId != messageSimplePingResult) {
-        throw std::runtime_error("Not a ping result");
-    }
-    if(header.msgVersion != 2) {
-        auto metadata = *reinterpret_cast<const OculusSimplePingResult*>(pingData.data());
-        std::vector<float> dst(metadata.nBeams * metadata.nRanges);
-        ping_data_to_array(dst.data(), metadata, pingData);
-        return dst;
-    }
-    else {
-        auto metadata = *reinterpret_cast<const OculusSimplePingResult2*>(pingData.data());
-        std::vector<float> dst(metadata.nBeams * metadata.nRanges);
-        ping_data_to_array(dst.data(), metadata, pingData);
-        return dst;
-    }
+    ping_data_to_array(dst, pingData);
+}
+template <typename T, class OculusPingResultType>
+[[deprecated("the metadata is read from pingData, use ping_data_to_array(dst, pingData, pool)")]]
+inline void ping_data_to_array(T* dst,
+                               const OculusPingResultType&,
+                               const MessageData& pingData,
+                               ThreadPool& pool)
+{
+    ping_data_to_array(dst, pingData, pool);
+}
+
+/**
+ * Returns the gain compensated ping data. The conversion is done on the pool
+ * threads if a pool is given (see decode_ping, which also handles 24 and 32
+ * bits samples).
+ */
+inline std::vector<float> get_ping_acoustic_data(const MessageData& pingData,
+                                                 ThreadPool* pool = nullptr)
+{
+    std::vector<float> dst;
+    decode_ping(pingData, dst, pool);
+    return dst;
 }
 
 /**
@@ -189,7 +230,7 @@ inline std::vector<float> get_ping_acoustic_data(const std::vector<uint8_t>& pin
 template <typename T, class OculusPingResultType>
 inline void get_ping_bearings(T* dst,
                               const OculusPingResultType& metadata,
-                              const std::vector<uint8_t>& pingData)
+                              const MessageData& pingData)
 {
     // copying bearing angles (
     auto bearingData = (const int16_t*)(pingData.data() + sizeof(OculusPingResultType));
@@ -197,7 +238,7 @@ inline void get_ping_bearings(T* dst,
         dst[i] = (0.01 * M_PI / 180.0) * bearingData[i];
     }
 }
-inline std::vector<float> get_ping_bearings(const std::vector<uint8_t>& pingData)
+inline std::vector<float> get_ping_bearings(const MessageData& pingData)
 {
     auto header = *reinterpret_cast<const OculusMessageHeader*>(pingData.data());
     if(header.msgId != messageSimplePingResult) {
@@ -223,14 +264,14 @@ inline std::vector<float> get_ping_bearings(const std::vector<uint8_t>& pingData
  * This function is intended to be an example on how to interpret the data from
  * an OculusSimplePingResult. It is purposefully inefficient on maximize
  * readability. User are expected to implement their own version of this
- * function adapted to their own use case.
+ * function adapted to their own use case (see FanRenderer for live display).
  *
  * This function return the image size as a std::pair(width,height).
  */
 template <class OculusPingResultType>
 inline std::pair<unsigned int, unsigned int> image_from_ping_data(
     const OculusPingResultType& metadata,
-    const std::vector<uint8_t>& msgData,
+    const MessageData& msgData,
     std::vector<float>& imageData,
     unsigned int imageWidth = 1024)
 {
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <oculus_driver/Oculus.h>
+#include <oculus_driver/OculusMessage.h>
 
 #include <rtac_base/types/Image.h>
 #include <rtac_base/types/SonarPing2D.h>
@@ -16,7 +17,7 @@ namespace rtac { namespace types {
 template <typename T, template<typename> class VectorT>
 inline void oculus_to_rtac(SonarPing2D<T,VectorT>& dst, 
                            const OculusSimplePingResult& metadata,
-                           const std::vector<uint8_t>& data)
+                           const oculus::MessageData& data)
 {
     dst.resize({metadata.nBeams, metadata.nRanges});
     
@@ -10,16 +10,21 @@ namespace py = pybind11;
 
 #include "oculus_message.h"
 
+// The views on a memory mapped message are read-only (the mapping is
+// read-only, a write would crash the interpreter).
 template <typename T>
-inline py::memoryview make_memory_view(std::size_t size, const T* data)
+inline py::memoryview make_memory_view(std::size_t size, const T* data,
+                                       bool readonly = false)
 {
-    return py::memoryview::from_buffer(const_cast<T*>(data), {size}, {sizeof(T)});
+    return py::memoryview::from_buffer(const_cast<T*>(data), {size}, {sizeof(T)}, readonly);
 }
 
 template <typename T>
-inline py::memoryview make_memory_view(std::size_t width, std::size_t height, const T* data)
+inline py::memoryview make_memory_view(std::size_t width, std::size_t height, const T* data,
+                                       bool readonly = false)
 {
-    return py::memoryview::from_buffer(const_cast<T*>(data), {height, width}, {sizeof(T)*width, sizeof(T)});
+    return py::memoryview::from_buffer(const_cast<T*>(data), {height, width},
+                                       {sizeof(T)*width, sizeof(T)}, readonly);
 }
 
 template <typename T>
@@ -30,7 +35,12 @@ inline py::memoryview make_memory_view(const std::vector<T>& data)
 
 inline py::memoryview make_memory_view(const oculus::Message& msg)
 {
-    return make_memory_view(msg.data());
+    return make_memory_view(msg.bytes().size(), msg.bytes().data(), msg.is_mapped());
+}
+
+inline py::memoryview make_memory_view(const oculus::PingMessage& msg)
+{
+    return make_memory_view(*msg.message());
 }
 
 inline py::memoryview make_raw_ping_data_view(const oculus::PingMessage& msg)
@@ -39,15 +49,18 @@ inline py::memoryview make_raw_ping_data_view(const oculus::PingMessage& msg)
     switch(msg.sample_size()) {
         case 1:
             if(msg.has_gains()) width += 4;
-            return make_memory_view(width, msg.range_count(), msg.ping_data());
+            return make_memory_view(width, msg.range_count(), msg.ping_data(),
+                                    msg.message()->is_mapped());
             break;
         case 2:
             if(msg.has_gains()) width += 2;
-            return make_memory_view(width, msg.range_count(), (const uint16_t*)msg.ping_data());
+            return make_memory_view(width, msg.range_count(), (const uint16_t*)msg.ping_data(),
+                                    msg.message()->is_mapped());
             break;
         case 4:
             if(msg.has_gains()) width += 1;
-            return make_memory_view(width, msg.range_count(), (const uint32_t*)msg.ping_data());
+            return make_memory_view(width, msg.range_count(), (const uint32_t*)msg.ping_data(),
+                                    msg.message()->is_mapped());
             break;
         default:
             std::cerr << "Unhandled sample_size ("
@@ -65,7 +78,8 @@ inline py::memoryview make_gains_view(const oculus::PingMessage& msg)
 
     auto step = msg.bearing_count()*msg.sample_size() + 4;
     return py::memoryview::from_buffer((uint32_t*)const_cast<uint8_t*>(msg.ping_data()),
-                                       {msg.range_count()}, {step});
+                                       {msg.range_count()}, {step},
+                                       msg.message()->is_mapped());
 }
 
 inline py::memoryview make_ping_data_view(const oculus::PingMessage& msg)
@@ -80,17 +94,17 @@ inline py::memoryview make_ping_data_view(const oculus::PingMessage& msg)
         case 1:
             return py::memoryview::from_buffer(const_cast<uint8_t*>(msg.ping_data() + offset),
                                   {msg.range_count(), msg.bearing_count()},
-                                  {step, sizeof(uint8_t)});
+                                  {step, sizeof(uint8_t)}, msg.message()->is_mapped());
             break;
         case 2:
             return py::memoryview::from_buffer((uint16_t*)const_cast<uint8_t*>(msg.ping_data() + offset),
                                   {msg.range_count(), msg.bearing_count()},
-                                  {step, sizeof(uint16_t)});
+                                  {step, sizeof(uint16_t)}, msg.message()->is_mapped());
             break;
         case 4:
             return py::memoryview::from_buffer((uint32_t*)const_cast<uint8_t*>(msg.ping_data() + offset),
                                   {msg.range_count(), msg.bearing_count()},
-                                  {step, sizeof(uint32_t)});
+                                  {step, sizeof(uint32_t)}, msg.message()->is_mapped());
             break;
         default:
             std::cerr << "Unhandled sample_size ("
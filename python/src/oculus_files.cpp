@@ -1,8 +1,10 @@
 #include <pybind11/pybind11.h>
+#include <pybind11/chrono.h>
 namespace py = pybind11;
 
 #include <oculus_driver/Oculus.h>
 #include <oculus_driver/Recorder.h>
+#include <oculus_driver/MappedFileReader.h>
 
 #include "oculus_message.h"
 
@@ -38,6 +40,35 @@ struct OculusFileReader
     }
 };
 
+struct OculusMappedFileReader
+{
+    oculus::MappedFileReader file_;
+
+    OculusMappedFileReader(const std::string& path) : file_(path) {}
+
+    const oculus::blueprint::LogHeader file_header() const { return file_.file_header(); }
+    py::object read_next_message() {
+        auto msg = file_.read_next_message();
+        if(msg)
+            return py::cast(std::const_pointer_cast<oculus::Message>(msg));
+        else
+            return py::none();
+    }
+
+    py::object read_next_ping() {
+        auto msg = file_.read_next_ping();
+        if(msg) {
+            return py::cast(msg);
+        }
+        else
+            return py::none();
+    }
+
+    void rewind() {
+        file_.rewind();
+    }
+};
+
 void init_oculus_python_files(py::module& parentModule)
 {
     py::module m_ = parentModule.def_submodule("files", "Submodule to read .oculus files.");
@@ -91,7 +122,27 @@ void init_oculus_python_files(py::module& parentModule)
         .def("file_header",       &OculusFileReader::file_header)
         .def("read_next_message", &OculusFileReader::read_next_message)
         .def("read_next_ping",    &OculusFileReader::read_next_ping)
-        .def("rewind",            &OculusFileReader::rewind);
+        .def("rewind",            &OculusFileReader::rewind)
+        .def("message_count",     [](OculusFileReader& r) { return r.file_.index().message_count(); })
+        .def("seek_to_message",   [](OculusFileReader& r, std::size_t idx) { return r.file_.seek_to_message(idx); })
+        .def("seek_to_time",      [](OculusFileReader& r, const oculus::Message::TimePoint& stamp) {
+            return r.file_.seek_to_time(stamp);
+        })
+        .def("seek_to_ping",      [](OculusFileReader& r, uint32_t pingId) { return r.file_.seek_to_ping(pingId); });
+
+    // Messages are views on the mapped file and stay valid after the next read.
+    py::class_<OculusMappedFileReader>(m_, "OculusMappedFileReader")
+        .def(py::init<const std::string&>())
+        .def("file_header",       &OculusMappedFileReader::file_header)
+        .def("read_next_message", &OculusMappedFileReader::read_next_message)
+        .def("read_next_ping",    &OculusMappedFileReader::read_next_ping)
+        .def("rewind",            &OculusMappedFileReader::rewind)
+        .def("message_count",     [](OculusMappedFileReader& r) { return r.file_.index().message_count(); })
+        .def("seek_to_message",   [](OculusMappedFileReader& r, std::size_t idx) { return r.file_.seek_to_message(idx); })
+        .def("seek_to_time",      [](OculusMappedFileReader& r, const oculus::Message::TimePoint& stamp) {
+            return r.file_.seek_to_time(stamp);
+        })
+        .def("seek_to_ping",      [](OculusMappedFileReader& r, uint32_t pingId) { return r.file_.seek_to_ping(pingId); });
 }
 
 
@@ -19,7 +19,7 @@ void init_oculus_message(py::module& m_)
         .def("header", &oculus::Message::header)
         .def("timestamp", &oculus::Message::timestamp)
         .def("data",   [](const oculus::Message::ConstPtr& msg) {
-            return make_memory_view(msg->data());
+            return make_memory_view(*msg);
          })
         .def("__str__", [](const oculus::Message::ConstPtr& msg) {
             std::ostringstream oss;
@@ -29,21 +29,25 @@ void init_oculus_message(py::module& m_)
         .def("timestamp_micros", [](const oculus::Message::ConstPtr& msg) {
             return std::chrono::duration_cast<std::chrono::microseconds>(
                 msg->timestamp().time_since_epoch()).count();
-        });
+        })
+        .def("kernel_timestamp",     &oculus::Message::kernel_timestamp)
+        .def("has_kernel_timestamp", &oculus::Message::has_kernel_timestamp);
 
     py::class_<oculus::PingMessage, oculus::PingMessage::Ptr>(m_, "PingMessage")
         .def(py::init<oculus::Message::ConstPtr>())
         .def("message",   &oculus::PingMessage::message)
         .def("timestamp", &oculus::PingMessage::timestamp)
+        .def("acquisition_timestamp",     &oculus::PingMessage::acquisition_timestamp)
+        .def("has_acquisition_timestamp", &oculus::PingMessage::has_acquisition_timestamp)
         .def("data",          [](const oculus::PingMessage::ConstPtr& msg) {
-            return make_memory_view(msg->data());
+            return make_memory_view(*msg);
         })
         .def("metadata", [](const oculus::PingMessage::ConstPtr& msg) {
             if(msg->message()->message_version() == 2) {
-                return py::cast(*reinterpret_cast<const OculusSimplePingResult2*>(msg->data().data()));
+                return py::cast(*reinterpret_cast<const OculusSimplePingResult2*>(msg->bytes().data()));
             }
             else {
-                return py::cast(*reinterpret_cast<const OculusSimplePingResult*>(msg->data().data()));
+                return py::cast(*reinterpret_cast<const OculusSimplePingResult*>(msg->bytes().data()));
             }
         })
 
@@ -54,7 +58,8 @@ void init_oculus_message(py::module& m_)
         .def("sample_size",   &oculus::PingMessage::sample_size)
 
         .def("bearing_data",  [](const oculus::PingMessage::ConstPtr& msg) {
-            return make_memory_view(msg->bearing_count(), msg->bearing_data());
+            return make_memory_view(msg->bearing_count(), msg->bearing_data(),
+                                    msg->message()->is_mapped());
         })
         .def("raw_ping_data", [](const oculus::PingMessage::ConstPtr& msg) {
             return make_raw_ping_data_view(*msg);
@@ -5,7 +5,7 @@ namespace py = pybind11;
 #include <oculus_driver/OculusMessage.h>
 #include <oculus_driver/AsyncService.h>
 #include <oculus_driver/SonarDriver.h>
-#include <oculus_driver/Recorder.h>
+#include <oculus_driver/AsyncRecorder.h>
 
 #include "oculus_message.h"
 #include "oculus_files.h"
@@ -58,7 +58,7 @@ struct OculusPythonHandle
 {
     oculus::AsyncService service_;
     oculus::SonarDriver  sonar_;
-    oculus::Recorder     recorder_;
+    oculus::AsyncRecorder recorder_; // writes from a background thread
     int recorderCallbackId_;
 
     OculusPythonHandle() :
@@ -115,12 +115,18 @@ struct OculusPythonHandle
             sonar_.remove_message_callback(recorderCallbackId_);
         }
     }
-    void recorder_callback(const oculus::Message::ConstPtr& msg) const {
+    void recorder_callback(const oculus::Message::ConstPtr& msg) {
         recorder_.write(msg);
     }
     bool is_recording() const {
         return recorder_.is_open();
     }
+    oculus::RecorderStats recorder_stats() const {
+        return recorder_.stats();
+    }
+
+    oculus::MetricsSnapshot metrics() const { return sonar_.metrics(); }
+    void reset_metrics() { sonar_.reset_metrics(); }
 };
 
 PYBIND11_MODULE(_oculus_python, m_)
@@ -277,6 +283,52 @@ PYBIND11_MODULE(_oculus_python, m_)
             return oss.str();
         });
 
+    py::class_<oculus::HistogramSnapshot>(m_, "HistogramSnapshot")
+        .def_readonly("count", &oculus::HistogramSnapshot::count)
+        .def_readonly("min",   &oculus::HistogramSnapshot::min)
+        .def_readonly("max",   &oculus::HistogramSnapshot::max)
+        .def_readonly("mean",  &oculus::HistogramSnapshot::mean)
+        .def_readonly("p50",   &oculus::HistogramSnapshot::p50)
+        .def_readonly("p90",   &oculus::HistogramSnapshot::p90)
+        .def_readonly("p99",   &oculus::HistogramSnapshot::p99)
+        .def_readonly("p999",  &oculus::HistogramSnapshot::p999)
+        .def("__str__", [](const oculus::HistogramSnapshot& hist) {
+            std::ostringstream oss;
+            oss << hist;
+            return oss.str();
+        });
+
+    py::class_<oculus::MetricsSnapshot>(m_, "MetricsSnapshot")
+        .def_readonly("frameAssembly",    &oculus::MetricsSnapshot::frameAssembly)
+        .def_readonly("dispatch",         &oculus::MetricsSnapshot::dispatch)
+        .def_readonly("messageCallbacks", &oculus::MetricsSnapshot::messageCallbacks)
+        .def_readonly("pingCallbacks",    &oculus::MetricsSnapshot::pingCallbacks)
+        .def_readonly("dummyCallbacks",   &oculus::MetricsSnapshot::dummyCallbacks)
+        .def_readonly("configCallbacks",  &oculus::MetricsSnapshot::configCallbacks)
+        .def_readonly("pingInterval",     &oculus::MetricsSnapshot::pingInterval)
+        .def_readonly("bytesReceived",    &oculus::MetricsSnapshot::bytesReceived)
+        .def_readonly("messagesReceived", &oculus::MetricsSnapshot::messagesReceived)
+        .def_readonly("resyncCount",      &oculus::MetricsSnapshot::resyncCount)
+        .def_readonly("skippedBytes",     &oculus::MetricsSnapshot::skippedBytes)
+        .def_readonly("reconnectCount",   &oculus::MetricsSnapshot::reconnectCount)
+        .def_readonly("configRetryCount", &oculus::MetricsSnapshot::configRetryCount)
+        .def("__str__", [](const oculus::MetricsSnapshot& metrics) {
+            std::ostringstream oss;
+            oss << metrics;
+            return oss.str();
+        });
+
+    py::class_<oculus::RecorderStats>(m_, "RecorderStats")
+        .def_readonly("queueDepth",   &oculus::RecorderStats::queueDepth)
+        .def_readonly("bytesPending", &oculus::RecorderStats::bytesPending)
+        .def_readonly("writtenBytes", &oculus::RecorderStats::writtenBytes)
+        .def_readonly("droppedItems", &oculus::RecorderStats::droppedItems)
+        .def_readonly("writeErrors",  &oculus::RecorderStats::writeErrors)
+        .def_readonly("compressionLevel", &oculus::RecorderStats::compressionLevel)
+        .def_property_readonly("compressionRatio", [](const oculus::RecorderStats& stats) {
+            return stats.compression.ratio();
+        });
+
     py::class_<OculusPythonHandle>(m_, "OculusSonar")
         .def(py::init<>())
         .def("start",       &OculusPythonHandle::start)
@@ -293,7 +345,11 @@ PYBIND11_MODULE(_oculus_python, m_)
 
         .def("recorder_start", &OculusPythonHandle::recorder_start)
         .def("recorder_stop",  &OculusPythonHandle::recorder_stop)
-        .def("is_recording",   &OculusPythonHandle::is_recording);
+        .def("is_recording",   &OculusPythonHandle::is_recording)
+        .def("recorder_stats", &OculusPythonHandle::recorder_stats)
+
+        .def("metrics",       &OculusPythonHandle::metrics)
+        .def("reset_metrics", &OculusPythonHandle::reset_metrics);
 
     init_oculus_message(m_);
     init_oculus_python_files(m_);
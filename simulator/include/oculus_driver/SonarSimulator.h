@@ -0,0 +1,147 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#ifndef _DEF_OCULUS_DRIVER_SONAR_SIMULATOR_H_
+#define _DEF_OCULUS_DRIVER_SONAR_SIMULATOR_H_
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+#include <boost/asio.hpp>
+
+#include <oculus_driver/Oculus.h>
+#include <oculus_driver/utils.h>
+#include <oculus_driver/Recorder.h>
+
+namespace oculus {
+
+/**
+ * Emulates the network interface of an Oculus sonar.
+ *
+ * Broadcasts OculusStatusMsg on the status port (UDP) and accepts a single
+ * client connection on the data port (TCP). Each OculusSimpleFireMessage
+ * received from the client becomes the current configuration. Pings are then
+ * sent at the requested pingRate (or as fast as possible if unthrottled), with
+ * a dummy message every second when in standby.
+ *
+ * Pings are either synthetic OculusSimplePingResult (message version 1) or
+ * OculusSimplePingResult2 (message version 2) built from the current
+ * configuration, or messages replayed from a .oculus file. Replayed messages
+ * are sent as they are recorded and do not reflect the requested
+ * configuration.
+ *
+ * All operations happen in the io_service, which is expected to be run by a
+ * single thread.
+ */
+class SonarSimulator
+{
+    public:
+
+    using IoService    = boost::asio::io_service;
+    using IoServicePtr = std::shared_ptr<IoService>;
+    using Socket       = boost::asio::ip::tcp::socket;
+    using Acceptor     = boost::asio::ip::tcp::acceptor;
+    using UdpSocket    = boost::asio::ip::udp::socket;
+    using Timer        = boost::asio::steady_timer;
+    using PingConfig   = OculusSimpleFireMessage;
+
+    static constexpr unsigned short DataPort   = 52100;
+    static constexpr unsigned short StatusPort = 52102;
+
+    protected:
+
+    IoServicePtr ioService_;
+    Acceptor     acceptor_;
+    UdpSocket    statusSocket_;
+    boost::asio::ip::udp::endpoint statusRemote_;
+    uint32_t     advertisedIp_;
+    Timer        statusTimer_;
+    Timer        pingTimer_;
+
+    std::unique_ptr<Socket> socket_;
+    OculusMessageHeader     fireHeader_;  // reception buffer
+    std::vector<uint8_t>    fireData_;    // reception buffer
+    std::vector<uint8_t>    outData_;     // message being sent
+    bool                    writing_;
+
+    uint16_t   deviceId_;
+    PingConfig config_;
+    uint16_t   messageVersion_;
+    uint16_t   rangeCount_;
+    bool       unthrottled_;
+    uint32_t   pingId_;
+    std::chrono::steady_clock::time_point startTime_;
+
+    std::unique_ptr<FileReader> replay_;
+    bool                        replayLoop_;
+
+    std::atomic<uint64_t> sentPingCount_;
+    std::atomic<uint64_t> sentByteCount_;
+
+    void send_status(const boost::system::error_code& err);
+    void accept_client();
+    void receive_fire_message();
+    void fire_header_received(const boost::system::error_code& err, std::size_t count);
+    void fire_payload_received(const boost::system::error_code& err, std::size_t count);
+
+    void schedule_ping();
+    void ping_timer_callback(const boost::system::error_code& err);
+    void send_output(bool isPing);
+    void write_callback(const boost::system::error_code& err, std::size_t count);
+    void close_client();
+
+    void make_dummy_message();
+    void make_synthetic_ping();
+    bool make_replayed_ping();
+
+    public:
+
+    SonarSimulator(const IoServicePtr& service,
+                   const std::string& statusAddress = "127.0.0.1",
+                   const std::string& advertisedAddress = "127.0.0.1",
+                   unsigned short dataPort   = DataPort,
+                   unsigned short statusPort = StatusPort);
+    ~SonarSimulator();
+
+    // Synthetic pings parameters
+    void set_message_version(uint16_t version) { messageVersion_ = version; }
+    void set_range_count(uint16_t rangeCount)  { rangeCount_     = rangeCount; }
+    uint16_t message_version() const { return messageVersion_; }
+    uint16_t range_count()     const { return rangeCount_;     }
+
+    // Pings are sent as fast as the connection allows, ignoring pingRate.
+    void set_unthrottled(bool unthrottled) { unthrottled_ = unthrottled; }
+    bool unthrottled() const { return unthrottled_; }
+
+    // Replays the messages of a .oculus file instead of synthetic pings.
+    void replay_file(const std::string& filename, bool loop = true);
+    void stop_replay() { replay_ = nullptr; }
+
+    bool client_connected() const { return socket_ != nullptr; }
+    const PingConfig& current_config() const { return config_; }
+    uint64_t sent_ping_count() const { return sentPingCount_; }
+    uint64_t sent_byte_count() const { return sentByteCount_; }
+
+    static double ping_period(uint8_t pingRate);
+};
+
+} //namespace oculus
+
+#endif //_DEF_OCULUS_DRIVER_SONAR_SIMULATOR_H_
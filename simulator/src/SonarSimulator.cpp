@@ -0,0 +1,442 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/SonarSimulator.h>
+
+namespace oculus {
+
+using namespace std::placeholders;
+
+constexpr unsigned short SonarSimulator::DataPort;
+constexpr unsigned short SonarSimulator::StatusPort;
+
+SonarSimulator::SonarSimulator(const IoServicePtr& service,
+                               const std::string& statusAddress,
+                               const std::string& advertisedAddress,
+                               unsigned short dataPort,
+                               unsigned short statusPort) :
+    ioService_(service),
+    acceptor_(*service),
+    statusSocket_(*service),
+    statusRemote_(boost::asio::ip::address_v4::from_string(statusAddress), statusPort),
+    advertisedIp_(0),
+    statusTimer_(*service),
+    pingTimer_(*service),
+    writing_(false),
+    deviceId_(1),
+    config_(default_ping_config()),
+    messageVersion_(1),
+    rangeCount_(512),
+    unthrottled_(false),
+    pingId_(0),
+    startTime_(std::chrono::steady_clock::now()),
+    replayLoop_(true),
+    sentPingCount_(0),
+    sentByteCount_(0)
+{
+    // The status ipAddr field is read byte by byte (see ip_to_string).
+    auto bytes = boost::asio::ip::address_v4::from_string(advertisedAddress).to_bytes();
+    advertisedIp_ = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+
+    boost::system::error_code err;
+    statusSocket_.open(boost::asio::ip::udp::v4(), err);
+    if(err)
+        throw std::runtime_error("oculus::SonarSimulator : Error opening status socket");
+    statusSocket_.set_option(boost::asio::socket_base::broadcast(true));
+
+    Acceptor::endpoint_type endpoint(boost::asio::ip::tcp::v4(), dataPort);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(Acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+
+    std::cout << "oculus::SonarSimulator : status to " << statusRemote_
+              << ", listening on " << endpoint << std::endl;
+
+    this->accept_client();
+    this->send_status(boost::system::error_code());
+}
+
+SonarSimulator::~SonarSimulator()
+{
+    boost::system::error_code err;
+    statusTimer_.cancel(err);
+    pingTimer_.cancel(err);
+    acceptor_.close(err);
+    statusSocket_.close(err);
+    if(socket_) {
+        socket_->close(err);
+    }
+}
+
+/**
+ * Maximum ping period (in seconds) for a given pingRate.
+ */
+double SonarSimulator::ping_period(uint8_t pingRate)
+{
+    switch(pingRate) {
+        case pingRateNormal:  return 1.0 / 10.0; break;
+        case pingRateHigh:    return 1.0 / 15.0; break;
+        case pingRateHighest: return 1.0 / 40.0; break;
+        case pingRateLow:     return 1.0 /  5.0; break;
+        case pingRateLowest:  return 1.0 /  2.0; break;
+        default:              return 1.0;        break; // standby, dummy messages
+    }
+}
+
+void SonarSimulator::replay_file(const std::string& filename, bool loop)
+{
+    replay_     = std::make_unique<FileReader>(filename);
+    replayLoop_ = loop;
+}
+
+void SonarSimulator::send_status(const boost::system::error_code& err)
+{
+    if(err) return; // timer cancelled
+
+    OculusStatusMsg msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.hdr.oculusId    = OCULUS_CHECK_ID;
+    msg.hdr.srcDeviceId = deviceId_;
+    msg.hdr.payloadSize = sizeof(msg) - sizeof(msg.hdr);
+    msg.deviceId        = deviceId_;
+    msg.deviceType      = deviceTypeImagingSonar;
+    msg.partNumber      = partNumberM750d;
+    msg.status          = oculusMasterStatusMainRun;
+    msg.ipAddr          = advertisedIp_;
+    msg.ipMask          = 0x00ffffff; // 255.255.255.0
+    msg.temperature0    = 20.0;
+
+    boost::system::error_code sendErr;
+    statusSocket_.send_to(boost::asio::buffer(&msg, sizeof(msg)), statusRemote_, 0, sendErr);
+    if(sendErr) {
+        std::cerr << "oculus::SonarSimulator : could not send status ("
+                  << sendErr.message() << ")" << std::endl;
+    }
+
+    statusTimer_.expires_from_now(std::chrono::seconds(1));
+    statusTimer_.async_wait(std::bind(&SonarSimulator::send_status, this, _1));
+}
+
+void SonarSimulator::accept_client()
+{
+    auto socket = std::make_shared<Socket>(*ioService_);
+    acceptor_.async_accept(*socket, [this, socket](const boost::system::error_code& err) {
+        if(err == boost::asio::error::operation_aborted)
+            return;
+        if(!err) {
+            // A new connection replaces the previous one.
+            this->close_client();
+            socket->set_option(boost::asio::ip::tcp::no_delay(true));
+            socket_ = std::make_unique<Socket>(std::move(*socket));
+            pingId_ = 0;
+            std::cout << "oculus::SonarSimulator : client connected ("
+                      << socket_->remote_endpoint() << ")" << std::endl;
+            this->receive_fire_message();
+        }
+        this->accept_client();
+    });
+}
+
+void SonarSimulator::close_client()
+{
+    boost::system::error_code err;
+    pingTimer_.cancel(err);
+    if(socket_) {
+        socket_->shutdown(Socket::shutdown_both, err);
+        socket_->close(err);
+        socket_ = nullptr;
+    }
+    writing_ = false;
+}
+
+void SonarSimulator::receive_fire_message()
+{
+    boost::asio::async_read(*socket_,
+        boost::asio::buffer(&fireHeader_, sizeof(fireHeader_)),
+        std::bind(&SonarSimulator::fire_header_received, this, _1, _2));
+}
+
+void SonarSimulator::fire_header_received(const boost::system::error_code& err,
+                                          std::size_t count)
+{
+    if(err == boost::asio::error::operation_aborted)
+        return;
+    if(err || count != sizeof(fireHeader_) || !header_valid(fireHeader_)
+       || fireHeader_.payloadSize > 65536)
+    {
+        if(!err) {
+            std::cerr << "oculus::SonarSimulator : invalid message from client" << std::endl;
+        }
+        this->close_client();
+        return;
+    }
+    fireData_.resize(sizeof(fireHeader_) + fireHeader_.payloadSize);
+    std::memcpy(fireData_.data(), &fireHeader_, sizeof(fireHeader_));
+    boost::asio::async_read(*socket_,
+        boost::asio::buffer(fireData_.data() + sizeof(fireHeader_), fireHeader_.payloadSize),
+        std::bind(&SonarSimulator::fire_payload_received, this, _1, _2));
+}
+
+void SonarSimulator::fire_payload_received(const boost::system::error_code& err,
+                                           std::size_t count)
+{
+    if(err == boost::asio::error::operation_aborted)
+        return;
+    if(err || count != fireHeader_.payloadSize) {
+        this->close_client();
+        return;
+    }
+
+    if(fireHeader_.msgId == messageSimpleFire) {
+        if(fireData_.size() == sizeof(OculusSimpleFireMessage)) {
+            std::memcpy(&config_, fireData_.data(), sizeof(config_));
+        }
+        else if(fireData_.size() == sizeof(OculusSimpleFireMessage2)) {
+            // Same layout as OculusSimpleFireMessage up to the salinity field.
+            std::memcpy(&config_, fireData_.data(), sizeof(config_));
+        }
+        this->schedule_ping();
+    }
+    this->receive_fire_message();
+}
+
+void SonarSimulator::schedule_ping()
+{
+    if(!socket_) return;
+    // A pending wait is cancelled by expires_from_now.
+    pingTimer_.expires_from_now(std::chrono::seconds(0));
+    pingTimer_.async_wait(std::bind(&SonarSimulator::ping_timer_callback, this, _1));
+}
+
+void SonarSimulator::ping_timer_callback(const boost::system::error_code& err)
+{
+    if(err || !socket_) return;
+
+    const bool standby = config_.pingRate == pingRateStandby;
+    if(standby || !unthrottled_) {
+        // Keeping a steady ping rate, unless we are late.
+        auto period = std::chrono::duration_cast<Timer::duration>(
+            std::chrono::duration<double>(ping_period(config_.pingRate)));
+        auto next = pingTimer_.expiry() + period;
+        if(next < Timer::clock_type::now()) {
+            next = Timer::clock_type::now() + period;
+        }
+        pingTimer_.expires_at(next);
+        pingTimer_.async_wait(std::bind(&SonarSimulator::ping_timer_callback, this, _1));
+    }
+
+    if(writing_) {
+        // The previous message is still being sent. When unthrottled, the
+        // next ping will be sent by write_callback. Otherwise, this ping is
+        // dropped like the sonar would do on a slow link.
+        return;
+    }
+    this->send_output(!standby);
+}
+
+void SonarSimulator::send_output(bool isPing)
+{
+    if(isPing) {
+        if(!replay_ || !this->make_replayed_ping()) {
+            this->make_synthetic_ping();
+        }
+    }
+    else {
+        this->make_dummy_message();
+    }
+
+    writing_ = true;
+    boost::asio::async_write(*socket_, boost::asio::buffer(outData_),
+        std::bind(&SonarSimulator::write_callback, this, _1, _2));
+}
+
+void SonarSimulator::write_callback(const boost::system::error_code& err,
+                                    std::size_t count)
+{
+    if(err == boost::asio::error::operation_aborted)
+        return;
+    writing_ = false;
+    if(err) {
+        std::cerr << "oculus::SonarSimulator : client disconnected ("
+                  << err.message() << ")" << std::endl;
+        this->close_client();
+        return;
+    }
+
+    sentByteCount_ += count;
+    const auto& header = *reinterpret_cast<const OculusMessageHeader*>(outData_.data());
+    if(header.msgId == messageSimplePingResult) {
+        sentPingCount_++;
+    }
+
+    if(unthrottled_ && config_.pingRate != pingRateStandby) {
+        this->send_output(true);
+    }
+}
+
+void SonarSimulator::make_dummy_message()
+{
+    OculusMessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.srcDeviceId = deviceId_;
+    header.msgId       = messageDummy;
+    header.payloadSize = 0;
+
+    outData_.resize(sizeof(header));
+    std::memcpy(outData_.data(), &header, sizeof(header));
+}
+
+bool SonarSimulator::make_replayed_ping()
+{
+    auto msg = replay_->read_next_message();
+    while(msg && !msg->is_ping_message()) {
+        msg = replay_->read_next_message();
+    }
+    if(!msg && replayLoop_) {
+        replay_->rewind();
+        msg = replay_->read_next_message();
+        while(msg && !msg->is_ping_message()) {
+            msg = replay_->read_next_message();
+        }
+    }
+    if(!msg) {
+        std::cerr << "oculus::SonarSimulator : end of replay, "
+                  << "sending synthetic pings." << std::endl;
+        replay_ = nullptr;
+        return false;
+    }
+    auto data = msg->bytes();
+    outData_.assign(data.begin(), data.end());
+    return true;
+}
+
+namespace {
+
+template <class FireT, class PingT>
+void fill_ping_metadata(PingT& ping, const FireT& fire, uint16_t nBeams,
+                        uint16_t nRanges, uint8_t sampleSize)
+{
+    ping.fireMessage       = fire;
+    ping.status            = 0;
+    ping.frequency         = fire.masterMode == 1 ? 750.0e3 : 1.2e6;
+    ping.temperature       = 20.0;
+    ping.pressure          = 1.0;
+    ping.speeedOfSoundUsed = fire.speedOfSound != 0.0 ? fire.speedOfSound : 1500.0;
+    ping.dataSize          = sampleSize == 2 ? dataSize16Bit : dataSize8Bit;
+    ping.nRanges           = nRanges;
+    ping.nBeams            = nBeams;
+}
+
+} //namespace
+
+/**
+ * Builds a ping from the current configuration.
+ *
+ * The image is a low level speckle-like background with a bright arc moving
+ * in range from one ping to the next.
+ */
+void SonarSimulator::make_synthetic_ping()
+{
+    const bool     wide       = config_.masterMode == 1;
+    const uint16_t nBeams     = (config_.flags & 0x40) ? 512 : 256;
+    const uint16_t nRanges    = rangeCount_;
+    const uint8_t  sampleSize = (config_.flags & 0x2) ? 2 : 1;
+    const bool     gains      = config_.flags & 0x4;
+    const double   aperture   = wide ? 130.0 : 80.0; // degrees
+    const double   elapsed    = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - startTime_).count();
+
+    // The sonar reports the gain between 40% and 100% in high frequency mode
+    // (see SonarDriver::handle_message).
+    PingConfig fire = config_;
+    if(fire.masterMode == 2) {
+        fire.gainPercent = 40.0 + 0.6*fire.gainPercent;
+    }
+    fire.head.srcDeviceId = deviceId_;
+    fire.head.dstDeviceId = 0;
+    fire.head.msgId       = messageSimplePingResult;
+    fire.head.msgVersion  = messageVersion_;
+
+    const std::size_t metadataSize = messageVersion_ == 2 ?
+        sizeof(OculusSimplePingResult2) : sizeof(OculusSimplePingResult);
+    const uint32_t lineSize    = (gains ? 4 : 0) + nBeams*sampleSize;
+    const uint32_t imageOffset = metadataSize + nBeams*sizeof(int16_t);
+    const uint32_t imageSize   = nRanges*lineSize;
+    const uint32_t messageSize = imageOffset + imageSize;
+
+    fire.head.payloadSize = messageSize - sizeof(OculusMessageHeader);
+
+    outData_.resize(messageSize);
+    std::memset(outData_.data(), 0, metadataSize);
+    if(messageVersion_ == 2) {
+        OculusSimpleFireMessage2 fire2;
+        std::memset(&fire2, 0, sizeof(fire2));
+        std::memcpy(&fire2, &fire, sizeof(fire)); // common prefix
+        auto& ping = *reinterpret_cast<OculusSimplePingResult2*>(outData_.data());
+        fill_ping_metadata(ping, fire2, nBeams, nRanges, sampleSize);
+        ping.pingId          = pingId_;
+        ping.pingStartTime   = elapsed;
+        ping.rangeResolution = fire.range / nRanges;
+        ping.imageOffset     = imageOffset;
+        ping.imageSize       = imageSize;
+        ping.messageSize     = messageSize;
+    }
+    else {
+        auto& ping = *reinterpret_cast<OculusSimplePingResult*>(outData_.data());
+        fill_ping_metadata(ping, fire, nBeams, nRanges, sampleSize);
+        ping.pingId          = pingId_;
+        ping.pingStartTime   = (uint32_t)(uint64_t)(1.0e6*elapsed); // microseconds
+        ping.rangeResolution = fire.range / nRanges;
+        ping.imageOffset     = imageOffset;
+        ping.imageSize       = imageSize;
+        ping.messageSize     = messageSize;
+    }
+
+    int16_t* bearings = reinterpret_cast<int16_t*>(outData_.data() + metadataSize);
+    for(int b = 0; b < nBeams; b++) {
+        bearings[b] = (int16_t)(100.0*aperture*((b + 0.5) / nBeams - 0.5));
+    }
+
+    const uint16_t targetRange = (pingId_ * 3) % nRanges;
+    uint8_t* line = outData_.data() + imageOffset;
+    for(int r = 0; r < nRanges; r++, line += lineSize) {
+        uint8_t* samples = line;
+        if(gains) {
+            uint32_t gain = 1 + r;
+            std::memcpy(line, &gain, sizeof(gain));
+            samples += 4;
+        }
+        const bool onTarget = std::abs(r - targetRange) < 2;
+        for(int b = 0; b < nBeams; b++) {
+            uint8_t value = onTarget ? 200 : ((r*7 + b*13 + pingId_) & 0x1f);
+            if(sampleSize == 2) {
+                uint16_t value16 = value << 8;
+                std::memcpy(samples + 2*b, &value16, sizeof(value16));
+            }
+            else {
+                samples[b] = value;
+            }
+        }
+    }
+
+    pingId_++;
+}
+
+} //namespace oculus
@@ -0,0 +1,82 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <string>
+#include <csignal>
+using namespace std;
+
+#include <oculus_driver/SonarSimulator.h>
+using namespace oculus;
+
+void print_usage(const char* name)
+{
+    cout << "Usage : " << name << " [options]\n"
+         << "  --version <1|2>     Synthetic ping message version (default 1)\n"
+         << "  --ranges <n>        Number of range lines of synthetic pings (default 512)\n"
+         << "  --file <path>       Replay pings from a .oculus file\n"
+         << "  --once              Do not loop the replayed file\n"
+         << "  --unthrottled       Send pings as fast as possible\n"
+         << "  --status <address>  Destination of status messages (default 127.0.0.1)\n"
+         << "  --ip <address>      Sonar address advertised in status (default 127.0.0.1)\n";
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t    version     = 1;
+    uint16_t    rangeCount  = 512;
+    std::string filename    = "";
+    bool        loop        = true;
+    bool        unthrottled = false;
+    std::string statusAddress     = "127.0.0.1";
+    std::string advertisedAddress = "127.0.0.1";
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if(arg == "--version" && hasValue)     version = std::stoi(argv[++i]);
+        else if(arg == "--ranges" && hasValue) rangeCount = std::stoi(argv[++i]);
+        else if(arg == "--file" && hasValue)   filename = argv[++i];
+        else if(arg == "--status" && hasValue) statusAddress = argv[++i];
+        else if(arg == "--ip" && hasValue)     advertisedAddress = argv[++i];
+        else if(arg == "--once")               loop = false;
+        else if(arg == "--unthrottled")        unthrottled = true;
+        else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    auto ioService = std::make_shared<SonarSimulator::IoService>();
+    SonarSimulator simulator(ioService, statusAddress, advertisedAddress);
+    simulator.set_message_version(version);
+    simulator.set_range_count(rangeCount);
+    simulator.set_unthrottled(unthrottled);
+    if(filename.size() > 0) {
+        simulator.replay_file(filename, loop);
+    }
+
+    boost::asio::signal_set signals(*ioService, SIGINT, SIGTERM);
+    signals.async_wait([&](const boost::system::error_code&, int) { ioService->stop(); });
+
+    ioService->run(); // is blocking
+
+    cout << "Sent " << simulator.sent_ping_count() << " pings ("
+         << simulator.sent_byte_count() << " bytes)" << endl;
+    return 0;
+}
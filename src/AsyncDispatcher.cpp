@@ -0,0 +1,154 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <stdexcept>
+
+#include <oculus_driver/AsyncDispatcher.h>
+
+namespace oculus {
+
+DispatchChannelBase::DispatchChannelBase(AsyncDispatcher* dispatcher) :
+    dispatcher_(dispatcher),
+    scheduled_(false),
+    closed_(false),
+    runner_(),
+    channelCount_(dispatcher->channelCount_)
+{
+    // Refused here rather than when scheduling, which happens on the
+    // producer (reception) thread.
+    if(++(*channelCount_) > dispatcher->ready_.capacity()) {
+        --(*channelCount_);
+        throw std::runtime_error("oculus::AsyncDispatcher : too many channels.");
+    }
+}
+
+DispatchChannelBase::~DispatchChannelBase()
+{
+    --(*channelCount_);
+}
+
+void DispatchChannelBase::schedule()
+{
+    dispatcher_->schedule(this);
+}
+
+void DispatchChannelBase::close()
+{
+    closed_ = true;
+    if(runner_.load() == std::this_thread::get_id()) {
+        // Closed from its own callback. The worker will release it.
+        return;
+    }
+    std::unique_lock<std::mutex> lock(dispatcher_->mutex_);
+    dispatcher_->closeCv_.wait(lock, [&]() {
+        return !scheduled_ || !dispatcher_->running_;
+    });
+}
+
+AsyncDispatcher::AsyncDispatcher(unsigned int workerCount, std::size_t maxChannels) :
+    ready_(maxChannels),
+    readyCount_(0),
+    running_(true),
+    channelCount_(std::make_shared<std::atomic<std::size_t>>(0))
+{
+    if(workerCount == 0) {
+        workerCount = 1;
+    }
+    for(unsigned int i = 0; i < workerCount; i++) {
+        workers_.push_back(std::thread(&AsyncDispatcher::worker_loop, this));
+    }
+}
+
+AsyncDispatcher::~AsyncDispatcher()
+{
+    this->stop();
+}
+
+void AsyncDispatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    closeCv_.notify_all();
+    for(auto& worker : workers_) {
+        if(worker.joinable())
+            worker.join();
+    }
+    workers_.clear();
+}
+
+/**
+ * Hands a channel with pending items to the workers. A channel is in the ready
+ * queue at most once and there are never more live channels than the
+ * capacity of ready_, so the push cannot fail.
+ */
+void AsyncDispatcher::schedule(DispatchChannelBase* channel)
+{
+    if(channel->closed_ || channel->scheduled_.exchange(true)) {
+        return;
+    }
+    // Counted before being published so a worker popping the channel right
+    // away never sees the count go below zero.
+    readyCount_++;
+    ready_.try_push(channel->shared_from_this());
+    {
+        // Taking the lock makes sure the notification is not lost if a worker
+        // is about to wait.
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    cv_.notify_one();
+}
+
+void AsyncDispatcher::worker_loop()
+{
+    while(running_) {
+        DispatchChannelBase::Ptr channel;
+        if(!ready_.try_pop(channel)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&]() { return !running_ || readyCount_ > 0; });
+            continue;
+        }
+        readyCount_--;
+
+        channel->runner_ = std::this_thread::get_id();
+        channel->run();
+        channel->runner_ = std::thread::id();
+        channel->scheduled_ = false;
+        if(channel->closed_) {
+            // Releasing a close() waiting on another thread. Taking the lock
+            // makes sure the notification is not lost.
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+            }
+            closeCv_.notify_all();
+        }
+        // Items may be left (run() processes a limited batch), or may have
+        // been pushed after run() returned and before scheduled_ was cleared
+        // (the producer did not schedule the channel then). The channel goes
+        // back at the end of the ready queue so the other channels get their
+        // turn.
+        if(!channel->closed_ && !channel->empty()) {
+            this->schedule(channel.get());
+        }
+        channel = nullptr;
+    }
+}
+
+} //namespace oculus
@@ -0,0 +1,435 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/AsyncRecorder.h>
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+namespace oculus {
+
+AsyncRecorder::AsyncRecorder(std::size_t blockSize,
+                             std::size_t blockCount,
+                             const Duration& flushPeriod) :
+    blockSize_(blockSize),
+    fd_(-1),
+    flushPeriod_(flushPeriod),
+    blocks_(std::max<std::size_t>(blockCount, 2)),
+    current_(nullptr),
+    inFlight_(0),
+    accepting_(false),
+    stopping_(false),
+    writtenBytes_(0),
+    droppedItems_(0),
+    writeErrors_(0),
+    codec_(Codec::None),
+    compressionLevel_(DefaultCompressionLevel),
+    lastLevel_(0)
+{
+    for(auto& block : blocks_) {
+        free_.push_back(&block);
+    }
+}
+
+/**
+ * During a stall the writer may hold a block in its writev call, the other
+ * blocks must hold the incoming data.
+ */
+std::size_t AsyncRecorder::block_size_for(double duration, double dataRate,
+                                          std::size_t blockCount)
+{
+    const std::size_t granularity = 1024*1024;
+    double size = duration * dataRate / (std::max<std::size_t>(blockCount, 2) - 1);
+    return granularity * (std::size_t)std::ceil(size / granularity);
+}
+
+AsyncRecorder::~AsyncRecorder()
+{
+    if(this->is_open()) {
+        this->close();
+    }
+}
+
+/**
+ * Opens a new file. An existing file is overwritten only if force is set,
+ * otherwise an exception is thrown and the file is left untouched.
+ */
+void AsyncRecorder::open(const std::string& filename, bool force)
+{
+    if(this->is_open()) {
+        this->close();
+    }
+    // Allocated here so an unused recorder does not hold the memory.
+    for(auto& block : blocks_) {
+        block.data.resize(blockSize_);
+    }
+
+    int flags = O_WRONLY | O_CREAT | (force ? O_TRUNC : O_EXCL);
+    fd_ = ::open(filename.c_str(), flags, 0644);
+    if(fd_ < 0) {
+        std::ostringstream oss;
+        oss << "Could not open file for writing : " << filename
+            << " (" << std::strerror(errno) << ")";
+        if(errno == EEXIST) {
+            oss << ", use force to overwrite it";
+        }
+        throw std::runtime_error(oss.str());
+    }
+    filename_ = filename;
+
+    auto header = Recorder::make_file_header();
+    Block headerBlock;
+    headerBlock.data.resize(sizeof(header));
+    headerBlock.size = sizeof(header);
+    std::memcpy(headerBlock.data.data(), &header, sizeof(header));
+    if(!this->write_all({&headerBlock})) {
+        ::close(fd_);
+        fd_ = -1;
+        throw std::runtime_error("Could not write file header : " + filename);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        accepting_    = true;
+        stopping_     = false;
+        writtenBytes_ = sizeof(header);
+        droppedItems_ = 0;
+        writeErrors_  = 0;
+        compressionStats_ = CompressionStats();
+    }
+    writer_ = std::thread(&AsyncRecorder::writer_loop, this);
+}
+
+void AsyncRecorder::close()
+{
+    if(!this->is_open()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(current_ && current_->size > 0) {
+            this->push_full(current_);
+            current_ = nullptr;
+        }
+        accepting_ = false;
+        stopping_  = true;
+    }
+    writerCv_.notify_all();
+    writer_.join();
+
+    ::close(fd_);
+    fd_ = -1;
+}
+
+void AsyncRecorder::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(!accepting_) {
+        return;
+    }
+    if(current_ && current_->size > 0) {
+        this->push_full(current_);
+        current_ = nullptr;
+    }
+    writerCv_.notify_all();
+    flushedCv_.wait(lock, [&]() { return full_.empty() && inFlight_ == 0; });
+}
+
+void AsyncRecorder::set_compression(Codec codec, int level, unsigned int workerCount)
+{
+    if(this->is_open()) {
+        throw std::runtime_error(
+            "oculus::AsyncRecorder : compression must be set while the recorder is closed.");
+    }
+    if(!codec_available(codec)) {
+        std::ostringstream oss;
+        oss << "oculus::AsyncRecorder : compression codec '" << codec_name(codec)
+            << "' not available in this build.";
+        throw std::runtime_error(oss.str());
+    }
+    codec_            = codec;
+    compressionLevel_ = level;
+    compressionPool_  = nullptr;
+    if(codec_ != Codec::None) {
+        compressionPool_ = std::make_unique<ThreadPool>(workerCount);
+    }
+}
+
+/**
+ * Queues a block for writing (mutex_ is expected to be locked). The block is
+ * compressed first if compression is enabled. The level depends on the number
+ * of blocks already waiting : fastest level when half of the blocks are
+ * waiting, no compression from three quarters.
+ */
+void AsyncRecorder::push_full(Block* block)
+{
+    full_.push_back(block);
+    block->outputSize = 0;
+    block->ready      = true;
+    if(codec_ == Codec::None) {
+        return;
+    }
+
+    std::size_t backlog = full_.size() - 1;
+    int level = compressionLevel_;
+    if(4*backlog >= 3*blocks_.size()) {
+        lastLevel_ = 0;
+        return; // stored as is
+    }
+    if(2*backlog >= blocks_.size()) {
+        level = fastest_compression_level(codec_);
+    }
+    lastLevel_    = level;
+    block->ready = false;
+    compressionPool_->post([this, block, level]() { this->compress_block(block, level); });
+}
+
+/**
+ * Called in the compression pool. The sonar message items are compressed one
+ * by one, other items are copied.
+ */
+void AsyncRecorder::compress_block(Block* block, int level)
+{
+    OCULUS_TRACE_SCOPE("AsyncRecorder::compress_block");
+    static thread_local std::vector<uint8_t> compressed;
+
+    CompressionStats stats;
+    block->output.resize(block->size);
+    std::size_t outputSize = 0;
+    std::size_t pos        = 0;
+    while(pos + sizeof(blueprint::LogItem) <= block->size) {
+        blueprint::LogItem item;
+        std::memcpy(&item, block->data.data() + pos, sizeof(item));
+        const uint8_t* payload = block->data.data() + pos + sizeof(item);
+        pos += sizeof(item) + item.payloadSize;
+
+        if(item.type == blueprint::rt_oculusSonar && item.compression == 0) {
+            stats.originalBytes += item.payloadSize;
+            if(compress(codec_, payload, item.payloadSize, compressed, level)
+               && compressed.size() < item.payloadSize)
+            {
+                item.compression = (uint16_t)codec_;
+                item.payloadSize = compressed.size();
+                payload          = compressed.data();
+            }
+            stats.compressedBytes += item.payloadSize;
+        }
+
+        if(block->output.size() < outputSize + sizeof(item) + item.payloadSize) {
+            block->output.resize(outputSize + sizeof(item) + item.payloadSize);
+        }
+        std::memcpy(block->output.data() + outputSize, &item, sizeof(item));
+        std::memcpy(block->output.data() + outputSize + sizeof(item), payload, item.payloadSize);
+        outputSize += sizeof(item) + item.payloadSize;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        block->outputSize = outputSize;
+        block->ready      = true;
+        compressionStats_.originalBytes   += stats.originalBytes;
+        compressionStats_.compressedBytes += stats.compressedBytes;
+    }
+    writerCv_.notify_all();
+}
+
+/**
+ * Makes sure current_ has at least size bytes available (mutex_ is expected
+ * to be locked). Returns false if no block is available.
+ */
+bool AsyncRecorder::reserve(std::size_t size)
+{
+    if(current_ && current_->size + size <= current_->data.size()) {
+        return true;
+    }
+    if(current_ && current_->size > 0) {
+        this->push_full(current_);
+        current_ = nullptr;
+        writerCv_.notify_all();
+    }
+    if(!current_) {
+        if(free_.size() == 0) {
+            return false;
+        }
+        current_ = free_.back();
+        free_.pop_back();
+        current_->size = 0;
+    }
+    if(current_->data.size() < size) {
+        // Message larger than a block (should not happen with the default
+        // block size).
+        current_->data.resize(size);
+    }
+    return true;
+}
+
+std::size_t AsyncRecorder::write(const Message& message)
+{
+    OCULUS_TRACE_SCOPE("AsyncRecorder::write");
+
+    TimeStamp stamp = TimeStamp::from_sonar_stamp(message.timestamp());
+    auto dataItem  = Recorder::make_item(blueprint::rt_oculusSonar,
+                                         stamp.to_seconds<double>(),
+                                         message.bytes().size());
+    auto stampItem = Recorder::make_item(blueprint::rt_oculusSonarStamp,
+                                         stamp.to_seconds<double>(),
+                                         sizeof(stamp));
+    std::size_t size = 2*sizeof(blueprint::LogItem) + dataItem.payloadSize + sizeof(stamp);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!accepting_) {
+        return 0;
+    }
+    if(!this->reserve(size)) {
+        droppedItems_++;
+        return 0;
+    }
+
+    uint8_t* dst = current_->data.data() + current_->size;
+    std::memcpy(dst, &dataItem, sizeof(dataItem));
+    dst += sizeof(dataItem);
+    std::memcpy(dst, message.bytes().data(), dataItem.payloadSize);
+    dst += dataItem.payloadSize;
+    std::memcpy(dst, &stampItem, sizeof(stampItem));
+    dst += sizeof(stampItem);
+    std::memcpy(dst, &stamp, sizeof(stamp));
+    current_->size += size;
+
+    return size;
+}
+
+void AsyncRecorder::writer_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true) {
+        // Blocks are written in order, waiting for the first one to be
+        // compressed.
+        auto ready = [&]() { return !full_.empty() && full_.front()->ready; };
+        writerCv_.wait_for(lock, flushPeriod_, [&]() {
+            return ready() || (stopping_ && full_.empty());
+        });
+        if(full_.empty() && current_ && current_->size > 0) {
+            // Nothing received for a while, writing the partially filled block.
+            this->push_full(current_);
+            current_ = nullptr;
+        }
+        if(!ready()) {
+            if(stopping_ && full_.empty()) break;
+            continue;
+        }
+
+        std::vector<Block*> blocks;
+        while(ready()) {
+            blocks.push_back(full_.front());
+            full_.pop_front();
+        }
+        inFlight_ = 0;
+        for(auto block : blocks) {
+            inFlight_ += block->outputSize > 0 ? block->outputSize : block->size;
+        }
+
+        lock.unlock();
+        bool success = this->write_all(blocks);
+        lock.lock();
+
+        if(success) {
+            writtenBytes_ += inFlight_;
+        }
+        else {
+            writeErrors_++;
+        }
+        inFlight_ = 0;
+        for(auto block : blocks) {
+            block->size = 0;
+            free_.push_back(block);
+        }
+        flushedCv_.notify_all();
+    }
+    flushedCv_.notify_all();
+}
+
+/**
+ * Writes all the blocks with as few system calls as possible.
+ */
+bool AsyncRecorder::write_all(const std::vector<Block*>& blocks)
+{
+    std::vector<iovec> iovs;
+    for(auto block : blocks) {
+        iovec iov;
+        if(block->outputSize > 0) {
+            iov.iov_base = block->output.data();
+            iov.iov_len  = block->outputSize;
+        }
+        else {
+            iov.iov_base = block->data.data();
+            iov.iov_len  = block->size;
+        }
+        iovs.push_back(iov);
+    }
+
+    std::size_t first = 0;
+    while(first < iovs.size()) {
+        int count = std::min<std::size_t>(iovs.size() - first, IOV_MAX);
+        ssize_t res = ::writev(fd_, iovs.data() + first, count);
+        if(res < 0) {
+            if(errno == EINTR) continue;
+            std::cerr << "oculus::AsyncRecorder : error writing to " << filename_
+                      << " : " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        // Skipping what was written (writev may write partially).
+        std::size_t written = res;
+        while(first < iovs.size() && written >= iovs[first].iov_len) {
+            written -= iovs[first].iov_len;
+            first++;
+        }
+        if(first < iovs.size()) {
+            iovs[first].iov_base = (uint8_t*)iovs[first].iov_base + written;
+            iovs[first].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+RecorderStats AsyncRecorder::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    RecorderStats stats;
+    stats.queueDepth   = full_.size();
+    stats.bytesPending = inFlight_ + (current_ ? current_->size : 0);
+    for(auto block : full_) {
+        stats.bytesPending += block->size;
+    }
+    stats.writtenBytes = writtenBytes_;
+    stats.droppedItems = droppedItems_;
+    stats.writeErrors  = writeErrors_;
+    stats.compression      = compressionStats_;
+    stats.compressionLevel = lastLevel_;
+    return stats;
+}
+
+} //namespace oculus
@@ -0,0 +1,93 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/BatchDecoder.h>
+#include <oculus_driver/MappedFileReader.h>
+#include <oculus_driver/helpers.h>
+
+#include <future>
+#include <stdexcept>
+#include <algorithm>
+
+namespace oculus {
+
+BatchDecoder::BatchDecoder(const std::string& filename, ThreadPool& pool,
+                           std::size_t batchSize) :
+    filename_(filename),
+    pool_(pool),
+    batchSize_(std::max<std::size_t>(batchSize, 1))
+{}
+
+std::size_t BatchDecoder::decode(const Callback& callback)
+{
+    // The index gives the position of each ping in the file, so each worker
+    // can read its own range of pings without the others.
+    auto index = FileIndex::load_or_build(filename_);
+    std::size_t pingCount = index->ping_count();
+
+    // Each range is read (and decompressed) and converted by one task, from
+    // its own mapping of the file.
+    auto decode_range = [&](std::vector<DecodedPing>& batch, std::size_t firstPing,
+                            std::size_t first, std::size_t last)
+    {
+        MappedFileReader reader(filename_, MappedFileReader::AdviceNormal, 0);
+        reader.set_index(index);
+        reader.seek_to_message(index->find_ping_index(firstPing + first));
+        for(std::size_t i = first; i < last; i++) {
+            auto ping = reader.read_next_ping();
+            if(!ping) {
+                throw std::runtime_error("oculus::BatchDecoder : file index does not match "
+                                         + filename_);
+            }
+            batch[i] = DecodedPing{firstPing + i, ping, get_ping_acoustic_data(ping->bytes())};
+        }
+    };
+    // One range per thread (more would map the file more often for nothing).
+    std::size_t grain = std::max<std::size_t>(1, batchSize_ / (pool_.thread_count() + 1));
+    auto decode_batch = [&](std::vector<DecodedPing>& batch, std::size_t firstPing) {
+        batch.resize(std::min(batchSize_, pingCount - std::min(firstPing, pingCount)));
+        pool_.parallel_for(0, batch.size(), [&](std::size_t first, std::size_t last) {
+            decode_range(batch, firstPing, first, last);
+        }, grain);
+    };
+
+    std::size_t count = 0;
+    std::vector<DecodedPing> current, next;
+    decode_batch(current, 0);
+    while(!current.empty()) {
+        count += current.size();
+
+        // decoding the next batch while the callback is consuming the
+        // current one.
+        auto pending = pool_.submit([&]() { decode_batch(next, count); });
+        try {
+            for(const auto& ping : current) {
+                callback(ping);
+            }
+        }
+        catch(...) {
+            pending.wait(); // next must outlive the conversion
+            throw;
+        }
+        pending.get();
+        std::swap(current, next);
+    }
+    return count;
+}
+
+} //namespace oculus
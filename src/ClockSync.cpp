@@ -0,0 +1,232 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/ClockSync.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace oculus {
+
+ClockSync::ClockSync(std::size_t windowSize,
+                     double      outlierThreshold,
+                     std::size_t minSamples,
+                     double      wrapPeriod) :
+    windowSize_(std::max<std::size_t>(windowSize, 2)),
+    minSamples_(std::max<std::size_t>(minSamples, 2)),
+    outlierThreshold_(outlierThreshold),
+    wrapPeriod_(wrapPeriod),
+    samples_(windowSize_),
+    residuals_(windowSize_),
+    absResiduals_(windowSize_),
+    inliers_(windowSize_),
+    hull_(windowSize_)
+{
+    this->reset();
+}
+
+void ClockSync::reset()
+{
+    next_          = 0;
+    count_         = 0;
+    hasOrigin_     = false;
+    sonarOrigin_   = 0.0;
+    hostOrigin_    = TimePoint();
+    lastSonarTime_ = 0.0;
+    wrapOffset_    = 0.0;
+    estimate_      = Estimate{false, 0.0, 0.0, 0.0, 0};
+}
+
+void ClockSync::set_wrap_period(double wrapPeriod)
+{
+    if(wrapPeriod != wrapPeriod_) {
+        wrapPeriod_ = wrapPeriod;
+        this->reset();
+    }
+}
+
+void ClockSync::add_sample(double sonarTime, const TimePoint& hostStamp)
+{
+    if(!hasOrigin_) {
+        hasOrigin_     = true;
+        sonarOrigin_   = sonarTime;
+        hostOrigin_    = hostStamp;
+        lastSonarTime_ = sonarTime;
+    }
+
+    double t = sonarTime + wrapOffset_;
+    if(t < lastSonarTime_) {
+        if(wrapPeriod_ > 0.0 && lastSonarTime_ - t > 0.5*wrapPeriod_) {
+            wrapOffset_ += wrapPeriod_;
+            t           += wrapPeriod_;
+        }
+        else {
+            // The sonar clock went back in time (probably a sonar reboot).
+            this->reset();
+            this->add_sample(sonarTime, hostStamp);
+            return;
+        }
+    }
+    lastSonarTime_ = t;
+
+    samples_[next_].sonarTime = t - sonarOrigin_;
+    samples_[next_].hostTime  = std::chrono::duration<double>(hostStamp - hostOrigin_).count();
+    next_  = (next_ + 1) % windowSize_;
+    count_ = std::min(count_ + 1, windowSize_);
+
+    this->update_estimate();
+}
+
+/**
+ * Least square fit of hostTime = offset + drift*sonarTime on the samples
+ * (only the ones with mask[i] != 0 if mask is given).
+ */
+bool ClockSync::fit(const std::vector<char>* mask, double& offset, double& drift) const
+{
+    std::size_t n = 0;
+    double mx = 0.0, my = 0.0;
+    for(std::size_t i = 0; i < count_; i++) {
+        if(mask && !(*mask)[i]) continue;
+        mx += samples_[i].sonarTime;
+        my += samples_[i].hostTime;
+        n++;
+    }
+    if(n < 2) return false;
+    mx /= n;
+    my /= n;
+
+    double sxx = 0.0, sxy = 0.0;
+    for(std::size_t i = 0; i < count_; i++) {
+        if(mask && !(*mask)[i]) continue;
+        double dx = samples_[i].sonarTime - mx;
+        sxx += dx*dx;
+        sxy += dx*(samples_[i].hostTime - my);
+    }
+    if(!(sxx > 0.0)) {
+        // All sonar dates are the same. Nothing to fit.
+        return false;
+    }
+    drift  = sxy / sxx;
+    offset = my - drift*mx;
+    return true;
+}
+
+/**
+ * Fits hostTime = offset + drift*sonarTime on the lower envelope of the
+ * inliers. The samples are visited from the oldest, in increasing sonar time
+ * order, to build their lower convex hull (monotone chain). The hull edge
+ * spanning the mean sonar date is the line under all the samples which is the
+ * highest at this date, which minimizes the sum of the residuals (all
+ * positive).
+ */
+bool ClockSync::fit_lower_envelope(double& offset, double& drift)
+{
+    std::size_t first = count_ < windowSize_ ? 0 : next_;
+    std::size_t n = 0, inlierCount = 0;
+    double mx = 0.0;
+    for(std::size_t k = 0; k < count_; k++) {
+        std::size_t i = (first + k) % windowSize_;
+        if(!inliers_[i]) continue;
+        const Sample& p = samples_[i];
+        mx += p.sonarTime;
+        inlierCount++;
+        if(n > 0 && samples_[hull_[n - 1]].sonarTime == p.sonarTime) {
+            // Same sonar date, only the lowest one can be on the hull.
+            if(p.hostTime >= samples_[hull_[n - 1]].hostTime) continue;
+            n--;
+        }
+        while(n >= 2) {
+            const Sample& a = samples_[hull_[n - 2]];
+            const Sample& b = samples_[hull_[n - 1]];
+            double cross = (b.sonarTime - a.sonarTime)*(p.hostTime  - a.hostTime)
+                         - (b.hostTime  - a.hostTime) *(p.sonarTime - a.sonarTime);
+            if(cross > 0.0) break;
+            n--;
+        }
+        hull_[n++] = i;
+    }
+    if(n < 2) return false;
+    mx /= inlierCount;
+
+    std::size_t edge = 1;
+    while(edge < n - 1 && samples_[hull_[edge]].sonarTime < mx) {
+        edge++;
+    }
+    const Sample& a = samples_[hull_[edge - 1]];
+    const Sample& b = samples_[hull_[edge]];
+    drift  = (b.hostTime - a.hostTime) / (b.sonarTime - a.sonarTime);
+    offset = a.hostTime - drift*a.sonarTime;
+    return true;
+}
+
+void ClockSync::update_estimate()
+{
+    estimate_.valid = false;
+    if(count_ < minSamples_) {
+        return;
+    }
+
+    double offset, drift;
+    if(!this->fit(nullptr, offset, drift)) {
+        return;
+    }
+
+    // Robust estimation of the residual dispersion.
+    for(std::size_t i = 0; i < count_; i++) {
+        residuals_[i] = samples_[i].hostTime - (offset + drift*samples_[i].sonarTime);
+        absResiduals_[i] = std::abs(residuals_[i]);
+    }
+    auto median = absResiduals_.begin() + count_ / 2;
+    std::nth_element(absResiduals_.begin(), median, absResiduals_.begin() + count_);
+    double sigma = 1.4826 * (*median);
+    double threshold = std::max(outlierThreshold_*sigma, 1.0e-6);
+
+    std::size_t inlierCount = 0;
+    for(std::size_t i = 0; i < count_; i++) {
+        inliers_[i] = std::abs(residuals_[i]) <= threshold;
+        inlierCount += inliers_[i];
+    }
+    if(!this->fit_lower_envelope(offset, drift) || drift <= 0.0) {
+        return;
+    }
+
+    estimate_.valid       = true;
+    estimate_.offset      = offset;
+    estimate_.drift       = drift;
+    estimate_.residualStd = sigma;
+    estimate_.inlierCount = inlierCount;
+}
+
+/**
+ * Converts a sonar date to a host date using the current estimate. The sonar
+ * date is expected to be close to the last added sample (less than half a wrap
+ * period away).
+ */
+ClockSync::TimePoint ClockSync::to_host_time(double sonarTime) const
+{
+    double t = sonarTime + wrapOffset_;
+    if(wrapPeriod_ > 0.0) {
+        if(t - lastSonarTime_ > 0.5*wrapPeriod_) t -= wrapPeriod_;
+        if(lastSonarTime_ - t > 0.5*wrapPeriod_) t += wrapPeriod_;
+    }
+    double hostTime = estimate_.offset + estimate_.drift*(t - sonarOrigin_);
+    return hostOrigin_ + std::chrono::duration_cast<TimePoint::duration>(
+        std::chrono::duration<double>(hostTime));
+}
+
+} //namespace oculus
@@ -0,0 +1,173 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/Compression.h>
+
+#include <cstring>
+#include <ostream>
+
+#ifdef OCULUS_DRIVER_HAS_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OCULUS_DRIVER_HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef OCULUS_DRIVER_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace oculus {
+
+bool codec_available(Codec codec)
+{
+    switch(codec) {
+        case Codec::None: return true;
+#ifdef OCULUS_DRIVER_HAS_ZLIB
+        case Codec::QCompress: return true;
+#endif
+#ifdef OCULUS_DRIVER_HAS_LZ4
+        case Codec::LZ4: return true;
+#endif
+#ifdef OCULUS_DRIVER_HAS_ZSTD
+        case Codec::Zstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+const char* codec_name(Codec codec)
+{
+    switch(codec) {
+        case Codec::None:      return "none";
+        case Codec::QCompress: return "qCompress";
+        case Codec::LZ4:       return "lz4";
+        case Codec::Zstd:      return "zstd";
+        default:               return "unknown";
+    }
+}
+
+int fastest_compression_level(Codec codec)
+{
+    switch(codec) {
+        case Codec::LZ4: return 16; // acceleration factor
+        default:         return 1;
+    }
+}
+
+bool compress(Codec codec, const uint8_t* src, std::size_t size,
+              std::vector<uint8_t>& dst, int level)
+{
+    switch(codec) {
+        case Codec::None:
+            dst.assign(src, src + size);
+            return true;
+#ifdef OCULUS_DRIVER_HAS_ZLIB
+        case Codec::QCompress: {
+            uLongf compressedSize = compressBound(size);
+            dst.resize(4 + compressedSize);
+            // Qt prepends the uncompressed size in big-endian
+            dst[0] = (size >> 24) & 0xff;
+            dst[1] = (size >> 16) & 0xff;
+            dst[2] = (size >>  8) & 0xff;
+            dst[3] =  size        & 0xff;
+            if(compress2(dst.data() + 4, &compressedSize, src, size,
+                         level < 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK) {
+                return false;
+            }
+            dst.resize(4 + compressedSize);
+            return true;
+        }
+#endif
+#ifdef OCULUS_DRIVER_HAS_LZ4
+        case Codec::LZ4: {
+            dst.resize(LZ4_compressBound(size));
+            // level is used as the acceleration factor (higher is faster)
+            int res = LZ4_compress_fast((const char*)src, (char*)dst.data(), size,
+                                        dst.size(), level < 1 ? 1 : level);
+            if(res <= 0) {
+                return false;
+            }
+            dst.resize(res);
+            return true;
+        }
+#endif
+#ifdef OCULUS_DRIVER_HAS_ZSTD
+        case Codec::Zstd: {
+            dst.resize(ZSTD_compressBound(size));
+            std::size_t res = ZSTD_compress(dst.data(), dst.size(), src, size,
+                                            level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+            if(ZSTD_isError(res)) {
+                return false;
+            }
+            dst.resize(res);
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+bool decompress(Codec codec, const uint8_t* src, std::size_t size,
+                uint8_t* dst, std::size_t originalSize)
+{
+    switch(codec) {
+        case Codec::None:
+            if(size != originalSize) {
+                return false;
+            }
+            std::memcpy(dst, src, size);
+            return true;
+#ifdef OCULUS_DRIVER_HAS_ZLIB
+        case Codec::QCompress: {
+            if(size < 4) {
+                return false;
+            }
+            std::size_t expected = ((std::size_t)src[0] << 24) | ((std::size_t)src[1] << 16)
+                                 | ((std::size_t)src[2] <<  8) |  (std::size_t)src[3];
+            uLongf decompressedSize = originalSize;
+            return expected == originalSize
+                && uncompress(dst, &decompressedSize, src + 4, size - 4) == Z_OK
+                && decompressedSize == originalSize;
+        }
+#endif
+#ifdef OCULUS_DRIVER_HAS_LZ4
+        case Codec::LZ4:
+            return LZ4_decompress_safe((const char*)src, (char*)dst, size, originalSize)
+                == (int)originalSize;
+#endif
+#ifdef OCULUS_DRIVER_HAS_ZSTD
+        case Codec::Zstd: {
+            std::size_t res = ZSTD_decompress(dst, originalSize, src, size);
+            return !ZSTD_isError(res) && res == originalSize;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const CompressionStats& stats)
+{
+    os << "original : " << stats.originalBytes
+       << " bytes, compressed : " << stats.compressedBytes
+       << " bytes, ratio : " << stats.ratio();
+    return os;
+}
+
+} //namespace oculus
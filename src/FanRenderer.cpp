@@ -0,0 +1,421 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/FanRenderer.h>
+#include <oculus_driver/helpers.h>
+#include <oculus_driver/Trace.h>
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define OCULUS_FAN_RENDERER_AVX2
+    #include <immintrin.h>
+#endif
+
+namespace oculus {
+
+constexpr int FanRenderer::WeightBits;
+constexpr std::size_t FanRenderer::MinTaskPixels;
+
+// FNV-1a
+static uint64_t hash_bytes(const uint8_t* data, std::size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for(std::size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static float lanczos2(float x)
+{
+    x = std::abs(x);
+    if(x < 1.0e-6f) return 1.0f;
+    if(x >= 2.0f)   return 0.0f;
+    float px = M_PI * x;
+    return 2.0f * std::sin(px) * std::sin(0.5f*px) / (px*px);
+}
+
+static int16_t to_fixed(float w)
+{
+    return std::lround(w * (1 << FanRenderer::WeightBits));
+}
+
+// Normalized 4 taps Lanczos weights at positions first..first+3.
+static void lanczos_weights(float pos, int first, int16_t* dst)
+{
+    float w[4];
+    float sum = 0.0f;
+    for(int t = 0; t < 4; t++) {
+        w[t] = lanczos2(pos - (first + t));
+        sum += w[t];
+    }
+    int total   = 0;
+    int largest = 0;
+    for(int t = 0; t < 4; t++) {
+        dst[t] = to_fixed(w[t] / sum);
+        total += dst[t];
+        if(dst[t] > dst[largest]) largest = t;
+    }
+    // rounding errors, the weights must sum to exactly 1
+    dst[largest] += (1 << FanRenderer::WeightBits) - total;
+}
+
+#ifdef OCULUS_FAN_RENDERER_AVX2
+static bool has_avx2()
+{
+    static const bool res = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return res;
+}
+
+__attribute__((target("avx2,fma")))
+static std::size_t gather_nearest_avx2(const float* src, const uint32_t* map,
+                                       float* dst, std::size_t begin, std::size_t end)
+{
+    std::size_t i = begin;
+    for(; i + 8 <= end; i += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(map + i));
+        _mm256_storeu_ps(dst + i, _mm256_i32gather_ps(src, idx, 4));
+    }
+    return i;
+}
+
+struct PairGather { __m256 low, high; };
+
+__attribute__((target("avx2,fma")))
+static inline PairGather gather_pairs(const float* src, __m256i idx)
+{
+    // Masked gathers from a zeroed source : same instruction, but gcc warns
+    // about the undefined source of _mm256_i32gather_pd.
+    auto base = (const double*)src;
+    auto zero = _mm256_setzero_pd();
+    auto all  = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return PairGather{
+        _mm256_castpd_ps(_mm256_mask_i32gather_pd(zero, base, _mm256_castsi256_si128(idx), all, 4)),
+        _mm256_castpd_ps(_mm256_mask_i32gather_pd(zero, base, _mm256_extracti128_si256(idx, 1), all, 4))};
+}
+
+__attribute__((target("avx2,fma")))
+static inline void deinterleave(const PairGather& pairs, __m256& even, __m256& odd)
+{
+    even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+        _mm256_shuffle_ps(pairs.low, pairs.high, _MM_SHUFFLE(2,0,2,0))), _MM_SHUFFLE(3,1,2,0)));
+    odd  = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+        _mm256_shuffle_ps(pairs.low, pairs.high, _MM_SHUFFLE(3,1,3,1))), _MM_SHUFFLE(3,1,2,0)));
+}
+
+__attribute__((target("avx2,fma")))
+static std::size_t gather_bilinear_avx2(const float* src, std::size_t nBeams,
+                                        const uint32_t* map, const int16_t* weights,
+                                        float* dst, std::size_t begin, std::size_t end)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / (1 << FanRenderer::WeightBits));
+    std::size_t i = begin;
+    for(; i + 8 <= end; i += 8) {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(map + i));
+        // (bearing, range) weight pairs : low and high half of each 32 bits lane
+        __m256i w   = _mm256_loadu_si256((const __m256i*)(weights + 2*i));
+        __m256  wb  = _mm256_mul_ps(scale,
+            _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(w, 16), 16)));
+        __m256  wr  = _mm256_mul_ps(scale, _mm256_cvtepi32_ps(_mm256_srai_epi32(w, 16)));
+
+        // The two horizontal neighbours are gathered together as a 64 bits
+        // element, then deinterleaved.
+        __m256 p00, p01, p10, p11;
+        deinterleave(gather_pairs(src, idx), p00, p01);
+        deinterleave(gather_pairs(src + nBeams, idx), p10, p11);
+        __m256 top    = _mm256_fmadd_ps(wb, _mm256_sub_ps(p01, p00), p00);
+        __m256 bottom = _mm256_fmadd_ps(wb, _mm256_sub_ps(p11, p10), p10);
+        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(wr, _mm256_sub_ps(bottom, top), top));
+    }
+    return i;
+}
+
+// One pixel at a time, the 4 bearing taps of a range row are contiguous.
+__attribute__((target("avx2,fma")))
+static std::size_t gather_lanczos_avx2(const float* src, std::size_t nBeams,
+                                       const uint32_t* map, const int16_t* weights,
+                                       float* dst, std::size_t begin, std::size_t end)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / (1 << FanRenderer::WeightBits));
+    for(std::size_t i = begin; i < end; i++) {
+        const float* p = src + map[i];
+        __m128i w  = _mm_loadu_si128((const __m128i*)(weights + 8*i));
+        __m128  wb = _mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_cvtepi16_epi32(w)));
+        __m128  wr = _mm_mul_ps(scale, _mm_cvtepi32_ps(_mm_cvtepi16_epi32(
+                                                       _mm_srli_si128(w, 8))));
+        __m128 acc = _mm_mul_ps(_mm_shuffle_ps(wr, wr, 0x00), _mm_loadu_ps(p));
+        acc = _mm_fmadd_ps(_mm_shuffle_ps(wr, wr, 0x55), _mm_loadu_ps(p +   nBeams), acc);
+        acc = _mm_fmadd_ps(_mm_shuffle_ps(wr, wr, 0xaa), _mm_loadu_ps(p + 2*nBeams), acc);
+        acc = _mm_fmadd_ps(_mm_shuffle_ps(wr, wr, 0xff), _mm_loadu_ps(p + 3*nBeams), acc);
+        acc = _mm_mul_ps(acc, wb);
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+        dst[i] = _mm_cvtss_f32(acc);
+    }
+    return end;
+}
+#endif
+
+FanRenderer::FanRenderer(unsigned int width, Interpolation interpolation) :
+    width_(width),
+    interpolation_(interpolation),
+    geometry_({0, 0, 0.0, 0, 0, 0, interpolation}),
+    mapUpdates_(0),
+    pool_(nullptr)
+{}
+
+/**
+ * Calls f(firstRow, lastRow) on the whole image, split between the pool
+ * threads if a pool was set and the image is large enough.
+ */
+template <class F>
+void FanRenderer::for_rows(F&& f) const
+{
+    if(!pool_) {
+        f(0, geometry_.height);
+        return;
+    }
+    pool_->parallel_for(0, geometry_.height, [&](std::size_t first, std::size_t last) {
+        f(first, last);
+    }, std::max<std::size_t>(1, MinTaskPixels / geometry_.width));
+}
+
+std::pair<unsigned int, unsigned int> FanRenderer::render(const MessageData& pingData,
+                                                          std::vector<float>& imageData)
+{
+    // Checked before anything is read from pingData (the bearings and the
+    // acoustic data must be inside the message).
+    PingFormat format = PingFormat::resolve(pingData);
+    std::size_t metadataSize = format.version != 2 ? sizeof(OculusSimplePingResult)
+                                                   : sizeof(OculusSimplePingResult2);
+    if(!format.is_valid()
+       || metadataSize + format.nBeams*sizeof(int16_t) > pingData.size())
+    {
+        throw std::runtime_error("oculus::FanRenderer : invalid ping data format");
+    }
+    if(format.version != 2) {
+        return this->render(*reinterpret_cast<const OculusSimplePingResult*>(pingData.data()),
+                            format, pingData, imageData);
+    }
+    else {
+        return this->render(*reinterpret_cast<const OculusSimplePingResult2*>(pingData.data()),
+                            format, pingData, imageData);
+    }
+}
+
+template <class OculusPingResultType>
+std::pair<unsigned int, unsigned int> FanRenderer::render(const OculusPingResultType& metadata,
+                                                          const PingFormat& format,
+                                                          const MessageData& pingData,
+                                                          std::vector<float>& imageData)
+{
+    OCULUS_TRACE_SCOPE("FanRenderer::render");
+
+    Geometry geometry;
+    geometry.nBeams        = metadata.nBeams;
+    geometry.nRanges       = metadata.nRanges;
+    geometry.range         = get_range(metadata);
+    geometry.bearingsHash  = hash_bytes(pingData.data() + sizeof(OculusPingResultType),
+                                        metadata.nBeams*sizeof(int16_t));
+    geometry.width         = width_;
+    geometry.interpolation = interpolation_;
+    if(mapUpdates_ == 0 || !geometry.same_key(geometry_)) {
+        bearings_.resize(metadata.nBeams);
+        get_ping_bearings(bearings_.data(), metadata, pingData);
+        this->update_map(geometry);
+    }
+
+    // The pixels outside of the fan point to the padding, which must hold
+    // all the taps of a pixel.
+    std::size_t pingSize = (std::size_t)metadata.nBeams*metadata.nRanges;
+    pingData_.resize(pingSize + 3*metadata.nBeams + 4);
+    if(pool_) {
+        pool_->parallel_for(0, format.nRanges, [&](std::size_t first, std::size_t last) {
+            ping_rows_to_array(pingData_.data(), format, pingData, first, last);
+        }, std::max<std::size_t>(1, MinTaskPixels / format.nBeams));
+    }
+    else {
+        ping_rows_to_array(pingData_.data(), format, pingData, 0, format.nRanges);
+    }
+    std::fill(pingData_.begin() + pingSize, pingData_.end(), 0.0f);
+
+    imageData.resize(pixelMap_.size());
+    float* dst = imageData.data();
+    this->for_rows([this, dst](unsigned int first, unsigned int last) {
+        this->gather(dst, (std::size_t)geometry_.width*first,
+                          (std::size_t)geometry_.width*last);
+    });
+
+    return std::make_pair(geometry_.width, geometry_.height);
+}
+
+void FanRenderer::gather(float* dst, std::size_t begin, std::size_t end) const
+{
+    const float*    src     = pingData_.data();
+    const uint32_t* map     = pixelMap_.data();
+    const int16_t*  weights = weights_.data();
+    std::size_t     nBeams  = geometry_.nBeams;
+    const float     scale   = 1.0f / (1 << WeightBits);
+
+    switch(geometry_.interpolation) {
+        case Interpolation::Nearest:
+            #ifdef OCULUS_FAN_RENDERER_AVX2
+            if(has_avx2()) {
+                begin = gather_nearest_avx2(src, map, dst, begin, end);
+            }
+            #endif
+            for(std::size_t i = begin; i < end; i++) {
+                dst[i] = src[map[i]];
+            }
+            break;
+        case Interpolation::Bilinear:
+            #ifdef OCULUS_FAN_RENDERER_AVX2
+            if(has_avx2()) {
+                begin = gather_bilinear_avx2(src, nBeams, map, weights, dst, begin, end);
+            }
+            #endif
+            for(std::size_t i = begin; i < end; i++) {
+                const float* p = src + map[i];
+                float wb = scale * weights[2*i];
+                float wr = scale * weights[2*i + 1];
+                float top    = p[0]      + wb*(p[1]          - p[0]);
+                float bottom = p[nBeams] + wb*(p[nBeams + 1] - p[nBeams]);
+                dst[i] = top + wr*(bottom - top);
+            }
+            break;
+        case Interpolation::Lanczos2:
+            #ifdef OCULUS_FAN_RENDERER_AVX2
+            if(has_avx2()) {
+                begin = gather_lanczos_avx2(src, nBeams, map, weights, dst, begin, end);
+            }
+            #endif
+            for(std::size_t i = begin; i < end; i++) {
+                const float* p = src + map[i];
+                float w[8];
+                for(int k = 0; k < 8; k++) {
+                    w[k] = weights[8*i + k];
+                }
+                float value = 0.0f;
+                for(int r = 0; r < 4; r++, p += nBeams) {
+                    value += w[4 + r] * (w[0]*p[0] + w[1]*p[1] + w[2]*p[2] + w[3]*p[3]);
+                }
+                dst[i] = (scale*scale) * value;
+            }
+            break;
+    }
+}
+
+static std::size_t weight_count(Interpolation interpolation)
+{
+    switch(interpolation) {
+        case Interpolation::Bilinear: return 2;
+        case Interpolation::Lanczos2: return 8;
+        default:                      return 0;
+    }
+}
+
+/**
+ * Computes the pixel map from bearings_ (same image geometry as
+ * image_from_ping_data).
+ */
+void FanRenderer::update_map(const Geometry& geometry)
+{
+    OCULUS_TRACE_SCOPE("FanRenderer::update_map");
+
+    unsigned int minSize = geometry.interpolation == Interpolation::Lanczos2 ? 4 : 2;
+    if(geometry.nBeams < minSize || geometry.nRanges < minSize || geometry.width == 0
+       || bearings_.back() <= bearings_.front())
+    {
+        throw std::runtime_error("oculus::FanRenderer : invalid ping geometry");
+    }
+
+    float aperture    = bearings_.back() - bearings_.front();
+    float aspectRatio = 2*std::sin(0.5f*aperture);
+
+    geometry_        = geometry;
+    geometry_.height = geometry.width / aspectRatio;
+
+    std::size_t pixelCount = (std::size_t)geometry_.width*geometry_.height;
+    pixelMap_.resize(pixelCount);
+    weights_.assign(weight_count(geometry_.interpolation)*pixelCount, 0);
+
+    this->for_rows([this](unsigned int first, unsigned int last) {
+        this->update_map_rows(first, last);
+    });
+    mapUpdates_++;
+}
+
+void FanRenderer::update_map_rows(unsigned int firstRow, unsigned int lastRow)
+{
+    unsigned int width   = geometry_.width;
+    unsigned int height  = geometry_.height;
+    float        range   = geometry_.range;
+    int          nBeams  = geometry_.nBeams;
+    int          nRanges = geometry_.nRanges;
+    uint32_t     outside = (uint32_t)nBeams*nRanges;
+    std::size_t  weightCount = weight_count(geometry_.interpolation);
+
+    float imageResolution = range / (height - 1);
+    for(unsigned int h = firstRow; h < lastRow; h++) {
+        float x = imageResolution * (height - 1 - h);
+        for(unsigned int w = 0; w < width; w++) {
+            std::size_t pixel = (std::size_t)width*h + w;
+            float y = imageResolution * (w - 0.5f*width);
+            float r       = std::sqrt(x*x + y*y);
+            float bearing = std::atan2(y, x);
+            if(r > range || bearing < bearings_.front() || bearing > bearings_.back()) {
+                pixelMap_[pixel] = outside;
+                continue;
+            }
+
+            // fractional indexes (the bearings are not evenly spaced)
+            auto it = std::upper_bound(bearings_.begin() + 1, bearings_.end() - 1, bearing);
+            int   b1 = it - bearings_.begin();
+            float bearingPos = b1 - 1 + (bearing - bearings_[b1 - 1])
+                                      / (bearings_[b1] - bearings_[b1 - 1]);
+            float rangePos = (nRanges - 1) * r / range;
+
+            int b0 = 0, r0 = 0;
+            int16_t* weights = weights_.data() + weightCount*pixel;
+            switch(geometry_.interpolation) {
+                case Interpolation::Nearest:
+                    b0 = std::lround(bearingPos);
+                    r0 = std::lround(rangePos);
+                    break;
+                case Interpolation::Bilinear:
+                    b0 = std::min<int>(bearingPos, nBeams  - 2);
+                    r0 = std::min<int>(rangePos,   nRanges - 2);
+                    weights[0] = to_fixed(bearingPos - b0);
+                    weights[1] = to_fixed(rangePos   - r0);
+                    break;
+                case Interpolation::Lanczos2:
+                    b0 = std::max(0, std::min<int>(std::floor(bearingPos) - 1, nBeams  - 4));
+                    r0 = std::max(0, std::min<int>(std::floor(rangePos)   - 1, nRanges - 4));
+                    lanczos_weights(bearingPos, b0, weights);
+                    lanczos_weights(rangePos,   r0, weights + 4);
+                    break;
+            }
+            pixelMap_[pixel] = nBeams*r0 + b0;
+        }
+    }
+}
+
+} //namespace oculus
@@ -0,0 +1,185 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/FileIndex.h>
+#include <oculus_driver/MappedFileReader.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace oculus {
+
+constexpr uint32_t FileIndex::MagicNumber;
+constexpr uint32_t FileIndex::Version;
+
+FileIndex::Ptr FileIndex::build(const std::string& filename)
+{
+    // Random access advice : only the item headers and the ping metadata are
+    // read, read-ahead of the ping data would be wasted.
+    MappedFileReader reader(filename, MappedFileReader::AdviceRandom, 0);
+
+    auto index = std::make_shared<FileIndex>();
+    index->fileSize_ = reader.file_size();
+    index->fileTime_ = reader.file_header().time;
+
+    while(reader.next_item_header().type != 0) {
+        if(reader.next_item_header().type != blueprint::rt_oculusSonar) {
+            reader.jump_item();
+            continue;
+        }
+        Entry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.offset = reader.current_item_position();
+
+        auto msg = reader.read_next_message();
+        entry.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            msg->timestamp().time_since_epoch()).count();
+        entry.messageId      = msg->message_id();
+        entry.messageVersion = msg->message_version();
+        if(msg->is_ping_message()) {
+            auto ping = PingMessage::make_ping_wrapper(msg);
+            entry.pingId     = ping->ping_index();
+            entry.range      = ping->range();
+            entry.nBeams     = ping->bearing_count();
+            entry.nRanges    = ping->range_count();
+            entry.masterMode = ping->master_mode();
+        }
+        index->entries_.push_back(entry);
+    }
+    index->update_lookups();
+    return index;
+}
+
+FileIndex::Ptr FileIndex::load(const std::string& indexFilename)
+{
+    std::ifstream f(indexFilename, std::ifstream::binary);
+    if(!f.is_open()) {
+        return nullptr;
+    }
+    SidecarHeader header;
+    if(!f.read((char*)&header, sizeof(header))
+       || header.magic != MagicNumber || header.version != Version)
+    {
+        return nullptr;
+    }
+
+    auto index = std::make_shared<FileIndex>();
+    index->fileSize_ = header.fileSize;
+    index->fileTime_ = header.fileTime;
+    index->entries_.resize(header.entryCount);
+    if(!f.read((char*)index->entries_.data(), sizeof(Entry)*header.entryCount)) {
+        std::cerr << "oculus::FileIndex : truncated index file '"
+                  << indexFilename << "'" << std::endl;
+        return nullptr;
+    }
+    index->update_lookups();
+    return index;
+}
+
+FileIndex::Ptr FileIndex::load_or_build(const std::string& filename, bool save)
+{
+    std::string indexFilename = sidecar_filename(filename);
+    auto index = load(indexFilename);
+    if(index && index->matches(filename)) {
+        return index;
+    }
+
+    index = build(filename);
+    if(save && !index->save(indexFilename)) {
+        std::cerr << "oculus::FileIndex : could not write index file '"
+                  << indexFilename << "', the index won't be cached." << std::endl;
+    }
+    return index;
+}
+
+bool FileIndex::save(const std::string& indexFilename) const
+{
+    std::ofstream f(indexFilename, std::ofstream::binary);
+    if(!f.is_open()) {
+        return false;
+    }
+    SidecarHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic      = MagicNumber;
+    header.version    = Version;
+    header.fileSize   = fileSize_;
+    header.fileTime   = fileTime_;
+    header.entryCount = entries_.size();
+
+    f.write((const char*)&header, sizeof(header));
+    f.write((const char*)entries_.data(), sizeof(Entry)*entries_.size());
+    return (bool)f;
+}
+
+/**
+ * Checks that the index was built from this file (same size and same creation
+ * date in the file header). A recording still being written won't match.
+ */
+bool FileIndex::matches(const std::string& filename) const
+{
+    std::ifstream f(filename, std::ifstream::binary | std::ifstream::ate);
+    if(!f.is_open()) {
+        return false;
+    }
+    uint64_t size = f.tellg();
+    blueprint::LogHeader header;
+    f.seekg(0);
+    if(!f.read((char*)&header, sizeof(header))) {
+        return false;
+    }
+    return size == fileSize_ && header.time == fileTime_;
+}
+
+void FileIndex::update_lookups()
+{
+    pings_.clear();
+    for(std::size_t i = 0; i < entries_.size(); i++) {
+        if(entries_[i].is_ping()) {
+            pings_.push_back(i);
+        }
+    }
+    // The ping ids are not always increasing over a whole file (sonar
+    // reboot), keeping a sorted copy.
+    byPingId_ = pings_;
+    std::stable_sort(byPingId_.begin(), byPingId_.end(),
+        [&](std::size_t lhs, std::size_t rhs) {
+            return entries_[lhs].pingId < entries_[rhs].pingId;
+        });
+}
+
+std::size_t FileIndex::find_time(const TimePoint& stamp) const
+{
+    int64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        stamp.time_since_epoch()).count();
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), nanos,
+        [](const Entry& entry, int64_t value) { return entry.stamp < value; });
+    return it - entries_.begin();
+}
+
+std::size_t FileIndex::find_ping(uint32_t pingId) const
+{
+    auto it = std::lower_bound(byPingId_.begin(), byPingId_.end(), pingId,
+        [&](std::size_t idx, uint32_t value) { return entries_[idx].pingId < value; });
+    if(it == byPingId_.end() || entries_[*it].pingId != pingId) {
+        return entries_.size();
+    }
+    return *it;
+}
+
+} //namespace oculus
@@ -0,0 +1,222 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/FilePlayer.h>
+
+namespace oculus {
+
+FilePlayer::FilePlayer(SonarDriver& driver, const std::string& filename) :
+    guard_(std::make_shared<Guard>()),
+    driver_(driver),
+    ioService_(driver.io_service()),
+    timer_(*ioService_),
+    reader_(filename),
+    index_(FileIndex::load_or_build(filename)),
+    playing_(false),
+    speed_(1.0),
+    loop_(false),
+    generation_(0),
+    isPlaying_(false),
+    finished_(false),
+    playedCount_(0)
+{
+    // The reader is given the index before any work is posted so that it
+    // never builds it lazily while another thread looks into it.
+    reader_.set_index(index_);
+}
+
+/**
+ * Waits for a running handler to return. The handlers still queued in the
+ * io_service (or posted by the timer cancellation) will not touch the player.
+ */
+FilePlayer::~FilePlayer()
+{
+    std::lock_guard<std::recursive_mutex> lock(guard_->mutex);
+    guard_->alive = false;
+    timer_.cancel();
+}
+
+void FilePlayer::play()
+{
+    ioService_->post(this->guarded([this]() {
+        if(playing_) return;
+        playing_   = true;
+        isPlaying_ = true;
+        finished_  = false;
+        this->reset_anchor();
+        this->schedule_next();
+    }));
+}
+
+void FilePlayer::pause()
+{
+    ioService_->post(this->guarded([this]() {
+        playing_   = false;
+        isPlaying_ = false;
+        generation_++;
+        timer_.cancel();
+    }));
+}
+
+void FilePlayer::set_speed(double speed)
+{
+    ioService_->post(this->guarded([this, speed]() {
+        speed_ = speed > 0.0 ? speed : 0.0;
+        if(playing_) {
+            // Rescheduling the pending message with the new speed.
+            generation_++;
+            timer_.cancel();
+            this->reset_anchor();
+            this->schedule_next();
+        }
+    }));
+}
+
+void FilePlayer::set_loop(bool loop)
+{
+    ioService_->post(this->guarded([this, loop]() { loop_ = loop; }));
+}
+
+void FilePlayer::set_end_callback(const EndCallback& callback)
+{
+    ioService_->post(this->guarded([this, callback]() { endCallback_ = callback; }));
+}
+
+/**
+ * The target is checked against the (immutable) index in the calling thread
+ * but the seek itself is resolved in the io_service, which owns reader_.
+ */
+bool FilePlayer::seek_to_message(std::size_t messageIndex)
+{
+    if(messageIndex >= index_->message_count()) {
+        return false;
+    }
+    ioService_->post(this->guarded([this, messageIndex]() {
+        this->do_seek([this, messageIndex]() { return reader_.seek_to_message(messageIndex); });
+    }));
+    return true;
+}
+
+bool FilePlayer::seek_to_time(const TimePoint& stamp)
+{
+    if(index_->find_time(stamp) >= index_->message_count()) {
+        return false;
+    }
+    ioService_->post(this->guarded([this, stamp]() {
+        this->do_seek([this, stamp]() { return reader_.seek_to_time(stamp); });
+    }));
+    return true;
+}
+
+bool FilePlayer::seek_to_ping(uint32_t pingId)
+{
+    if(index_->find_ping(pingId) >= index_->message_count()) {
+        return false;
+    }
+    ioService_->post(this->guarded([this, pingId]() {
+        this->do_seek([this, pingId]() { return reader_.seek_to_ping(pingId); });
+    }));
+    return true;
+}
+
+void FilePlayer::do_seek(const std::function<bool()>& seek)
+{
+    if(!seek()) {
+        return;
+    }
+    generation_++;
+    timer_.cancel();
+    next_     = nullptr;
+    finished_ = false;
+    if(playing_) {
+        this->reset_anchor();
+        this->schedule_next();
+    }
+}
+
+/**
+ * The next message is played now, the following ones are paced relative to
+ * it.
+ */
+void FilePlayer::reset_anchor()
+{
+    if(!next_) {
+        next_ = reader_.read_next_message();
+    }
+    anchorTime_ = Clock::now();
+    if(next_) {
+        anchorStamp_ = next_->timestamp();
+    }
+}
+
+void FilePlayer::schedule_next()
+{
+    if(!playing_) {
+        return;
+    }
+    if(!next_) {
+        next_ = reader_.read_next_message();
+    }
+    if(!next_ && loop_) {
+        reader_.rewind();
+        next_ = reader_.read_next_message();
+        this->reset_anchor();
+    }
+    if(!next_) {
+        playing_   = false;
+        isPlaying_ = false;
+        finished_  = true;
+        if(endCallback_) {
+            endCallback_();
+        }
+        return;
+    }
+
+    uint64_t generation = generation_;
+    if(speed_ <= 0.0) {
+        // As fast as possible, still going through the io_service so the
+        // other handlers (control, network) are not starved.
+        ioService_->post(this->guarded([this, generation]() {
+            this->send_next(generation, boost::system::error_code());
+        }));
+        return;
+    }
+
+    auto offset = std::chrono::duration<double>(next_->timestamp() - anchorStamp_);
+    if(offset.count() < 0.0) {
+        offset = offset.zero(); // timestamps going backward, sending right away
+    }
+    timer_.expires_at(anchorTime_ + std::chrono::duration_cast<Clock::duration>(offset / speed_));
+    timer_.async_wait(this->guarded([this, generation](const boost::system::error_code& err) {
+        this->send_next(generation, err);
+    }));
+}
+
+void FilePlayer::send_next(uint64_t generation, const boost::system::error_code& err)
+{
+    if(err || generation != generation_ || !playing_ || !next_) {
+        return; // cancelled (pause, seek...)
+    }
+    auto message = next_;
+    next_ = nullptr;
+    driver_.handle_message(message);
+    playedCount_++;
+    this->schedule_next();
+}
+
+} //namespace oculus
@@ -0,0 +1,274 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/GainKernels.h>
+
+#include <atomic>
+#include <initializer_list>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define OCULUS_SIMD_X86
+    #include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    #define OCULUS_SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace oculus {
+
+template <typename T>
+static void scale_scalar(const T* src, float* dst, std::size_t count, float gain)
+{
+    for(std::size_t i = 0; i < count; i++) {
+        dst[i] = gain * src[i];
+    }
+}
+
+#ifdef OCULUS_SIMD_X86
+
+__attribute__((target("sse4.1")))
+static void scale_u8_sse41(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_ps(dst + i,      _mm_mul_ps(g, _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v))));
+        _mm_storeu_ps(dst + i + 4,  _mm_mul_ps(g, _mm_cvtepi32_ps(
+                                    _mm_cvtepu8_epi32(_mm_srli_si128(v, 4)))));
+        _mm_storeu_ps(dst + i + 8,  _mm_mul_ps(g, _mm_cvtepi32_ps(
+                                    _mm_cvtepu8_epi32(_mm_srli_si128(v, 8)))));
+        _mm_storeu_ps(dst + i + 12, _mm_mul_ps(g, _mm_cvtepi32_ps(
+                                    _mm_cvtepu8_epi32(_mm_srli_si128(v, 12)))));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+__attribute__((target("sse4.1")))
+static void scale_u16_sse41(const uint16_t* src, float* dst, std::size_t count, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_ps(dst + i,     _mm_mul_ps(g, _mm_cvtepi32_ps(_mm_cvtepu16_epi32(v))));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(g, _mm_cvtepi32_ps(
+                                   _mm_cvtepu16_epi32(_mm_srli_si128(v, 8)))));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void scale_u8_avx2(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm256_storeu_ps(dst + i,     _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+                                      _mm256_cvtepu8_epi32(v))));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+                                      _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)))));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+__attribute__((target("avx2")))
+static void scale_u16_avx2(const uint16_t* src, float* dst, std::size_t count, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_ps(dst + i,     _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+                                      _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)))));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(g, _mm256_cvtepi32_ps(
+                                      _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)))));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+__attribute__((target("avx512f")))
+static void scale_u8_avx512(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    // The maskz_ conversions do not read an uninitialized pass-through
+    // register (-Wmaybe-uninitialized with the unmasked ones).
+    const __mmask16 all = 0xffff;
+    const __m512    g   = _mm512_set1_ps(gain);
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(g, _mm512_maskz_cvtepi32_ps(all,
+                                  _mm512_maskz_cvtepu8_epi32(all, v))));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+__attribute__((target("avx512f")))
+static void scale_u16_avx512(const uint16_t* src, float* dst, std::size_t count, float gain)
+{
+    const __mmask16 all = 0xffff;
+    const __m512    g   = _mm512_set1_ps(gain);
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(g, _mm512_maskz_cvtepi32_ps(all,
+                                  _mm512_maskz_cvtepu16_epi32(all, v))));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+#endif //OCULUS_SIMD_X86
+
+#ifdef OCULUS_SIMD_NEON
+
+static void scale_u8_neon(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    std::size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        uint8x16_t v  = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        vst1q_f32(dst + i,      vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))),  gain));
+        vst1q_f32(dst + i + 4,  vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), gain));
+        vst1q_f32(dst + i + 8,  vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))),  gain));
+        vst1q_f32(dst + i + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), gain));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+static void scale_u16_neon(const uint16_t* src, float* dst, std::size_t count, float gain)
+{
+    std::size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        vst1q_f32(dst + i,     vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))),  gain));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), gain));
+    }
+    scale_scalar(src + i, dst + i, count - i, gain);
+}
+
+#endif //OCULUS_SIMD_NEON
+
+struct GainKernels
+{
+    SimdLevel level;
+    void (*u8) (const uint8_t*,  float*, std::size_t, float);
+    void (*u16)(const uint16_t*, float*, std::size_t, float);
+};
+
+static const GainKernels scalarKernels = {SimdLevel::Scalar,
+    scale_scalar<uint8_t>, scale_scalar<uint16_t>};
+#ifdef OCULUS_SIMD_X86
+static const GainKernels sse41Kernels  = {SimdLevel::SSE41,  scale_u8_sse41,  scale_u16_sse41};
+static const GainKernels avx2Kernels   = {SimdLevel::AVX2,   scale_u8_avx2,   scale_u16_avx2};
+static const GainKernels avx512Kernels = {SimdLevel::AVX512, scale_u8_avx512, scale_u16_avx512};
+#endif
+#ifdef OCULUS_SIMD_NEON
+static const GainKernels neonKernels   = {SimdLevel::NEON,   scale_u8_neon,   scale_u16_neon};
+#endif
+
+static const GainKernels* kernels_for(SimdLevel level)
+{
+    switch(level) {
+        case SimdLevel::Scalar: return &scalarKernels;
+        #ifdef OCULUS_SIMD_X86
+        case SimdLevel::SSE41:  return &sse41Kernels;
+        case SimdLevel::AVX2:   return &avx2Kernels;
+        case SimdLevel::AVX512: return &avx512Kernels;
+        #endif
+        #ifdef OCULUS_SIMD_NEON
+        case SimdLevel::NEON:   return &neonKernels;
+        #endif
+        default:                return nullptr;
+    }
+}
+
+static std::atomic<const GainKernels*>& current_kernels()
+{
+    static std::atomic<const GainKernels*> kernels(kernels_for(best_simd_level()));
+    return kernels;
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    switch(level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE41:  return "sse4.1";
+        case SimdLevel::AVX2:   return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::NEON:   return "neon";
+        default:                return "unknown";
+    }
+}
+
+bool simd_level_supported(SimdLevel level)
+{
+    #ifdef OCULUS_SIMD_X86
+    __builtin_cpu_init();
+    #endif
+    switch(level) {
+        case SimdLevel::Scalar: return true;
+        #ifdef OCULUS_SIMD_X86
+        case SimdLevel::SSE41:  return __builtin_cpu_supports("sse4.1");
+        case SimdLevel::AVX2:   return __builtin_cpu_supports("avx2");
+        case SimdLevel::AVX512: return __builtin_cpu_supports("avx512f");
+        #endif
+        #ifdef OCULUS_SIMD_NEON
+        case SimdLevel::NEON:   return true;
+        #endif
+        default:                return false;
+    }
+}
+
+SimdLevel best_simd_level()
+{
+    for(auto level : {SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE41, SimdLevel::NEON}) {
+        if(simd_level_supported(level)) {
+            return level;
+        }
+    }
+    return SimdLevel::Scalar;
+}
+
+SimdLevel simd_level()
+{
+    return current_kernels().load(std::memory_order_relaxed)->level;
+}
+
+bool set_simd_level(SimdLevel level)
+{
+    if(!simd_level_supported(level)) {
+        return false;
+    }
+    current_kernels().store(kernels_for(level), std::memory_order_relaxed);
+    return true;
+}
+
+void scale_to_float(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    current_kernels().load(std::memory_order_relaxed)->u8(src, dst, count, gain);
+}
+
+void scale_to_float(const uint16_t* src, float* dst, std::size_t count, float gain)
+{
+    current_kernels().load(std::memory_order_relaxed)->u16(src, dst, count, gain);
+}
+
+} //namespace oculus
@@ -0,0 +1,165 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/HeaderScanner.h>
+#include <oculus_driver/Oculus.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OCULUS_DRIVER_X86
+#endif
+
+namespace oculus {
+
+namespace detail {
+
+// Bytes to be matched, in stream order (the protocol is little endian).
+struct HeaderPattern
+{
+    uint8_t     bytes[4];
+    std::size_t length;
+
+    HeaderPattern(int srcDeviceId) :
+        bytes{OCULUS_CHECK_ID & 0xff, OCULUS_CHECK_ID >> 8,
+              (uint8_t)(srcDeviceId & 0xff), (uint8_t)((srcDeviceId >> 8) & 0xff)},
+        length(srcDeviceId < 0 ? 2 : 4)
+    {}
+
+    bool match(const uint8_t* data) const {
+        for(std::size_t k = 0; k < length; k++) {
+            if(data[k] != bytes[k]) return false;
+        }
+        return true;
+    }
+};
+
+inline std::size_t scan_tail(const HeaderPattern& pattern, const uint8_t* data,
+                             std::size_t size, std::size_t start)
+{
+    if(size < pattern.length) {
+        return 0;
+    }
+    std::size_t i = start;
+    for(; i + pattern.length <= size; i++) {
+        if(pattern.match(data + i)) return i;
+    }
+    return i;
+}
+
+std::size_t find_header_candidate_scalar(const uint8_t* data, std::size_t size,
+                                         int srcDeviceId)
+{
+    return scan_tail(HeaderPattern(srcDeviceId), data, size, 0);
+}
+
+#ifdef OCULUS_DRIVER_X86
+
+std::size_t find_header_candidate_sse2(const uint8_t* data, std::size_t size,
+                                       int srcDeviceId)
+{
+    HeaderPattern pattern(srcDeviceId);
+
+    // Comparing 16 consecutive positions at once. Each byte of the pattern is
+    // compared with the buffer shifted by the byte position in the pattern.
+    std::size_t i = 0;
+    for(; i + 16 + 3 <= size; i += 16) {
+        __m128i match = _mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i*)(data + i)), _mm_set1_epi8(pattern.bytes[0]));
+        for(std::size_t k = 1; k < pattern.length; k++) {
+            match = _mm_and_si128(match, _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i*)(data + i + k)),
+                _mm_set1_epi8(pattern.bytes[k])));
+        }
+        int mask = _mm_movemask_epi8(match);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return scan_tail(pattern, data, size, i);
+}
+
+__attribute__((target("avx2")))
+std::size_t find_header_candidate_avx2(const uint8_t* data, std::size_t size,
+                                       int srcDeviceId)
+{
+    HeaderPattern pattern(srcDeviceId);
+
+    std::size_t i = 0;
+    for(; i + 32 + 3 <= size; i += 32) {
+        __m256i match = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i*)(data + i)), _mm256_set1_epi8(pattern.bytes[0]));
+        for(std::size_t k = 1; k < pattern.length; k++) {
+            match = _mm256_and_si256(match, _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i*)(data + i + k)),
+                _mm256_set1_epi8(pattern.bytes[k])));
+        }
+        uint32_t mask = _mm256_movemask_epi8(match);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return scan_tail(pattern, data, size, i);
+}
+
+#endif //OCULUS_DRIVER_X86
+
+} //namespace detail
+
+using ScannerFunction = std::size_t(*)(const uint8_t*, std::size_t, int);
+
+struct ScannerSelection
+{
+    ScannerFunction function;
+    const char*     name;
+
+    ScannerSelection() :
+        function(&detail::find_header_candidate_scalar),
+        name("scalar")
+    {
+        #ifdef OCULUS_DRIVER_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            function = &detail::find_header_candidate_avx2;
+            name     = "avx2";
+        }
+        else if(__builtin_cpu_supports("sse2")) {
+            function = &detail::find_header_candidate_sse2;
+            name     = "sse2";
+        }
+        #endif
+    }
+};
+
+static const ScannerSelection& scanner_selection()
+{
+    static const ScannerSelection selection;
+    return selection;
+}
+
+std::size_t find_header_candidate(const uint8_t* data, std::size_t size,
+                                  int srcDeviceId)
+{
+    return scanner_selection().function(data, size, srcDeviceId);
+}
+
+const char* header_scanner_implementation()
+{
+    return scanner_selection().name;
+}
+
+} //namespace oculus
@@ -0,0 +1,303 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/MappedFileReader.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <sstream>
+
+namespace oculus {
+
+constexpr uint32_t MappedFileReader::FileMagicNumber;
+constexpr uint32_t MappedFileReader::ItemMagicNumber;
+
+MappedFileReader::Mapping::~Mapping()
+{
+    if(data) {
+        ::munmap(const_cast<uint8_t*>(data), size);
+    }
+}
+
+MappedFileReader::MappedFileReader(const std::string& filename,
+                                   Advice advice,
+                                   std::size_t prefetchSize) :
+    itemPosition_(0),
+    prefetchSize_(prefetchSize),
+    prefetchedEnd_(0)
+{
+    std::memset(&fileHeader_, 0, sizeof(fileHeader_));
+    std::memset(&nextItem_,   0, sizeof(nextItem_));
+    this->open(filename, advice);
+}
+
+void MappedFileReader::open(const std::string& filename, Advice advice)
+{
+    filename_ = filename;
+    mapping_  = nullptr;
+    index_    = nullptr;
+
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        std::ostringstream oss;
+        oss << "Could not open file for reading : " << filename
+            << " (" << std::strerror(errno) << ")";
+        throw std::runtime_error(oss.str());
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) < 0 || (std::size_t)st.st_size < sizeof(fileHeader_)) {
+        ::close(fd);
+        std::ostringstream oss;
+        oss << "oculus::MappedFileReader : error reading file header.\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if(data == MAP_FAILED) {
+        std::ostringstream oss;
+        oss << "oculus::MappedFileReader : could not map file ("
+            << std::strerror(errno) << ").\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+    mapping_ = std::make_shared<const Mapping>((const uint8_t*)data, st.st_size);
+    this->advise(advice);
+
+    std::memcpy(&fileHeader_, mapping_->data, sizeof(fileHeader_));
+    if(fileHeader_.fileHeader != FileMagicNumber) {
+        mapping_ = nullptr;
+        std::ostringstream oss;
+        oss << "oculus::MappedFileReader : invalid file header, is it a .oculus file ?.\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+    if(fileHeader_.version != 1) {
+        std::cerr << "oculus::FileHeader version is != 1. Reading may fail" << std::endl;
+    }
+    if(fileHeader_.encryption != 0) {
+        mapping_ = nullptr;
+        std::ostringstream oss;
+        oss << "oculus::MappedFileReader : file is encrypted. Cannot decode.\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+
+    this->rewind();
+}
+
+void MappedFileReader::rewind()
+{
+    prefetchedEnd_ = 0;
+    this->read_next_header(sizeof(fileHeader_));
+}
+
+void MappedFileReader::advise(Advice advice)
+{
+    if(!mapping_) {
+        return;
+    }
+    int hint = MADV_NORMAL;
+    switch(advice) {
+        case AdviceSequential: hint = MADV_SEQUENTIAL; break;
+        case AdviceRandom:     hint = MADV_RANDOM;     break;
+        default: break;
+    }
+    // Only a hint, failing is not an error.
+    ::madvise(const_cast<uint8_t*>(mapping_->data), mapping_->size, hint);
+}
+
+/**
+ * Asks the kernel to start reading the pages ahead of the current position
+ * (asynchronously), half a window before they are needed.
+ */
+void MappedFileReader::prefetch()
+{
+    if(prefetchSize_ == 0 || itemPosition_ + prefetchSize_ / 2 < prefetchedEnd_) {
+        return;
+    }
+    static const std::size_t pageSize = ::sysconf(_SC_PAGESIZE);
+
+    std::size_t begin = std::max(itemPosition_, prefetchedEnd_) & ~(pageSize - 1);
+    std::size_t end   = std::min(begin + prefetchSize_, mapping_->size);
+    if(begin < end) {
+        ::madvise(const_cast<uint8_t*>(mapping_->data) + begin, end - begin, MADV_WILLNEED);
+    }
+    prefetchedEnd_ = end;
+}
+
+void MappedFileReader::read_next_header(std::size_t position)
+{
+    if(!mapping_ || position + sizeof(nextItem_) > mapping_->size) {
+        // End of file (or truncated item header).
+        std::memset(&nextItem_, 0, sizeof(nextItem_));
+        itemPosition_ = 0;
+        return;
+    }
+    itemPosition_ = position;
+    std::memcpy(&nextItem_, mapping_->data + position, sizeof(nextItem_));
+    this->prefetch();
+}
+
+void MappedFileReader::check_next_payload() const
+{
+    if(itemPosition_ + sizeof(nextItem_) + nextItem_.payloadSize > mapping_->size) {
+        std::ostringstream oss;
+        oss << "oculus::MappedFileReader : error reading item data. File might be corrupted.\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+const uint8_t* MappedFileReader::next_item_data() const
+{
+    if(nextItem_.type == 0) {
+        return nullptr;
+    }
+    this->check_next_payload();
+    return mapping_->data + itemPosition_ + sizeof(nextItem_);
+}
+
+std::size_t MappedFileReader::jump_item()
+{
+    if(nextItem_.type == 0) {
+        return 0;
+    }
+    this->check_next_payload();
+
+    std::size_t currentItemPosition = itemPosition_;
+    this->read_next_header(itemPosition_ + sizeof(nextItem_) + nextItem_.payloadSize);
+    return currentItemPosition;
+}
+
+void MappedFileReader::seek_item(std::size_t position)
+{
+    prefetchedEnd_ = 0;
+    this->read_next_header(position);
+}
+
+Message::ConstPtr MappedFileReader::read_next_message()
+{
+    // Reading file until we find a rt_oculusSonar message or enf of file
+    while(nextItem_.type != blueprint::rt_oculusSonar && this->jump_item());
+    if(nextItem_.type == 0) {
+        return nullptr;
+    }
+
+    const uint8_t* data = this->next_item_data();
+    if(nextItem_.compression == 0 && nextItem_.payloadSize < sizeof(OculusMessageHeader)) {
+        std::ostringstream oss;
+        oss << "oculus::MappedFileReader : invalid message size. File might be corrupted.\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+    auto message = Message::Create();
+    if(nextItem_.compression == 0
+       && reinterpret_cast<uintptr_t>(data) % MessageData::Alignment == 0)
+    {
+        message->set_external_data(data, nextItem_.payloadSize, mapping_);
+    }
+    else if(nextItem_.compression == 0) {
+        // The helpers read the samples in place, an unaligned item is copied
+        // (see MessageData).
+        message->data_.assign(data, data + nextItem_.payloadSize);
+        message->update_from_data();
+    }
+    else {
+        // compressed items cannot be used in place
+        message->data_.resize(nextItem_.originalSize);
+        if(nextItem_.originalSize < sizeof(OculusMessageHeader)
+           || !decompress((Codec)nextItem_.compression, data, nextItem_.payloadSize,
+                          message->data_.data(), message->data_.size()))
+        {
+            std::ostringstream oss;
+            oss << "oculus::MappedFileReader : could not decompress item (compression "
+                << nextItem_.compression << ", "
+                << codec_name((Codec)nextItem_.compression) << ").\n";
+            oss << "    file : '" << filename_ << "'";
+            throw std::runtime_error(oss.str());
+        }
+        message->update_from_data();
+    }
+
+    double itemDate = nextItem_.time;
+    this->jump_item();
+
+    // Reading TimeStamp from next message if it is there. Falling back to the
+    // LogItem date if it is not there.
+    if(nextItem_.type == blueprint::rt_oculusSonarStamp) {
+        TimeStamp stamp;
+        std::memcpy(&stamp, this->next_item_data(), sizeof(stamp));
+        message->timestamp_ = stamp.to_sonar_stamp();
+        this->jump_item();
+    }
+    else {
+        uint64_t nanos = 1000000000*itemDate;
+        message->timestamp_ = Message::TimePoint(std::chrono::nanoseconds(nanos));
+    }
+
+    return message;
+}
+
+const FileIndex& MappedFileReader::index()
+{
+    if(!index_) {
+        index_ = FileIndex::load_or_build(filename_);
+    }
+    return *index_;
+}
+
+bool MappedFileReader::seek_to_message(std::size_t messageIndex)
+{
+    if(messageIndex >= this->index().message_count()) {
+        return false;
+    }
+    this->seek_item(this->index()[messageIndex].offset);
+    return true;
+}
+
+bool MappedFileReader::seek_to_time(const Message::TimePoint& stamp)
+{
+    return this->seek_to_message(this->index().find_time(stamp));
+}
+
+bool MappedFileReader::seek_to_ping(uint32_t pingId)
+{
+    return this->seek_to_message(this->index().find_ping(pingId));
+}
+
+PingMessage::ConstPtr MappedFileReader::read_next_ping()
+{
+    Message::ConstPtr msg = this->read_next_message();
+    while(msg && !msg->is_ping_message()) {
+        msg = this->read_next_message();
+    }
+    if(!msg)
+        return nullptr;
+    return PingMessage::Create(msg);
+}
+
+} //namespace oculus
@@ -0,0 +1,86 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/MessagePool.h>
+
+#include <atomic>
+
+namespace oculus {
+
+MessagePool::MessagePool(std::size_t capacity, std::size_t reservedSize) :
+    next_(0),
+    reservedSize_(reservedSize),
+    missCount_(0)
+{
+    if(capacity == 0) {
+        throw std::runtime_error("oculus::MessagePool : capacity must be > 0");
+    }
+    messages_.reserve(capacity);
+    for(std::size_t i = 0; i < capacity; i++) {
+        auto msg = Message::Create();
+        msg->data_.reserve(reservedSize_);
+        messages_.push_back(msg);
+    }
+}
+
+/**
+ * Returns a Message which is not referenced anywhere else.
+ *
+ * The messages are checked in a round-robin fashion starting after the last
+ * acquired one, so a released message is reused as late as possible.
+ */
+Message::Ptr MessagePool::acquire()
+{
+    for(std::size_t i = 0; i < messages_.size(); i++) {
+        auto& msg = messages_[(next_ + i) % messages_.size()];
+        if(msg.use_count() == 1) {
+            // use_count() is a relaxed load. This fence synchronizes with the
+            // release of the last user reference so any access made by a user
+            // on another thread happens before we overwrite the message.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next_ = (next_ + i + 1) % messages_.size();
+            return msg;
+        }
+    }
+
+    // Pool exhausted. Falling back to a regular allocation.
+    missCount_++;
+    auto msg = Message::Create();
+    msg->data_.reserve(reservedSize_);
+    return msg;
+}
+
+void MessagePool::grow(std::size_t capacity)
+{
+    while(messages_.size() < capacity) {
+        auto msg = Message::Create();
+        msg->data_.reserve(reservedSize_);
+        messages_.push_back(msg);
+    }
+}
+
+std::size_t MessagePool::available() const
+{
+    std::size_t count = 0;
+    for(const auto& msg : messages_) {
+        if(msg.use_count() == 1) count++;
+    }
+    return count;
+}
+
+} //namespace oculus
@@ -0,0 +1,193 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/Metrics.h>
+
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+namespace oculus {
+
+constexpr unsigned int LatencyHistogram::SubBucketBits;
+constexpr unsigned int LatencyHistogram::SubBucketCount;
+constexpr unsigned int LatencyHistogram::MaxExponent;
+constexpr unsigned int LatencyHistogram::BucketCount;
+
+unsigned int LatencyHistogram::bucket_index(uint64_t value)
+{
+    if(value < SubBucketCount) {
+        return value;
+    }
+    unsigned int exponent = 63 - __builtin_clzll(value);
+    if(exponent >= MaxExponent) {
+        return BucketCount - 1;
+    }
+    unsigned int sub = (value >> (exponent - SubBucketBits)) & (SubBucketCount - 1);
+    return ((exponent - SubBucketBits + 1) << SubBucketBits) + sub;
+}
+
+/**
+ * Middle of the bucket.
+ */
+uint64_t LatencyHistogram::bucket_value(unsigned int index)
+{
+    if(index < SubBucketCount) {
+        return index;
+    }
+    unsigned int exponent = (index >> SubBucketBits) + SubBucketBits - 1;
+    unsigned int sub      = index & (SubBucketCount - 1);
+    uint64_t     width    = 1ull << (exponent - SubBucketBits);
+    return ((uint64_t)(SubBucketCount + sub) << (exponent - SubBucketBits)) + width / 2;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = min_.load(std::memory_order_relaxed);
+    while(value < current
+          && !min_.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    current = max_.load(std::memory_order_relaxed);
+    while(value > current
+          && !max_.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+void LatencyHistogram::reset()
+{
+    for(auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    min_.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    // Copying the buckets first to get consistent percentiles if values are
+    // recorded concurrently.
+    std::array<uint64_t, BucketCount> buckets;
+    uint64_t count = 0;
+    for(unsigned int i = 0; i < BucketCount; i++) {
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+
+    HistogramSnapshot res = {0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    res.count = count;
+    if(count == 0) {
+        return res;
+    }
+    res.min  = 1.0e-3 * min_.load(std::memory_order_relaxed);
+    res.max  = 1.0e-3 * max_.load(std::memory_order_relaxed);
+    res.mean = 1.0e-3 * sum_.load(std::memory_order_relaxed)
+                      / std::max<uint64_t>(count_.load(std::memory_order_relaxed), 1);
+
+    auto percentile = [&](double p) {
+        uint64_t target = (uint64_t)(p * count);
+        uint64_t seen   = 0;
+        for(unsigned int i = 0; i < BucketCount; i++) {
+            seen += buckets[i];
+            if(seen > target) {
+                // bucket middle, may be outside of the recorded values
+                return std::min(res.max, std::max(res.min, 1.0e-3 * bucket_value(i)));
+            }
+        }
+        return res.max;
+    };
+    res.p50  = percentile(0.5);
+    res.p90  = percentile(0.9);
+    res.p99  = percentile(0.99);
+    res.p999 = percentile(0.999);
+    return res;
+}
+
+void DriverMetrics::reset()
+{
+    frameAssembly.reset();
+    dispatch.reset();
+    messageCallbacks.reset();
+    pingCallbacks.reset();
+    dummyCallbacks.reset();
+    configCallbacks.reset();
+    pingInterval.reset();
+
+    bytesReceived    = 0;
+    messagesReceived = 0;
+    resyncCount      = 0;
+    skippedBytes     = 0;
+    reconnectCount   = 0;
+    configRetryCount = 0;
+}
+
+MetricsSnapshot DriverMetrics::snapshot() const
+{
+    MetricsSnapshot res;
+
+    res.frameAssembly    = frameAssembly.snapshot();
+    res.dispatch         = dispatch.snapshot();
+    res.messageCallbacks = messageCallbacks.snapshot();
+    res.pingCallbacks    = pingCallbacks.snapshot();
+    res.dummyCallbacks   = dummyCallbacks.snapshot();
+    res.configCallbacks  = configCallbacks.snapshot();
+    res.pingInterval     = pingInterval.snapshot();
+
+    res.bytesReceived    = bytesReceived;
+    res.messagesReceived = messagesReceived;
+    res.resyncCount      = resyncCount;
+    res.skippedBytes     = skippedBytes;
+    res.reconnectCount   = reconnectCount;
+    res.configRetryCount = configRetryCount;
+
+    return res;
+}
+
+std::ostream& operator<<(std::ostream& os, const HistogramSnapshot& hist)
+{
+    os << "count : " << hist.count
+       << ", mean : " << hist.mean
+       << "us, p50 : " << hist.p50
+       << "us, p99 : " << hist.p99
+       << "us, p999 : " << hist.p999
+       << "us, max : " << hist.max << "us";
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const MetricsSnapshot& metrics)
+{
+    os << "- frame assembly    : " << metrics.frameAssembly
+       << "\n- dispatch          : " << metrics.dispatch
+       << "\n- message callbacks : " << metrics.messageCallbacks
+       << "\n- ping callbacks    : " << metrics.pingCallbacks
+       << "\n- dummy callbacks   : " << metrics.dummyCallbacks
+       << "\n- config callbacks  : " << metrics.configCallbacks
+       << "\n- ping interval     : " << metrics.pingInterval
+       << "\n- bytes received    : " << metrics.bytesReceived
+       << "\n- messages received : " << metrics.messagesReceived
+       << "\n- resync count      : " << metrics.resyncCount
+       << "\n- skipped bytes     : " << metrics.skippedBytes
+       << "\n- reconnect count   : " << metrics.reconnectCount
+       << "\n- config retries    : " << metrics.configRetryCount;
+    return os;
+}
+
+} //namespace oculus
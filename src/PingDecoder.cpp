@@ -0,0 +1,216 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/PingDecoder.h>
+#include <oculus_driver/GainKernels.h>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+namespace oculus {
+
+static uint8_t sample_size(uint8_t dataSize)
+{
+    switch(dataSize) {
+        case dataSize8Bit:  return 1;
+        case dataSize16Bit: return 2;
+        case dataSize24Bit: return 3;
+        case dataSize32Bit: return 4;
+        default:            return 0;
+    }
+}
+
+// Sample size of rows of rowSize bytes, 0 if they do not fit the beam count.
+static uint8_t deduce_sample_size(std::size_t rowSize, std::size_t gainSize,
+                                  std::size_t nBeams)
+{
+    if(rowSize <= gainSize || (rowSize - gainSize) % nBeams != 0
+       || (rowSize - gainSize) / nBeams > 4)
+    {
+        return 0;
+    }
+    return (rowSize - gainSize) / nBeams;
+}
+
+template <class OculusPingResultType>
+static PingFormat resolve_format(const OculusPingResultType& metadata,
+                                 uint8_t version, std::size_t dataSize)
+{
+    PingFormat format;
+    format.version     = version;
+    format.hasGains    = metadata.fireMessage.flags & 0x4;
+    format.nBeams      = metadata.nBeams;
+    format.nRanges     = metadata.nRanges;
+    format.imageOffset = metadata.imageOffset;
+    format.sampleSize  = sample_size(metadata.dataSize);
+    format.rowSize     = 0;
+    if(format.nBeams == 0 || format.nRanges == 0) {
+        format.sampleSize = 0;
+        return format;
+    }
+
+    std::size_t imageSize = metadata.imageSize;
+    std::size_t rowSize   = imageSize / format.nRanges;
+    bool        exactRows = rowSize*format.nRanges == imageSize;
+    if(version == 2) {
+        // The gain flag of the V2 messages is not reliable. The gains are
+        // present if the image is larger than the samples alone (same as
+        // PingWrapper2::has_gains).
+        if(format.sampleSize != 0) {
+            format.hasGains = imageSize >
+                (std::size_t)format.sampleSize*format.nBeams*format.nRanges;
+        }
+        else if(exactRows) {
+            // Invalid value in metadata.dataSize. Deducing both from the
+            // image size, without gains first.
+            format.hasGains   = false;
+            format.sampleSize = deduce_sample_size(rowSize, 0, format.nBeams);
+            if(format.sampleSize == 0) {
+                format.hasGains   = true;
+                format.sampleSize = deduce_sample_size(rowSize, 4, format.nBeams);
+            }
+        }
+    }
+    else if(format.sampleSize == 0 && exactRows) {
+        // invalid value in metadata.dataSize. Deducing from image size.
+        format.sampleSize = deduce_sample_size(rowSize, format.hasGains ? 4 : 0,
+                                               format.nBeams);
+    }
+    format.rowSize = (format.hasGains ? 4 : 0) + format.sampleSize*format.nBeams;
+
+    if(format.imageOffset + (std::size_t)format.rowSize*format.nRanges > dataSize) {
+        format.sampleSize = 0;
+    }
+    return format;
+}
+
+PingFormat PingFormat::resolve(const MessageData& pingData)
+{
+    if(pingData.size() < sizeof(OculusMessageHeader)) {
+        throw std::runtime_error("Not a ping result");
+    }
+    auto header = *reinterpret_cast<const OculusMessageHeader*>(pingData.data());
+    if(header.msgId != messageSimplePingResult) {
+        throw std::runtime_error("Not a ping result");
+    }
+    if(header.msgVersion != 2) {
+        if(pingData.size() < sizeof(OculusSimplePingResult)) {
+            throw std::runtime_error("Not a ping result");
+        }
+        return resolve_format(*reinterpret_cast<const OculusSimplePingResult*>(pingData.data()),
+                              1, pingData.size());
+    }
+    else {
+        if(pingData.size() < sizeof(OculusSimplePingResult2)) {
+            throw std::runtime_error("Not a ping result");
+        }
+        return resolve_format(*reinterpret_cast<const OculusSimplePingResult2*>(pingData.data()),
+                              2, pingData.size());
+    }
+}
+
+template <unsigned int SampleSize>
+inline void scale_samples(const uint8_t* src, float* dst, std::size_t count, float gain);
+
+template <>
+inline void scale_samples<1>(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    scale_to_float(src, dst, count, gain);
+}
+
+template <>
+inline void scale_samples<2>(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    scale_to_float((const uint16_t*)src, dst, count, gain);
+}
+
+template <>
+inline void scale_samples<3>(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    for(std::size_t i = 0; i < count; i++, src += 3) {
+        uint32_t value = src[0] | (src[1] << 8) | (src[2] << 16);
+        dst[i] = gain * value;
+    }
+}
+
+template <>
+inline void scale_samples<4>(const uint8_t* src, float* dst, std::size_t count, float gain)
+{
+    for(std::size_t i = 0; i < count; i++, src += 4) {
+        uint32_t value;
+        std::memcpy(&value, src, sizeof(value));
+        dst[i] = gain * value;
+    }
+}
+
+template <unsigned int SampleSize, bool HasGains>
+static void decode_ping_rows(const PingFormat& format, const uint8_t* imageData,
+                             float* dst, unsigned int firstRange, unsigned int lastRange)
+{
+    std::size_t nBeams = format.nBeams;
+    for(unsigned int r = firstRange; r < lastRange; r++) {
+        const uint8_t* row = imageData + (std::size_t)format.rowSize*r;
+        float gain = 1.0f;
+        if constexpr(HasGains) {
+            uint32_t rowGain;
+            std::memcpy(&rowGain, row, sizeof(rowGain));
+            gain = 1.0f / std::sqrt((float)rowGain);
+            row += sizeof(rowGain);
+        }
+        scale_samples<SampleSize>(row, dst + nBeams*r, nBeams, gain);
+    }
+}
+
+PingKernel select_ping_kernel(const PingFormat& format)
+{
+    static const PingKernel kernels[4][2] = {
+        {decode_ping_rows<1, false>, decode_ping_rows<1, true>},
+        {decode_ping_rows<2, false>, decode_ping_rows<2, true>},
+        {decode_ping_rows<3, false>, decode_ping_rows<3, true>},
+        {decode_ping_rows<4, false>, decode_ping_rows<4, true>}};
+    if(!format.is_valid() || format.sampleSize > 4) {
+        return nullptr;
+    }
+    return kernels[format.sampleSize - 1][format.hasGains ? 1 : 0];
+}
+
+PingFormat decode_ping(const MessageData& pingData, std::vector<float>& dst, ThreadPool* pool)
+{
+    PingFormat format = PingFormat::resolve(pingData);
+    PingKernel kernel = select_ping_kernel(format);
+    if(!kernel) {
+        throw std::runtime_error("oculus::decode_ping : invalid ping data format");
+    }
+
+    dst.resize((std::size_t)format.nBeams*format.nRanges);
+    const uint8_t* imageData = pingData.data() + format.imageOffset;
+    if(!pool) {
+        kernel(format, imageData, dst.data(), 0, format.nRanges);
+        return format;
+    }
+    // same task size as ping_data_to_array
+    constexpr std::size_t minTaskSize = 32768;
+    pool->parallel_for(0, format.nRanges, [&](std::size_t first, std::size_t last) {
+        kernel(format, imageData, dst.data(), first, last);
+    }, std::max<std::size_t>(1, minTaskSize / format.nBeams));
+    return format;
+}
+
+} //namespace oculus
@@ -0,0 +1,172 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/PrefetchReader.h>
+
+namespace oculus {
+
+PrefetchReader::PrefetchReader(const std::string& filename,
+                               std::size_t queueDepth,
+                               std::size_t bufferSize) :
+    reader_(filename, bufferSize),
+    index_(FileIndex::load_or_build(filename)),
+    queueDepth_(std::max<std::size_t>(queueDepth, 1)),
+    endOfFile_(false),
+    stopping_(false)
+{
+    // The reader would otherwise build its index lazily in the reader thread
+    // while the seek methods look into it from the calling thread.
+    reader_.set_index(index_);
+    this->start();
+}
+
+PrefetchReader::~PrefetchReader()
+{
+    this->stop();
+}
+
+void PrefetchReader::start()
+{
+    queue_.clear();
+    endOfFile_ = false;
+    stopping_  = false;
+    error_     = nullptr;
+    thread_ = std::thread(&PrefetchReader::reader_loop, this);
+}
+
+void PrefetchReader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    notFull_.notify_all();
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void PrefetchReader::reader_loop()
+{
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            notFull_.wait(lock, [&]() { return stopping_ || queue_.size() < queueDepth_; });
+            if(stopping_) {
+                return;
+            }
+        }
+
+        // Reading without holding the lock.
+        auto message = Message::Create();
+        bool ok = false;
+        std::exception_ptr error;
+        try {
+            ok = reader_.read_next_message(*message);
+        }
+        catch(...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(ok) {
+                queue_.push_back(message);
+            }
+            else {
+                endOfFile_ = true;
+                error_     = error;
+            }
+        }
+        notEmpty_.notify_one();
+        if(!ok) {
+            return;
+        }
+    }
+}
+
+Message::ConstPtr PrefetchReader::read_next_message()
+{
+    Message::Ptr message;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [&]() { return endOfFile_ || !queue_.empty(); });
+        if(queue_.empty()) {
+            if(error_) {
+                std::rethrow_exception(error_);
+            }
+            return nullptr;
+        }
+        message = queue_.front();
+        queue_.pop_front();
+    }
+    notFull_.notify_one();
+    return message;
+}
+
+PingMessage::ConstPtr PrefetchReader::read_next_ping()
+{
+    Message::ConstPtr msg = this->read_next_message();
+    while(msg && !msg->is_ping_message()) {
+        msg = this->read_next_message();
+    }
+    if(!msg)
+        return nullptr;
+    return PingMessage::Create(msg);
+}
+
+/**
+ * The queued messages are discarded and the reader thread restarts from the
+ * new position.
+ */
+void PrefetchReader::rewind()
+{
+    this->stop();
+    reader_.rewind();
+    this->start();
+}
+
+bool PrefetchReader::seek_to_message(std::size_t messageIndex)
+{
+    // Checked first so the prefetched messages are kept on failure.
+    if(messageIndex >= index_->message_count()) {
+        return false;
+    }
+    this->stop();
+    reader_.seek_to_message(messageIndex);
+    this->start();
+    return true;
+}
+
+bool PrefetchReader::seek_to_time(const Message::TimePoint& stamp)
+{
+    return this->seek_to_message(index_->find_time(stamp));
+}
+
+bool PrefetchReader::seek_to_ping(uint32_t pingId)
+{
+    return this->seek_to_message(index_->find_ping(pingId));
+}
+
+std::size_t PrefetchReader::queued() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+} //namespace oculus
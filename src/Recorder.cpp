@@ -2,10 +2,18 @@
 #include <oculus_driver/print_utils.h>
 
 #include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace oculus {
 
-Recorder::Recorder()
+Recorder::Recorder() :
+    codec_(Codec::None),
+    compressionLevel_(DefaultCompressionLevel)
 {}
 
 Recorder::~Recorder()
@@ -15,8 +23,27 @@ Recorder::~Recorder()
     }
 }
 
+/**
+ * Opens a new file. An existing file is overwritten only if force is set,
+ * otherwise an exception is thrown and the file is left untouched (same as
+ * AsyncRecorder::open).
+ */
 void Recorder::open(const std::string& filename, bool force)
 {
+    if(!force) {
+        // Creating the file exclusively, std::ofstream cannot.
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if(fd < 0) {
+            std::ostringstream oss;
+            oss << "Could not open file for writing : " << filename
+                << " (" << std::strerror(errno) << ")";
+            if(errno == EEXIST) {
+                oss << ", use force to overwrite it";
+            }
+            throw std::runtime_error(oss.str());
+        }
+        ::close(fd);
+    }
     file_.open(filename, std::ofstream::binary);
     if(!file_.is_open()) {
         std::ostringstream oss;
@@ -24,7 +51,12 @@ void Recorder::open(const std::string& filename, bool force)
         throw std::runtime_error(oss.str());
     }
 
-    // preparing file header
+    auto header = Recorder::make_file_header();
+    file_.write((const char*)&header, sizeof(header));
+}
+
+blueprint::LogHeader Recorder::make_file_header()
+{
     blueprint::LogHeader header;
     std::memset(&header, 0, sizeof(header));
 
@@ -35,8 +67,38 @@ void Recorder::open(const std::string& filename, bool force)
     header.encryption = 0;
     header.time = std::chrono::duration_cast<std::chrono::milliseconds>(
         std::chrono::system_clock::now().time_since_epoch()).count() / 1000.0;
+    return header;
+}
+
+/**
+ * Uncompressed item of the given type and size.
+ */
+blueprint::LogItem Recorder::make_item(uint16_t type, double time, uint32_t size)
+{
+    blueprint::LogItem item;
+    std::memset(&item, 0, sizeof(item));
     
-    file_.write((const char*)&header, sizeof(header));
+    item.itemHeader   = ItemMagicNumber;
+    item.sizeHeader   = sizeof(item);
+    item.type         = type;
+    item.version      = 0;
+    item.time         = time;
+    item.compression  = 0;
+    item.originalSize = size;
+    item.payloadSize  = size;
+    return item;
+}
+
+void Recorder::set_compression(Codec codec, int level)
+{
+    if(!codec_available(codec)) {
+        std::ostringstream oss;
+        oss << "oculus::Recorder : compression codec '" << codec_name(codec)
+            << "' not available in this build.";
+        throw std::runtime_error(oss.str());
+    }
+    codec_            = codec;
+    compressionLevel_ = level;
 }
 
 void Recorder::close()
@@ -58,6 +120,7 @@ std::size_t Recorder::write(const blueprint::LogItem& header,
 
 std::size_t Recorder::write(const Message& message) const
 {
+    OCULUS_TRACE_SCOPE("Recorder::write");
     if(!this->is_open()) {
         return 0;
     }
@@ -65,28 +128,31 @@ std::size_t Recorder::write(const Message& message) const
 
     TimeStamp stamp = TimeStamp::from_sonar_stamp(message.timestamp());
 
-    blueprint::LogItem item;
-    std::memset(&item, 0, sizeof(item));
-    
-    item.itemHeader   = ItemMagicNumber;
-    item.sizeHeader   = sizeof(item);
-    item.type         = blueprint::rt_oculusSonar;
-    item.version      = 0;
-    item.time         = stamp.to_seconds<double>();
-    item.compression  = 0;
-    item.originalSize = message.data().size();
-    item.payloadSize  = item.originalSize;
-    writtenSize += this->write(item, message.data().data());
-
-    item.type         = blueprint::rt_oculusSonarStamp;
-    item.originalSize = sizeof(stamp);
-    item.payloadSize  = item.originalSize;
-    writtenSize += this->write(item, (const uint8_t*)&stamp);
+    auto item = make_item(blueprint::rt_oculusSonar, stamp.to_seconds<double>(),
+                          message.bytes().size());
+    const uint8_t* payload = message.bytes().data();
+    // Written uncompressed if compression failed or did not help.
+    if(codec_ != Codec::None
+       && compress(codec_, payload, item.originalSize, compressed_, compressionLevel_)
+       && compressed_.size() < item.originalSize)
+    {
+        item.compression = (uint16_t)codec_;
+        item.payloadSize = compressed_.size();
+        payload          = compressed_.data();
+    }
+    compressionStats_.originalBytes   += item.originalSize;
+    compressionStats_.compressedBytes += item.payloadSize;
+    writtenSize += this->write(item, payload);
+    writtenSize += this->write(make_item(blueprint::rt_oculusSonarStamp,
+                                         stamp.to_seconds<double>(),
+                                         sizeof(stamp)),
+                               (const uint8_t*)&stamp);
 
     return writtenSize;
 }
 
-FileReader::FileReader(const std::string& filename) :
+FileReader::FileReader(const std::string& filename, std::size_t bufferSize) :
+    fileBuffer_(bufferSize),
     itemPosition_(0),
     message_(new Message())
 {
@@ -124,6 +190,11 @@ bool FileReader::check_file_header(const blueprint::LogHeader& header)
 void FileReader::open(const std::string& filename)
 {
     filename_ = filename;
+    index_    = nullptr;
+    if(fileBuffer_.size() > 0) {
+        // must be set before opening the file
+        file_.rdbuf()->pubsetbuf(fileBuffer_.data(), fileBuffer_.size());
+    }
     file_.open(filename, std::ifstream::binary);
     if(!file_.is_open()) {
         std::ostringstream oss;
@@ -184,6 +255,13 @@ std::size_t FileReader::jump_item() const
     return currentItemPosition;
 }
 
+void FileReader::seek_item(std::size_t position)
+{
+    file_.clear();
+    file_.seekg(position);
+    this->read_next_header();
+}
+
 std::size_t FileReader::read_next_item(uint8_t* dst) const
 {
     if(nextItem_.type == 0) {
@@ -209,21 +287,46 @@ std::size_t FileReader::read_next_item(std::vector<uint8_t>& dst) const
     if(nextItem_.type == 0) {
         return 0;
     }
-    dst.resize(nextItem_.payloadSize);
-    return this->read_next_item(dst.data());
+    if(nextItem_.compression == 0) {
+        dst.resize(nextItem_.payloadSize);
+        return this->read_next_item(dst.data());
+    }
+
+    blueprint::LogItem item = nextItem_;
+    compressed_.resize(item.payloadSize);
+    std::size_t position = this->read_next_item(compressed_.data());
+    dst.resize(item.originalSize);
+    if(!decompress((Codec)item.compression, compressed_.data(), compressed_.size(),
+                   dst.data(), dst.size()))
+    {
+        std::ostringstream oss;
+        oss << "oculus::FileReader : could not decompress item (compression "
+            << item.compression << ", " << codec_name((Codec)item.compression) << ").\n";
+        oss << "    file : '" << filename_ << "'";
+        throw std::runtime_error(oss.str());
+    }
+    return position;
 }
 
 Message::ConstPtr FileReader::read_next_message() const
+{
+    if(!this->read_next_message(*message_)) {
+        return nullptr;
+    }
+    return message_;
+}
+
+bool FileReader::read_next_message(Message& dst) const
 {
     // Reading file until we find a rt_oculusSonar message or enf of file
     while(nextItem_.type != blueprint::rt_oculusSonar && this->jump_item());
     if(nextItem_.type == 0) {
-        return nullptr;
+        return false;
     }
 
     double nextItemDate = nextItem_.time;
-    this->read_next_item(message_->data_);
-    (*message_).update_from_data();
+    this->read_next_item(dst.data_);
+    dst.update_from_data();
 
     // Reading TimeStamp from next message if it is there. Falling back to the
     // LogItem date if it is not there.
@@ -231,14 +334,41 @@ Message::ConstPtr FileReader::read_next_message() const
         // next message is timestamp associated with the message we just read.
         TimeStamp stamp;
         this->read_next_item((uint8_t*)&stamp);
-        message_->timestamp_ = stamp.to_sonar_stamp();
+        dst.timestamp_ = stamp.to_sonar_stamp();
     }
     else {
         uint64_t nanos = 1000000000*nextItemDate;
-        message_->timestamp_ = Message::TimePoint(std::chrono::nanoseconds(nanos));
+        dst.timestamp_ = Message::TimePoint(std::chrono::nanoseconds(nanos));
     }
 
-    return message_;
+    return true;
+}
+
+const FileIndex& FileReader::index() const
+{
+    if(!index_) {
+        index_ = FileIndex::load_or_build(filename_);
+    }
+    return *index_;
+}
+
+bool FileReader::seek_to_message(std::size_t messageIndex)
+{
+    if(messageIndex >= this->index().message_count()) {
+        return false;
+    }
+    this->seek_item(this->index()[messageIndex].offset);
+    return true;
+}
+
+bool FileReader::seek_to_time(const Message::TimePoint& stamp)
+{
+    return this->seek_to_message(this->index().find_time(stamp));
+}
+
+bool FileReader::seek_to_ping(uint32_t pingId)
+{
+    return this->seek_to_message(this->index().find_ping(pingId));
 }
 
 PingMessage::ConstPtr FileReader::read_next_ping() const
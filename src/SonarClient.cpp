@@ -18,12 +18,19 @@
 
 #include <oculus_driver/SonarClient.h>
 
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+
 namespace oculus {
 
 using namespace std::placeholders;
 
 SonarClient::SonarClient(const IoServicePtr& service,
-                         const Duration& checkerPeriod) :
+                         const Duration& checkerPeriod,
+                         std::size_t messagePoolSize) :
     ioService_(service),
     socket_(nullptr),
     remote_(),
@@ -35,8 +42,13 @@ SonarClient::SonarClient(const IoServicePtr& service,
     //statusCallbackId_(0),
     //data_(0)
     statusCallbackId_(0),
-    message_(Message::Create())
+    messagePool_(messagePoolSize),
+    message_(messagePool_.acquire()),
+    reportedSkippedBytes_(0),
+    kernelTimestamps_(false)
 {
+    framer_.set_header_checker(
+        std::bind(&SonarClient::is_valid, this, std::placeholders::_1));
     this->checkerTimer_.async_wait(
         std::bind(&SonarClient::checker_callback, this, std::placeholders::_1));
     this->reset_connection();
@@ -70,6 +82,8 @@ size_t SonarClient::send(const boost::asio::streambuf& buffer) const
  */
 void SonarClient::checker_callback(const boost::system::error_code& err)
 {
+    OCULUS_TRACE_SCOPE("SonarClient::checker_callback");
+
     // Programming now the next check 
     this->checkerTimer_.expires_from_now(checkerPeriod_);
     this->checkerTimer_.async_wait(
@@ -97,20 +111,28 @@ void SonarClient::checker_callback(const boost::system::error_code& err)
         // message is more than 10s old. The connection is probably broken and
         // needs a reset.
         std::cerr << "Broken connection. Resetting.\n";
+        metrics_.reconnectCount++;
         this->reset_connection();
         return;
     }
 }
 
+/**
+ * Called on a reception error. The stream cannot be trusted anymore (and no
+ * read is pending), so the connection is reset explicitly instead of waiting
+ * for the checker_callback to notice the silence.
+ */
 void SonarClient::check_reception(const boost::system::error_code& err)
 {
-    // no real handling for now
-    if(err) {
-        std::ostringstream oss;
-        oss << "oculus::SonarClient, reception error : " << err;
-        //throw oss.str();
-        std::cerr << oss.str() << std::endl;
+    if(!err || err == boost::asio::error::operation_aborted) {
+        // The socket was closed on our side (reset_connection or
+        // close_connection). Nothing to do.
+        return;
     }
+    std::cerr << "oculus::SonarClient, reception error : " << err.message()
+              << ". Resetting connection." << std::endl;
+    metrics_.reconnectCount++;
+    this->reset_connection();
 }
 
 void SonarClient::reset_connection()
@@ -150,6 +172,7 @@ void SonarClient::on_first_status(const OculusStatusMsg& msg)
     // device id and ip fetched from status message
     sonarId_ = msg.hdr.srcDeviceId;
     remote_ = remote_from_status<EndPoint>(msg);
+    framer_.set_source_device(sonarId_);
     
     std::cout << "Got Oculus status"
               << "\n- netip   : " << ip_to_string(msg.ipAddr)
@@ -172,7 +195,12 @@ void SonarClient::connect_callback(const boost::system::error_code& err)
     clock_.reset();
 
     connectionState_ = Connected;
+    if(kernelTimestamps_) {
+        std::unique_lock<std::mutex> lock(socketMutex_);
+        this->setup_kernel_timestamps();
+    }
     // this enters the ping data reception loop
+    framer_.reset();
     this->initiate_receive();
 
     this->on_connect();
@@ -185,70 +213,199 @@ void SonarClient::on_connect()
 
 void SonarClient::initiate_receive()
 {
+    OCULUS_TRACE_SCOPE("SonarClient::initiate_receive");
     if(!socket_) return;
-    // asynchronously scan input until finding a valid header.
-    // /!\ To be checked : This function and its callback handle the data
-    // synchronization with the start of the ping message. It is relying on the
-    // assumption that if the data left in the socket is less than the size of
-    // the header, a short read will happen, so that the next read will be
-    // exactly aligned on the next header.
-    static unsigned int count = 0;
-    //std::cout << "Initiate receive : " << count << std::endl << std::flush;
-    count++;
-    boost::asio::async_read(*socket_,
-        boost::asio::buffer(reinterpret_cast<uint8_t*>(&message_->header_), 
-                            sizeof(message_->header_)),
-        std::bind(&SonarClient::header_received_callback, this, _1, _2));
-}
-
-void SonarClient::header_received_callback(const boost::system::error_code err,
-                                           std::size_t receivedByteCount)
-{
-    static unsigned int count = 0;
-    //std::cout << "Receive callback : " << count << std::endl << std::flush;
-    count++;
-    // This function received only enough bytes for an OculusMessageHeader.  If
-    // the header is valid, the control is dispatched to the next state
-    // depending on the header content (message type). For now only simple ping
-    // is implemented, but it seems to be the only message sent by the Oculus.
-    // (TODO : check this last statement. Checked : wrong. Other message types
-    // seem to be sent but are not documented by Oculus).
-    this->check_reception(err);
-    if(receivedByteCount != sizeof(message_->header_) || !this->is_valid(message_->header_)) {
-        // Either we got data in the middle of a ping or did not get enougth
-        // bytes (end of message). Continue listening to get a valid header.
-        std::cout << "Header reception error" << std::endl << std::flush;
-        this->initiate_receive();
+    if(kernelTimestamps_) {
+        // Reading is done in data_available_callback with recvmsg to retrieve
+        // the reception date from the socket control messages.
+        socket_->async_wait(Socket::wait_read,
+            std::bind(&SonarClient::data_available_callback, this, _1));
         return;
     }
-
-    // Messsage header is valid. Now getting the remaining part of the message.
-    // (The header contains the payload size, we can receive everything and
-    // parse afterwards).
-    message_->update_from_header();
-    boost::asio::async_read(*socket_,
-        boost::asio::buffer(message_->payload_handle(), message_->payload_size()),
+    // Reading as much data as available in the framer buffer. The message
+    // boundaries are found afterwards by the framer, so there is no
+    // assumption on how the sonar data is split between reads.
+    socket_->async_read_some(
+        boost::asio::buffer(framer_.write_handle(), framer_.write_capacity()),
         std::bind(&SonarClient::data_received_callback, this, _1, _2));
 }
 
 void SonarClient::data_received_callback(const boost::system::error_code err,
                                          std::size_t receivedByteCount)
 {
-    if(receivedByteCount != message_->header_.payloadSize) {
-        // We did not get enough bytes. Reinitiating reception.
-        std::cout << "Data reception error" << std::endl << std::flush;
-        this->initiate_receive();
+    OCULUS_TRACE_SCOPE("SonarClient::data_received_callback");
+    if(err) {
+        // Stopping the reception loop, check_reception resets the connection.
+        this->check_reception(err);
         return;
     }
-    
-    clock_.reset();
-    // handle message is to be reimplemented in a subclass
-    this->handle_message(message_);
+    this->process_received_data(receivedByteCount, TimeSource::now());
 
     // Continuing the reception loop.
     this->initiate_receive();
 }
 
+void SonarClient::data_available_callback(const boost::system::error_code err)
+{
+    OCULUS_TRACE_SCOPE("SonarClient::data_available_callback");
+    if(err) {
+        this->check_reception(err);
+        return;
+    }
+
+    TimePoint kernelStamp;
+    std::size_t receivedByteCount = 0;
+    #ifdef __linux__
+    {
+        iovec iov;
+        iov.iov_base = framer_.write_handle();
+        iov.iov_len  = framer_.write_capacity();
+
+        alignas(cmsghdr) char control[256];
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t res = ::recvmsg(socket_->native_handle(), &msg, MSG_DONTWAIT);
+        if(res < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                // spurious wake up
+                this->initiate_receive();
+                return;
+            }
+            this->check_reception(boost::system::error_code(
+                errno, boost::system::system_category()));
+            return;
+        }
+        if(res == 0) {
+            this->check_reception(boost::asio::error::eof);
+            return;
+        }
+        receivedByteCount = res;
+
+        for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if(cmsg->cmsg_level != SOL_SOCKET) continue;
+            const timespec* ts = nullptr;
+            // The stamp is the one of the last TCP segment read here.
+            if(cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                // ts[0] is the software timestamp (ts[2] would be the hardware one).
+                ts = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(cmsg))->ts;
+            }
+            else if(cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                ts = reinterpret_cast<const timespec*>(CMSG_DATA(cmsg));
+            }
+            if(ts && (ts->tv_sec != 0 || ts->tv_nsec != 0)) {
+                kernelStamp = TimePoint(std::chrono::duration_cast<TimePoint::duration>(
+                    std::chrono::seconds(ts->tv_sec) + std::chrono::nanoseconds(ts->tv_nsec)));
+            }
+        }
+    }
+    #endif //__linux__
+    this->process_received_data(receivedByteCount, TimeSource::now(), kernelStamp);
+
+    this->initiate_receive();
+}
+
+/**
+ * Hands newly received data to the framer and dispatches all the complete
+ * messages found so far.
+ */
+void SonarClient::process_received_data(std::size_t receivedByteCount,
+                                        const TimePoint& stamp,
+                                        const TimePoint& kernelStamp)
+{
+    framer_.commit(receivedByteCount, stamp, kernelStamp);
+    metrics_.bytesReceived += receivedByteCount;
+
+    // The header of each frame was already checked with is_valid by the framer.
+    while(const uint8_t* frame = framer_.next_frame()) {
+        OCULUS_TRACE_SCOPE("SonarClient::handle_message");
+        // Taking a free buffer from the pool. The previous message_ may still
+        // be referenced by a user and must not be overwritten.
+        message_ = messagePool_.acquire();
+        std::memcpy(&message_->header_, frame, sizeof(message_->header_));
+        message_->update_from_header(framer_.frame_stamp(), framer_.frame_kernel_stamp());
+        metrics_.frameAssembly.record(stamp - framer_.frame_stamp());
+        std::memcpy(message_->payload_handle(), frame + sizeof(message_->header_),
+                    message_->payload_size());
+        framer_.consume_frame();
+
+        if(framer_.skipped_bytes() != reportedSkippedBytes_) {
+            std::cerr << "Stream resynchronized, skipped "
+                      << framer_.skipped_bytes() - reportedSkippedBytes_
+                      << " bytes" << std::endl;
+            metrics_.resyncCount  = framer_.resync_count();
+            metrics_.skippedBytes = framer_.skipped_bytes();
+            reportedSkippedBytes_ = framer_.skipped_bytes();
+        }
+
+        clock_.reset();
+        // handle message is to be reimplemented in a subclass
+        this->handle_message(message_);
+        metrics_.messagesReceived++;
+        metrics_.dispatch.record(TimeSource::now() - stamp);
+    }
+}
+
+/**
+ * Enables the reception date given by the kernel (SO_TIMESTAMPING, or
+ * SO_TIMESTAMPNS if not supported) in Message::kernel_timestamp().
+ *
+ * On a TCP socket, recvmsg returns the reception date of the last segment it
+ * read. The kernel stamp of a message is therefore the date at which the
+ * kernel received the last segment of the read containing the first byte of
+ * the message : it is not earlier than the arrival of that first byte, and
+ * never later than Message::timestamp(). Unlike Message::timestamp() it does
+ * not depend on the io_service scheduling. Only available on Linux. Returns
+ * false if the socket option could not be set on the current connection.
+ */
+bool SonarClient::enable_kernel_timestamps(bool enable)
+{
+    #ifndef __linux__
+    if(enable) {
+        std::cerr << "oculus::SonarClient : kernel timestamps not available "
+                  << "on this platform." << std::endl;
+        return false;
+    }
+    #endif
+    // This will be taken into account by initiate_receive and on the next
+    // connection.
+    kernelTimestamps_ = enable;
+    std::unique_lock<std::mutex> lock(socketMutex_);
+    if(!socket_ || !socket_->is_open()) {
+        return true;
+    }
+    return this->setup_kernel_timestamps();
+}
+
+bool SonarClient::setup_kernel_timestamps()
+{
+    #ifdef __linux__
+    int fd = socket_->native_handle();
+    if(!kernelTimestamps_) {
+        int disabled = 0;
+        ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &disabled, sizeof(disabled));
+        ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS,  &disabled, sizeof(disabled));
+        return true;
+    }
+
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if(::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+        return true;
+    }
+    int enabled = 1;
+    if(::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enabled, sizeof(enabled)) == 0) {
+        return true;
+    }
+    std::cerr << "oculus::SonarClient : could not enable kernel timestamps : "
+              << std::strerror(errno) << std::endl;
+    #endif
+    return false;
+}
+
 void SonarClient::handle_message(const Message::ConstPtr& msg)
 {
     // To be reimplemented in a subclass
@@ -21,12 +21,44 @@
 namespace oculus {
 
 SonarDriver::SonarDriver(const IoServicePtr& service,
-                         const Duration& checkerPeriod) :
-    SonarClient(service, checkerPeriod),
+                         const Duration& checkerPeriod,
+                         std::size_t messagePoolSize) :
+    SonarClient(service, checkerPeriod, messagePoolSize),
     lastConfig_(default_ping_config()),
-    lastPingRate_(pingRateNormal)
+    lastPingRate_(pingRateNormal),
+    lastPingStamp_(),
+    clockSyncVersion_(0xffff),
+    dispatchWorkerCount_(1),
+    basePoolSize_(messagePoolSize),
+    asyncHeldMessages_(0)
 {}
 
+SonarDriver::~SonarDriver()
+{
+    this->cancel_config_requests();
+
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    for(auto& item : messageChannels_) {
+        messageCallbacks_.remove_callback(item.first);
+        item.second->close();
+    }
+    for(auto& item : pingChannels_) {
+        pingCallbacks_.remove_callback(item.first);
+        item.second->close();
+    }
+    for(auto& item : dummyChannels_) {
+        dummyCallbacks_.remove_callback(item.first);
+        item.second->close();
+    }
+    for(auto& item : configChannels_) {
+        configCallbacks_.remove_callback(item.first);
+        item.second->close();
+    }
+    if(dispatcher_) {
+        dispatcher_->stop();
+    }
+}
+
 bool SonarDriver::send_ping_config(PingConfig config)
 {
     config.head.oculusId    = OCULUS_CHECK_ID;
@@ -109,6 +141,7 @@ SonarDriver::PingConfig SonarDriver::request_ping_config(PingConfig request)
             }
         }
         count++;
+        metrics_.configRetryCount++;
     } while(count < maxCount);
     //std::cout << "Count is : " << count << std::endl << std::flush;
 
@@ -122,6 +155,187 @@ SonarDriver::PingConfig SonarDriver::request_ping_config(PingConfig request)
     return feedback;
 }
 
+struct SonarDriver::ConfigRequest
+{
+    ConfigRequest(SonarDriver* drv, IoService& service, const PingConfig& req,
+                  const ConfigRequestOptions& opts) :
+        driver(drv),
+        strand(service),
+        deadlineTimer(service),
+        retryTimer(service),
+        request(req),
+        options(opts),
+        retryCount(0),
+        callbackId(0),
+        done(false)
+    {}
+
+    // The handlers run with mutex locked and only if driver is not null. The
+    // SonarDriver destructor sets it to null (see cancel_config_requests), so
+    // no handler touches a destroyed driver.
+    std::mutex   mutex;
+    SonarDriver* driver;
+
+    // All the handlers of a request are run in this strand, so the timers and
+    // the fields below are never accessed concurrently.
+    IoService::strand           strand;
+    boost::asio::deadline_timer deadlineTimer;
+    boost::asio::deadline_timer retryTimer;
+    std::promise<PingConfig>    promise;
+    PingConfig                  request;
+    ConfigRequestOptions        options;
+    unsigned int                retryCount;
+    unsigned int                callbackId;
+    bool                        done;
+
+    template <class F>
+    static auto guarded(const std::shared_ptr<ConfigRequest>& state, F f) {
+        return [state, f](auto&&... args) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if(state->driver) {
+                f(std::forward<decltype(args)>(args)...);
+            }
+        };
+    }
+};
+
+/**
+ * Non-blocking version of request_ping_config.
+ *
+ * The returned future is set with the config feedback of the first message
+ * matching the request (see check_config_feedback). It is set with a
+ * ConfigRequestTimeout exception if options.deadline is reached, with a
+ * ConfigRequestSendError if the request could not be sent, and with a
+ * ConfigRequestCancelled if the driver is destroyed first. The request is
+ * sent again every options.retryPeriod until a matching feedback is
+ * received. No thread is blocked, everything happens in the io_service.
+ */
+std::future<SonarDriver::PingConfig> SonarDriver::request_ping_config_async(
+    PingConfig request, const ConfigRequestOptions& options)
+{
+    request.flags |= 0x4; // forcing sonar sending gains to true
+
+    auto state = std::make_shared<ConfigRequest>(this, *ioService_, request, options);
+    auto future = state->promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(configRequestsMutex_);
+        configRequests_.insert(state);
+    }
+    state->strand.post(ConfigRequest::guarded(state, [this, state]() {
+        this->config_request_start(state);
+    }));
+    return future;
+}
+
+void SonarDriver::config_request_start(const std::shared_ptr<ConfigRequest>& state)
+{
+    state->callbackId = this->add_message_callback(
+        [this, state](const Message::ConstPtr& message) {
+            // lastConfig_ is ALWAYS updated before the callbacks are called.
+            PingConfig feedback = lastConfig_;
+            feedback.head = message->header();
+            if(!check_config_feedback(state->request, feedback))
+                return;
+            state->strand.post(ConfigRequest::guarded(state, [this, state, feedback]() {
+                this->config_request_complete(state, &feedback);
+            }));
+        });
+
+    state->deadlineTimer.expires_from_now(state->options.deadline);
+    state->deadlineTimer.async_wait(state->strand.wrap(ConfigRequest::guarded(state,
+        [this, state](const boost::system::error_code& err) {
+            if(err != boost::asio::error::operation_aborted) {
+                this->config_request_complete(state, nullptr);
+            }
+        })));
+
+    this->config_request_send(state);
+}
+
+/**
+ * Sends the request and schedules the next retry. The request fails right
+ * away if it could not be sent.
+ */
+void SonarDriver::config_request_send(const std::shared_ptr<ConfigRequest>& state)
+{
+    if(!this->send_ping_config(state->request)) {
+        this->config_request_complete(state, nullptr,
+            std::make_exception_ptr(ConfigRequestSendError()));
+        return;
+    }
+    this->config_request_retry(state);
+}
+
+void SonarDriver::config_request_retry(const std::shared_ptr<ConfigRequest>& state)
+{
+    if(state->done || state->retryCount >= state->options.maxRetries)
+        return;
+
+    state->retryTimer.expires_from_now(state->options.retryPeriod);
+    state->retryTimer.async_wait(state->strand.wrap(ConfigRequest::guarded(state,
+        [this, state](const boost::system::error_code& err) {
+            if(err == boost::asio::error::operation_aborted || state->done)
+                return;
+            state->retryCount++;
+            metrics_.configRetryCount++;
+            this->config_request_send(state);
+        })));
+}
+
+/**
+ * Ends a request. A null feedback means the request failed with error (or
+ * the deadline was reached if error is null).
+ */
+void SonarDriver::config_request_complete(const std::shared_ptr<ConfigRequest>& state,
+                                          const PingConfig* feedback,
+                                          std::exception_ptr error)
+{
+    if(state->done)
+        return;
+    state->done = true;
+
+    state->deadlineTimer.cancel();
+    state->retryTimer.cancel();
+    this->remove_message_callback(state->callbackId);
+    {
+        std::lock_guard<std::mutex> lock(configRequestsMutex_);
+        configRequests_.erase(state);
+    }
+
+    if(feedback) {
+        state->promise.set_value(*feedback);
+    }
+    else {
+        state->promise.set_exception(error ? error
+            : std::make_exception_ptr(ConfigRequestTimeout()));
+    }
+}
+
+/**
+ * Fails the pending requests with ConfigRequestCancelled and detaches their
+ * handlers from the driver (called by the destructor).
+ */
+void SonarDriver::cancel_config_requests()
+{
+    // Moved out first : a completing handler locks configRequestsMutex_
+    // while holding its request mutex.
+    std::unordered_set<std::shared_ptr<ConfigRequest>> requests;
+    {
+        std::lock_guard<std::mutex> lock(configRequestsMutex_);
+        requests.swap(configRequests_);
+    }
+    for(const auto& state : requests) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->driver = nullptr;
+        if(state->done)
+            continue;
+        state->done = true;
+        state->deadlineTimer.cancel();
+        state->retryTimer.cancel();
+        state->promise.set_exception(std::make_exception_ptr(ConfigRequestCancelled()));
+    }
+}
+
 void SonarDriver::standby()
 {
     auto request = lastConfig_;
@@ -181,20 +395,48 @@ void SonarDriver::handle_message(const Message::ConstPtr& message)
             break;
     };
 
+    // Execution time of each callback queue is recorded in the metrics.
+    using Clock = std::chrono::steady_clock;
+
     if(config_changed(lastConfig_, newConfig)) {
+        OCULUS_TRACE_SCOPE("SonarDriver::configCallbacks");
+        auto t0 = Clock::now();
         configCallbacks_.call(lastConfig_, newConfig);
+        metrics_.configCallbacks.record(Clock::now() - t0);
     }
     lastConfig_ = newConfig;
 
     // Calling generic message callbacks first (in case we want to do something
     // before calling the specialized callbacks).
-    messageCallbacks_.call(message);
+    auto t0 = Clock::now();
+    {
+        OCULUS_TRACE_SCOPE("SonarDriver::messageCallbacks");
+        messageCallbacks_.call(message);
+    }
+    metrics_.messageCallbacks.record(Clock::now() - t0);
     switch(header.msgId) {
         case messageSimplePingResult:
-            pingCallbacks_.call(PingMessage::Create(message));
+            {
+                if(lastPingStamp_ != TimePoint()) {
+                    metrics_.pingInterval.record(message->timestamp() - lastPingStamp_);
+                }
+                lastPingStamp_ = message->timestamp();
+
+                auto ping = PingMessage::Create(message);
+                this->update_clock_sync(ping);
+                OCULUS_TRACE_SCOPE("SonarDriver::pingCallbacks");
+                t0 = Clock::now();
+                pingCallbacks_.call(ping);
+                metrics_.pingCallbacks.record(Clock::now() - t0);
+            }
             break;
         case messageDummy:
-            dummyCallbacks_.call(header);
+            {
+                OCULUS_TRACE_SCOPE("SonarDriver::dummyCallbacks");
+                t0 = Clock::now();
+                dummyCallbacks_.call(header);
+                metrics_.dummyCallbacks.record(Clock::now() - t0);
+            }
             break;
         case messageSimpleFire:
             std::cerr << "messageSimpleFire parsing not implemented." << std::endl;
@@ -210,6 +452,30 @@ void SonarDriver::handle_message(const Message::ConstPtr& message)
     }
 }
 
+/**
+ * Adds the ping to the clock synchronization and sets its acquisition date.
+ *
+ * The kernel reception date is used if available since it is less affected by
+ * the scheduling jitter.
+ */
+void SonarDriver::update_clock_sync(const PingMessage::Ptr& ping)
+{
+    if(ping->header().msgVersion != clockSyncVersion_) {
+        // The pingStartTime is a 32 bits integer in OculusSimplePingResult
+        // and seconds (double) in OculusSimplePingResult2.
+        clockSyncVersion_ = ping->header().msgVersion;
+        clockSync_.reset();
+        clockSync_.set_wrap_period(clockSyncVersion_ == 2 ? 0.0 : 4294967296.0);
+    }
+
+    const auto& msg = *ping->message();
+    clockSync_.add_sample(ping->ping_start_time(),
+        msg.has_kernel_timestamp() ? msg.kernel_timestamp() : msg.timestamp());
+    if(clockSync_.valid()) {
+        ping->acquisitionTimestamp_ = clockSync_.to_host_time(ping->ping_start_time());
+    }
+}
+
 // message callbacks
 unsigned int SonarDriver::add_message_callback(const MessageCallback& callback)
 {
@@ -218,6 +484,10 @@ unsigned int SonarDriver::add_message_callback(const MessageCallback& callback)
 
 bool SonarDriver::remove_message_callback(unsigned int callbackId)
 {
+    // The id of an asynchronous callback also closes its channel.
+    if(this->remove_async_message_callback(callbackId)) {
+        return true;
+    }
     return messageCallbacks_.remove_callback(callbackId);
 }
 
@@ -250,6 +520,10 @@ unsigned int SonarDriver::add_ping_callback(const PingCallback& callback)
 
 bool SonarDriver::remove_ping_callback(unsigned int callbackId)
 {
+    // The id of an asynchronous callback also closes its channel.
+    if(this->remove_async_ping_callback(callbackId)) {
+        return true;
+    }
     return pingCallbacks_.remove_callback(callbackId);
 }
 
@@ -266,6 +540,10 @@ unsigned int SonarDriver::add_dummy_callback(const DummyCallback& callback)
 
 bool SonarDriver::remove_dummy_callback(unsigned int callbackId)
 {
+    // The id of an asynchronous callback also closes its channel.
+    if(this->remove_async_dummy_callback(callbackId)) {
+        return true;
+    }
     return dummyCallbacks_.remove_callback(callbackId);
 }
 
@@ -274,6 +552,191 @@ bool SonarDriver::on_next_dummy(const DummyCallback& callback)
     return dummyCallbacks_.add_single_shot(callback);
 }
 
+/**
+ * Sets the number of worker threads calling the asynchronous callbacks. Only
+ * effective before the first asynchronous callback is added.
+ */
+void SonarDriver::set_dispatch_worker_count(unsigned int workerCount)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    if(dispatcher_) {
+        std::cerr << "oculus::SonarDriver : dispatcher already started, "
+                  << "ignoring new worker count." << std::endl;
+        return;
+    }
+    dispatchWorkerCount_ = workerCount;
+}
+
+AsyncDispatcher& SonarDriver::dispatcher()
+{
+    // dispatchMutex_ is expected to be locked.
+    if(!dispatcher_) {
+        dispatcher_ = std::make_unique<AsyncDispatcher>(dispatchWorkerCount_);
+    }
+    return *dispatcher_;
+}
+
+/**
+ * Grows the message pool so it is larger than the total depth of the message
+ * and ping channels (each one can also hold one message in its callback).
+ * The pool is only accessed in the io_service.
+ */
+void SonarDriver::update_pool_capacity()
+{
+    // dispatchMutex_ is expected to be locked.
+    std::size_t capacity = basePoolSize_ + asyncHeldMessages_;
+    ioService_->post([this, capacity]() { messagePool_.grow(capacity); });
+}
+
+// Messages a channel can keep alive : its queue and the item being processed.
+template <typename T>
+static std::size_t held_messages(const DispatchChannel<T>& channel)
+{
+    return channel.capacity() + 1;
+}
+
+template <class Callbacks, class Channels>
+static bool remove_async_callback(Callbacks& callbacks, Channels& channels,
+                                  unsigned int callbackId)
+{
+    auto it = channels.find(callbackId);
+    if(it == channels.end()) {
+        return false;
+    }
+    callbacks.remove_callback(callbackId);
+    it->second->close();
+    channels.erase(it);
+    return true;
+}
+
+template <class Channels>
+static DispatchStats async_callback_stats(const Channels& channels, unsigned int callbackId)
+{
+    auto it = channels.find(callbackId);
+    if(it == channels.end()) {
+        return DispatchStats{0,0,0,0};
+    }
+    return it->second->stats();
+}
+
+unsigned int SonarDriver::add_async_message_callback(const MessageCallback& callback,
+                                                     DropPolicy policy,
+                                                     std::size_t queueDepth)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    auto channel = this->dispatcher().make_channel<Message::ConstPtr>(
+        callback, policy, queueDepth);
+    // The regular callback only pushes the message in the channel queue.
+    auto callbackId = messageCallbacks_.add_callback(
+        [channel](const Message::ConstPtr& msg) { channel->push(msg); });
+    messageChannels_[callbackId] = channel;
+    asyncHeldMessages_ += held_messages(*channel);
+    this->update_pool_capacity();
+    return callbackId;
+}
+
+unsigned int SonarDriver::add_async_ping_callback(const PingCallback& callback,
+                                                  DropPolicy policy,
+                                                  std::size_t queueDepth)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    auto channel = this->dispatcher().make_channel<PingMessage::ConstPtr>(
+        callback, policy, queueDepth);
+    auto callbackId = pingCallbacks_.add_callback(
+        [channel](const PingMessage::ConstPtr& ping) { channel->push(ping); });
+    pingChannels_[callbackId] = channel;
+    asyncHeldMessages_ += held_messages(*channel);
+    this->update_pool_capacity();
+    return callbackId;
+}
+
+unsigned int SonarDriver::add_async_dummy_callback(const DummyCallback& callback,
+                                                   DropPolicy policy,
+                                                   std::size_t queueDepth)
+{
+    // The header is copied, no pooled message is kept.
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    auto channel = this->dispatcher().make_channel<OculusMessageHeader>(
+        callback, policy, queueDepth);
+    auto callbackId = dummyCallbacks_.add_callback(
+        [channel](const OculusMessageHeader& header) { channel->push(header); });
+    dummyChannels_[callbackId] = channel;
+    return callbackId;
+}
+
+unsigned int SonarDriver::add_async_config_callback(const ConfigCallback& callback,
+                                                    DropPolicy policy,
+                                                    std::size_t queueDepth)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    auto channel = this->dispatcher().make_channel<std::pair<PingConfig, PingConfig>>(
+        [callback](const std::pair<PingConfig, PingConfig>& configs) {
+            callback(configs.first, configs.second);
+        }, policy, queueDepth);
+    auto callbackId = configCallbacks_.add_callback(
+        [channel](const PingConfig& lastConfig, const PingConfig& newConfig) {
+            channel->push(std::make_pair(lastConfig, newConfig));
+        });
+    configChannels_[callbackId] = channel;
+    return callbackId;
+}
+
+bool SonarDriver::remove_async_message_callback(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    auto it = messageChannels_.find(callbackId);
+    if(it != messageChannels_.end()) {
+        asyncHeldMessages_ -= held_messages(*it->second);
+    }
+    return remove_async_callback(messageCallbacks_, messageChannels_, callbackId);
+}
+
+bool SonarDriver::remove_async_ping_callback(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    auto it = pingChannels_.find(callbackId);
+    if(it != pingChannels_.end()) {
+        asyncHeldMessages_ -= held_messages(*it->second);
+    }
+    return remove_async_callback(pingCallbacks_, pingChannels_, callbackId);
+}
+
+bool SonarDriver::remove_async_dummy_callback(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return remove_async_callback(dummyCallbacks_, dummyChannels_, callbackId);
+}
+
+bool SonarDriver::remove_async_config_callback(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return remove_async_callback(configCallbacks_, configChannels_, callbackId);
+}
+
+DispatchStats SonarDriver::async_message_callback_stats(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return async_callback_stats(messageChannels_, callbackId);
+}
+
+DispatchStats SonarDriver::async_ping_callback_stats(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return async_callback_stats(pingChannels_, callbackId);
+}
+
+DispatchStats SonarDriver::async_dummy_callback_stats(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return async_callback_stats(dummyChannels_, callbackId);
+}
+
+DispatchStats SonarDriver::async_config_callback_stats(unsigned int callbackId)
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex_);
+    return async_callback_stats(configChannels_, callbackId);
+}
+
 /**
  * This is a synchronization primitive allowing for waiting for the sonar to be
  * ready for example.
@@ -289,5 +752,14 @@ unsigned int SonarDriver::add_config_callback(const ConfigCallback& callback)
     return configCallbacks_.add_callback(callback);
 }
 
+bool SonarDriver::remove_config_callback(unsigned int callbackId)
+{
+    // The id of an asynchronous callback also closes its channel.
+    if(this->remove_async_config_callback(callbackId)) {
+        return true;
+    }
+    return configCallbacks_.remove_callback(callbackId);
+}
+
 } //namespace oculus
 
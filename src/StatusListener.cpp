@@ -69,6 +69,7 @@ bool StatusListener::on_next_status(
 void StatusListener::message_callback(const boost::system::error_code& err,
                                       std::size_t bytesReceived)
 {
+    OCULUS_TRACE_SCOPE("StatusListener::message_callback");
     if(err) {
         std::cerr << "oculus::StatusListener::read_callback : Status reception error.\n";
         this->get_one_message();
@@ -0,0 +1,259 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/StreamFramer.h>
+
+#include <cstring>
+
+#include <oculus_driver/HeaderScanner.h>
+
+namespace oculus {
+
+StreamFramer::StreamFramer(std::size_t capacity, std::size_t maxPayloadSize) :
+    buffer_(std::max(capacity, 2*MinReadSize)),
+    begin_(0),
+    end_(0),
+    streamBegin_(0),
+    maxPayloadSize_(maxPayloadSize),
+    srcDeviceId_(-1),
+    chunks_{},
+    chunkBegin_(0),
+    chunkCount_(0),
+    skippedBytes_(0),
+    resyncCount_(0),
+    synchronized_(true)
+{}
+
+/**
+ * Discards all buffered data (to be called on a new connection).
+ */
+void StreamFramer::reset()
+{
+    begin_        = 0;
+    end_          = 0;
+    streamBegin_  = 0;
+    chunkBegin_   = 0;
+    chunkCount_   = 0;
+    synchronized_ = true;
+}
+
+/**
+ * Largest plausible payload for a message type. A corrupted header announcing
+ * a huge payload would otherwise stall the framer until that many bytes are
+ * received.
+ */
+std::size_t StreamFramer::payload_limit(uint16_t msgId)
+{
+    switch(msgId) {
+        case messageSimplePingResult:
+        case messagePingResult:
+            return MaxPingPayloadSize;
+        default:
+            return MaxOtherPayloadSize;
+    }
+}
+
+bool StreamFramer::header_valid(const OculusMessageHeader& header) const
+{
+    return header.oculusId == OCULUS_CHECK_ID
+        && header.payloadSize <= maxPayloadSize_
+        && header.payloadSize <= payload_limit(header.msgId)
+        && (!checker_ || checker_(header));
+}
+
+/**
+ * Returns a pointer where the next received data is to be written.
+ *
+ * At least MinReadSize bytes are available after this call (see
+ * write_capacity()), and enough space is reserved for the current frame to be
+ * stored contiguously.
+ */
+uint8_t* StreamFramer::write_handle()
+{
+    std::size_t frameSize = 0;
+    if(this->buffered() >= sizeof(OculusMessageHeader)) {
+        OculusMessageHeader header;
+        std::memcpy(&header, buffer_.data() + begin_, sizeof(header));
+        if(this->header_valid(header)) {
+            frameSize = sizeof(header) + header.payloadSize;
+        }
+    }
+
+    if(this->write_capacity() < MinReadSize || begin_ + frameSize > buffer_.size()) {
+        // Not enough room left at the end of the buffer. Moving unparsed data
+        // at the beginning (this is usually a small part of a frame).
+        std::memmove(buffer_.data(), buffer_.data() + begin_, this->buffered());
+        end_  -= begin_;
+        begin_ = 0;
+    }
+
+    std::size_t required = std::max(end_ + MinReadSize, frameSize);
+    if(buffer_.size() < required) {
+        // Only happens for frames larger than the buffer.
+        buffer_.resize(required);
+    }
+
+    return buffer_.data() + end_;
+}
+
+/**
+ * Signals that byteCount bytes were written at write_handle().
+ *
+ * The stamp is the reception date of these bytes. It is used to date the
+ * messages starting in this chunk of data (see frame_stamp()).
+ */
+void StreamFramer::commit(std::size_t byteCount, const TimePoint& stamp,
+                          const TimePoint& kernelStamp)
+{
+    if(byteCount == 0) return;
+
+    if(chunkCount_ == MaxChunkCount) {
+        chunkBegin_ = (chunkBegin_ + 1) % MaxChunkCount;
+        chunkCount_--;
+    }
+    auto& chunk = chunks_[(chunkBegin_ + chunkCount_) % MaxChunkCount];
+    chunk.offset      = streamBegin_ + this->buffered();
+    chunk.stamp       = stamp;
+    chunk.kernelStamp = kernelStamp;
+    chunkCount_++;
+
+    end_ += byteCount;
+}
+
+/**
+ * Removes the reception chunks entirely located before the current position.
+ */
+void StreamFramer::drop_chunks()
+{
+    while(chunkCount_ > 1
+          && chunks_[(chunkBegin_ + 1) % MaxChunkCount].offset <= streamBegin_)
+    {
+        chunkBegin_ = (chunkBegin_ + 1) % MaxChunkCount;
+        chunkCount_--;
+    }
+}
+
+/**
+ * Skips data until a possible header is found.
+ *
+ * Returns true if the current position is on a valid header, false if more
+ * data is needed.
+ */
+bool StreamFramer::resync()
+{
+    if(synchronized_) {
+        resyncCount_++;
+        synchronized_ = false;
+    }
+
+    // Jumping from candidate to candidate with the vectorized scanner. The
+    // scanner keeps the last bytes of the buffer if they may be the beginning
+    // of a header.
+    std::size_t pos = begin_ + 1;
+    bool found = false;
+    while(pos < end_) {
+        pos += find_header_candidate(buffer_.data() + pos, end_ - pos, srcDeviceId_);
+        if(end_ - pos < sizeof(OculusMessageHeader)) {
+            // No candidate or candidate header not complete yet. Waiting for
+            // more data.
+            break;
+        }
+        OculusMessageHeader header;
+        std::memcpy(&header, buffer_.data() + pos, sizeof(header));
+        if(this->header_valid(header)) {
+            found = true;
+            break;
+        }
+        pos++;
+    }
+
+    skippedBytes_ += pos - begin_;
+    streamBegin_  += pos - begin_;
+    begin_         = pos;
+    this->drop_chunks();
+
+    return found;
+}
+
+/**
+ * Returns a pointer to the next complete frame, or nullptr if more data is
+ * needed. The frame stays valid until consume_frame() or write_handle() is
+ * called.
+ */
+const uint8_t* StreamFramer::next_frame()
+{
+    while(this->buffered() >= sizeof(OculusMessageHeader)) {
+        OculusMessageHeader header;
+        std::memcpy(&header, buffer_.data() + begin_, sizeof(header));
+        if(!this->header_valid(header)) {
+            if(!this->resync()) {
+                return nullptr;
+            }
+            continue;
+        }
+        if(this->buffered() < sizeof(header) + header.payloadSize) {
+            return nullptr;
+        }
+        return buffer_.data() + begin_;
+    }
+    return nullptr;
+}
+
+/**
+ * Size of the frame returned by next_frame() (header included).
+ */
+std::size_t StreamFramer::frame_size() const
+{
+    OculusMessageHeader header;
+    std::memcpy(&header, buffer_.data() + begin_, sizeof(header));
+    return sizeof(header) + header.payloadSize;
+}
+
+/**
+ * Reception information of the first byte of the frame returned by
+ * next_frame().
+ */
+const StreamFramer::ChunkInfo& StreamFramer::frame_chunk() const
+{
+    // drop_chunks() guarantees that the first chunk contains the current
+    // position, unless a commit overflowed the chunk list.
+    std::size_t index = chunkBegin_;
+    for(std::size_t i = 1; i < chunkCount_; i++) {
+        std::size_t next = (chunkBegin_ + i) % MaxChunkCount;
+        if(chunks_[next].offset > streamBegin_) {
+            break;
+        }
+        index = next;
+    }
+    return chunks_[index];
+}
+
+void StreamFramer::consume_frame()
+{
+    std::size_t size = this->frame_size();
+    synchronized_  = true;
+    begin_        += size;
+    streamBegin_  += size;
+    if(begin_ == end_) {
+        begin_ = 0;
+        end_   = 0;
+    }
+    this->drop_chunks();
+}
+
+} //namespace oculus
@@ -0,0 +1,123 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <oculus_driver/Trace.h>
+
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace oculus {
+
+constexpr std::size_t Tracer::BufferCapacity;
+
+Tracer& Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::ThreadBuffer* Tracer::register_thread()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.push_back(std::make_shared<ThreadBuffer>(buffers_.size() + 1));
+    return buffers_.back().get();
+}
+
+void Tracer::record(const char* name, char phase)
+{
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if(!buffer) {
+        buffer = this->register_thread();
+    }
+    buffer->push(name, phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Discards all the recorded events. Must not be called while events are
+ * being recorded.
+ */
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto& buffer : buffers_) {
+        buffer->head.store(0, std::memory_order_release);
+    }
+}
+
+std::size_t Tracer::event_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t count = 0;
+    for(const auto& buffer : buffers_) {
+        count += std::min<uint64_t>(buffer->head.load(std::memory_order_acquire),
+                                    BufferCapacity);
+    }
+    return count;
+}
+
+void Tracer::write_chrome_trace(std::ostream& os) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    std::vector<Event> events;
+    for(const auto& buffer : buffers_) {
+        // Copying the events first. The slots which may have been overwritten
+        // by the owning thread during the copy are discarded afterwards.
+        uint64_t head  = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > BufferCapacity ? head - BufferCapacity : 0;
+        events.clear();
+        for(uint64_t i = begin; i < head; i++) {
+            events.push_back(buffer->events[i & (BufferCapacity - 1)]);
+        }
+        uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+        uint64_t valid   = newHead >= BufferCapacity ? newHead - BufferCapacity + 1 : 0;
+        std::size_t skip = valid > begin ? std::min<uint64_t>(valid - begin, events.size()) : 0;
+
+        os << (first ? "\n" : ",\n")
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+           << ",\"args\":{\"name\":\"thread " << buffer->threadId << "\"}}";
+        first = false;
+        char stampStr[32];
+        for(std::size_t i = skip; i < events.size(); i++) {
+            const auto& e = events[i];
+            std::snprintf(stampStr, sizeof(stampStr), "%.3f", 1.0e-3 * e.stamp);
+            os << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+               << "\",\"ts\":" << stampStr << ",\"pid\":1,\"tid\":" << buffer->threadId << "}";
+        }
+    }
+    os << "\n]}\n";
+}
+
+bool Tracer::write_chrome_trace(const std::string& filename) const
+{
+    std::ofstream f(filename);
+    if(!f.is_open()) {
+        std::cerr << "oculus::Tracer : could not open " << filename << std::endl;
+        return false;
+    }
+    this->write_chrome_trace(f);
+    return true;
+}
+
+} //namespace oculus
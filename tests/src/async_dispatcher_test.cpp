@@ -0,0 +1,121 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+using namespace std;
+
+#include <oculus_driver/AsyncDispatcher.h>
+#include <oculus_driver/Clock.h>
+using namespace oculus;
+
+int main()
+{
+    AsyncDispatcher dispatcher(2);
+
+    // A slow subscriber (10ms per item) and a fast one, fed at 400Hz.
+    uint64_t lastSlow = 0, lastFast = 0;
+    bool ordered = true;
+    auto slow = dispatcher.make_channel<uint64_t>([&](const uint64_t& v) {
+        if(v <= lastSlow) ordered = false;
+        lastSlow = v;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }, DropPolicy::DropOldest, 4);
+    auto fast = dispatcher.make_channel<uint64_t>([&](const uint64_t& v) {
+        if(v <= lastFast) ordered = false;
+        lastFast = v;
+    }, DropPolicy::DropNewest, 64);
+
+    Clock clock;
+    double maxPushTime = 0.0;
+    for(uint64_t i = 1; i <= 400; i++) {
+        clock.reset();
+        slow->push(i);
+        fast->push(i);
+        maxPushTime = std::max(maxPushTime, clock.now());
+        std::this_thread::sleep_for(std::chrono::microseconds(2500));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    slow->close();
+    fast->close();
+
+    auto slowStats = slow->stats();
+    auto fastStats = fast->stats();
+    cout << "slow : pushed " << slowStats.pushed << ", processed " << slowStats.processed
+         << ", dropped " << slowStats.dropped << endl;
+    cout << "fast : pushed " << fastStats.pushed << ", processed " << fastStats.processed
+         << ", dropped " << fastStats.dropped << endl;
+    cout << "max push time : " << 1.0e6*maxPushTime << "us" << endl;
+
+    // close() waits for a callback running on a worker thread.
+    std::atomic<bool> inCallback(false);
+    bool closedWhileRunning = false;
+    auto blocking = dispatcher.make_channel<uint64_t>([&](const uint64_t&) {
+        inCallback = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        inCallback = false;
+    });
+    blocking->push(1);
+    while(!inCallback) std::this_thread::yield();
+    blocking->close();
+    closedWhileRunning = inCallback;
+    blocking = nullptr;
+
+    // Channels are refused at creation once the dispatcher is full, not when
+    // they are scheduled.
+    AsyncDispatcher small(1, 4);
+    std::vector<DispatchChannel<uint64_t>::Ptr> channels;
+    bool refused = false;
+    try {
+        for(std::size_t i = 0; i <= small.max_channels(); i++) {
+            channels.push_back(small.make_channel<uint64_t>([](const uint64_t&) {}));
+        }
+    }
+    catch(const std::runtime_error&) {
+        refused = true;
+    }
+    for(auto& channel : channels) {
+        channel->push(1);
+    }
+    for(auto& channel : channels) {
+        channel->close();
+    }
+    const std::size_t fullCount = channels.size();
+    channels.clear();
+    small.stop(); // the workers release their last reference
+    cout << "channels : " << fullCount << " / " << small.max_channels()
+         << (refused ? ", refused" : "") << endl;
+    if(closedWhileRunning || !refused || fullCount != small.max_channels()
+       || small.channel_count() != 0)
+    {
+        cerr << "AsyncDispatcher channel test failed" << endl;
+        return -1;
+    }
+
+    if(!ordered || fastStats.processed != 400 || slowStats.dropped == 0
+       || slowStats.processed + slowStats.dropped != 400)
+    {
+        cerr << "AsyncDispatcher test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
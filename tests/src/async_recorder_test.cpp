@@ -0,0 +1,129 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+using namespace std;
+
+#include <oculus_driver/AsyncRecorder.h>
+using namespace oculus;
+
+Message::ConstPtr make_message(unsigned int index)
+{
+    std::vector<uint8_t> data(sizeof(OculusMessageHeader) + 1000 + index % 100);
+    OculusMessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageDummy;
+    header.payloadSize = data.size() - sizeof(header);
+    std::memcpy(data.data(), &header, sizeof(header));
+    for(std::size_t i = sizeof(header); i < data.size(); i++) {
+        data[i] = (uint8_t)(index + i);
+    }
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(1000 + 100*index)));
+}
+
+bool record_and_check(Codec codec)
+{
+    const unsigned int count = 1000;
+    {
+        // Small blocks to test the block rotation.
+        AsyncRecorder recorder(16*1024, 4);
+        recorder.set_compression(codec, DefaultCompressionLevel, 2);
+        recorder.open("async_recorder_test.oculus", true);
+        for(unsigned int i = 0; i < count; i++) {
+            while(recorder.write(make_message(i)) == 0) {
+                // All blocks full, waiting for the writer.
+                recorder.flush();
+            }
+        }
+        auto stats = recorder.stats();
+        cout << codec_name(codec) << " : dropped items : " << stats.droppedItems
+             << ", bytes pending : " << stats.bytesPending << endl;
+        recorder.close();
+        stats = recorder.stats();
+        cout << "written bytes : " << stats.writtenBytes;
+        if(codec != Codec::None) {
+            cout << ", " << stats.compression << ", last level : " << stats.compressionLevel;
+        }
+        cout << endl;
+    }
+
+    FileReader reader("async_recorder_test.oculus");
+    unsigned int readCount = 0;
+    bool ok = true;
+    while(auto msg = reader.read_next_message()) {
+        auto expected = make_message(readCount);
+        ok &= msg->data() == expected->data();
+        ok &= msg->timestamp() == expected->timestamp();
+        readCount++;
+    }
+    cout << "read " << readCount << " messages" << endl;
+    return ok && readCount == count;
+}
+
+bool check_no_overwrite()
+{
+    // The file was written by record_and_check, it must be left untouched
+    // when opened without force.
+    std::size_t messageCount = FileReader("async_recorder_test.oculus").message_count();
+    AsyncRecorder recorder;
+    try {
+        recorder.open("async_recorder_test.oculus");
+        cerr << "existing file was overwritten without force" << endl;
+        return false;
+    }
+    catch(const std::runtime_error& e) {
+        cout << "refused overwrite : " << e.what() << endl;
+    }
+    // Same behavior with the synchronous Recorder.
+    Recorder syncRecorder;
+    try {
+        syncRecorder.open("async_recorder_test.oculus");
+        cerr << "existing file was overwritten without force (Recorder)" << endl;
+        return false;
+    }
+    catch(const std::runtime_error& e) {
+        cout << "refused overwrite (Recorder) : " << e.what() << endl;
+    }
+    return !recorder.is_open() && !syncRecorder.is_open()
+        && FileReader("async_recorder_test.oculus").message_count() == messageCount;
+}
+
+int main()
+{
+    bool ok = record_and_check(Codec::None);
+    ok &= check_no_overwrite();
+
+    // The default blocks absorb a BufferDuration stall at MaxDataRate, with
+    // one block held by the writer.
+    ok &= AsyncRecorder::block_size_for(AsyncRecorder::BufferDuration)
+        * (AsyncRecorder::DefaultBlockCount - 1)
+        >= AsyncRecorder::BufferDuration * AsyncRecorder::MaxDataRate;
+    if(codec_available(Codec::QCompress)) {
+        ok &= record_and_check(Codec::QCompress);
+    }
+
+    if(!ok) {
+        cerr << "AsyncRecorder test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
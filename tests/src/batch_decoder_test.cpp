@@ -0,0 +1,149 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+using namespace std;
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/BatchDecoder.h>
+#include <oculus_driver/Compression.h>
+#include <oculus_driver/helpers.h>
+using namespace oculus;
+
+// 8 bits V2 ping with gains
+Message::ConstPtr make_ping(unsigned int index)
+{
+    const uint16_t nBeams = 256, nRanges = 512;
+    std::size_t metadataSize = sizeof(OculusSimplePingResult2) + nBeams*sizeof(int16_t);
+    std::size_t step = nBeams + 4;
+    std::vector<uint8_t> data(metadataSize + step*nRanges);
+
+    OculusSimplePingResult2 ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = 2;
+    header.payloadSize = data.size() - sizeof(header);
+    ping.fireMessage.flags = 0x4;
+    ping.pingId      = index;
+    ping.dataSize    = dataSize8Bit;
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = step*nRanges;
+    ping.messageSize = data.size();
+    std::memcpy(data.data(), &ping, sizeof(ping));
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint8_t* line = data.data() + metadataSize + r*step;
+        uint32_t gain = 1 + r;
+        std::memcpy(line, &gain, sizeof(gain));
+        for(unsigned int b = 0; b < nBeams; b++) {
+            line[4 + b] = (uint8_t)(index + r + b);
+        }
+    }
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(100*index)));
+}
+
+int main()
+{
+    const unsigned int count = 300;
+    const std::string filename = "batch_decoder_test.oculus";
+    {
+        Recorder recorder;
+        recorder.open(filename, true);
+        for(unsigned int i = 0; i < count; i++) {
+            recorder.write(make_ping(i));
+        }
+    }
+
+    bool ok = true;
+
+    // parallel_for covers the whole range exactly once
+    ThreadPool pool(4);
+    std::vector<int> hits(100000, 0);
+    pool.parallel_for(0, hits.size(), [&](std::size_t first, std::size_t last) {
+        for(auto i = first; i < last; i++) hits[i]++;
+    });
+    for(auto h : hits) ok &= h == 1;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::vector<float>> reference;
+    {
+        FileReader reader(filename);
+        while(auto ping = reader.read_next_ping()) {
+            reference.push_back(get_ping_acoustic_data(ping->data()));
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::size_t decoded = 0;
+    BatchDecoder decoder(filename, pool, 32);
+    decoder.decode([&](const DecodedPing& ping) {
+        ok &= ping.index == decoded && ping.ping->ping_index() == decoded;
+        ok &= ping.data == reference[decoded];
+        decoded++;
+    });
+    auto t2 = std::chrono::steady_clock::now();
+    ok &= decoded == count && reference.size() == count;
+
+    cout << "sequential : " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+         << "ms, batch (" << pool.thread_count() << " threads) : "
+         << std::chrono::duration<double, std::milli>(t2 - t1).count() << "ms" << endl;
+
+    std::vector<DecodedPing> all;
+    ok &= BatchDecoder(filename, pool).decode_to(std::back_inserter(all)) == count;
+    ok &= all.size() == count && all.back().data == reference.back();
+
+    // Compressed pings with other messages in between : the ranges of the
+    // workers start at positions given by the index.
+    if(codec_available(Codec::QCompress)) {
+        const std::string compressedFilename = "batch_decoder_test_compressed.oculus";
+        {
+            Recorder recorder;
+            recorder.open(compressedFilename, true);
+            recorder.set_compression(Codec::QCompress);
+            for(unsigned int i = 0; i < count; i++) {
+                if(i % 7 == 0) {
+                    OculusMessageHeader header;
+                    std::memset(&header, 0, sizeof(header));
+                    header.oculusId = OCULUS_CHECK_ID;
+                    header.msgId    = messageDummy;
+                    recorder.write(Message::Create(sizeof(header), (const uint8_t*)&header));
+                }
+                recorder.write(make_ping(i));
+            }
+        }
+        decoded = 0;
+        BatchDecoder(compressedFilename, pool, 50).decode([&](const DecodedPing& ping) {
+            ok &= ping.index == decoded && ping.data == reference[decoded];
+            decoded++;
+        });
+        ok &= decoded == count;
+    }
+
+    if(!ok) {
+        cerr << "BatchDecoder test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <memory>
+using namespace std;
+
+#include <oculus_driver/CallbackQueue.h>
+using namespace oculus;
+
+// Counting heap allocations to check call() does not allocate.
+static std::atomic<size_t> allocationCount(0);
+
+void* operator new(std::size_t size)
+{
+    allocationCount++;
+    if(void* p = std::malloc(size)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+int main()
+{
+    CallbackQueue<int> queue;
+    std::atomic<long> sum(0);
+    for(int i = 0; i < 4; i++) {
+        queue.add_callback([&](int v) { sum += v; });
+    }
+
+    const int callCount = 1000000;
+    size_t allocBefore = allocationCount;
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i = 0; i < callCount; i++) {
+        queue.call(1);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    size_t allocations = allocationCount - allocBefore;
+
+    cout << "call() duration    : "
+         << std::chrono::duration<double, std::nano>(t1 - t0).count() / callCount
+         << " ns" << endl;
+    cout << "call() allocations : " << allocations << endl;
+
+    // Adding and removing callbacks while another thread is calling. Each
+    // list holds a copy of token : the replaced lists must be freed while the
+    // calls go on (only the current list and the one being called remain).
+    auto token = std::make_shared<int>(0);
+    queue.add_callback([token](int) {});
+    std::atomic<bool> running(true);
+    std::thread caller([&]() { while(running) queue.call(1); });
+    for(int i = 0; i < 10000; i++) {
+        auto id = queue.add_callback([&](int v) { sum += v; });
+        queue.remove_callback(id);
+    }
+    long liveLists = token.use_count() - 1;
+    running = false;
+    caller.join();
+    cout << "live callback lists : " << liveLists << endl;
+
+    // Single shots are still called.
+    std::thread singleShotCaller([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        queue.call(1);
+    });
+    bool called = queue.add_single_shot([](int) {}, 1000);
+    singleShotCaller.join();
+    cout << "single shot called : " << called << endl;
+
+    if(allocations != 0 || sum < 4*callCount || !called || liveLists > 2) {
+        cerr << "CallbackQueue test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
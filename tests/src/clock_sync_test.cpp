@@ -0,0 +1,72 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <random>
+#include <cmath>
+using namespace std;
+
+#include <oculus_driver/ClockSync.h>
+using namespace oculus;
+
+int main()
+{
+    // Simulating a sonar clock in microseconds on 32 bits (wrapping), with a
+    // 50ppm drift, received with an exponential network / scheduling jitter
+    // (mean 5ms) and a few large outliers.
+    ClockSync sync(200, 3.0, 10, 4294967296.0);
+
+    std::mt19937 gen(0);
+    std::exponential_distribution<double> jitter(1.0 / 0.005);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    auto hostOrigin = ClockSync::TimeSource::now();
+    double sonarOrigin = 4294967296.0 - 2.0e6; // wrapping after 2s
+    double maxError = 0.0;
+    for(int i = 0; i < 2000; i++) {
+        double t = 0.025 * i; // 40Hz
+        double sonarTime = std::fmod(sonarOrigin + 1.0e6 * t * (1.0 + 50.0e-6),
+                                     4294967296.0);
+        double delay = 0.002 + jitter(gen);
+        if(uniform(gen) < 0.02) delay += 0.2; // outlier
+        auto hostStamp = hostOrigin + std::chrono::duration_cast<ClockSync::TimePoint::duration>(
+            std::chrono::duration<double>(t + delay));
+        sync.add_sample(sonarTime, hostStamp);
+
+        if(i > 400 && sync.valid()) {
+            double estimated = std::chrono::duration<double>(
+                sync.to_host_time(sonarTime) - hostOrigin).count();
+            // The constant part of the delay cannot be observed. Comparing to
+            // the true date plus the minimal delay.
+            maxError = std::max(maxError, std::abs(estimated - (t + 0.002)));
+        }
+    }
+
+    auto estimate = sync.estimate();
+    cout << "valid        : " << estimate.valid        << endl;
+    cout << "drift        : " << estimate.drift        << endl;
+    cout << "residual std : " << estimate.residualStd  << endl;
+    cout << "inliers      : " << estimate.inlierCount  << endl;
+    cout << "max error    : " << maxError              << "s" << endl;
+
+    if(!estimate.valid || maxError > 0.0005) {
+        cerr << "ClockSync test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+using namespace std;
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/MappedFileReader.h>
+#include <oculus_driver/Compression.h>
+using namespace oculus;
+
+// 8 bits V2 ping with a smooth (compressible) image and some noise.
+Message::ConstPtr make_ping(unsigned int index)
+{
+    const uint16_t nBeams = 512, nRanges = 400;
+    std::size_t metadataSize = sizeof(OculusSimplePingResult2) + nBeams*sizeof(int16_t);
+    std::vector<uint8_t> data(metadataSize + nBeams*nRanges);
+
+    OculusSimplePingResult2 ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = 2;
+    header.payloadSize = data.size() - sizeof(header);
+    ping.pingId      = index;
+    ping.dataSize    = dataSize8Bit;
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = nBeams*nRanges;
+    std::memcpy(data.data(), &ping, sizeof(ping));
+    uint32_t seed = index;
+    for(unsigned int r = 0; r < nRanges; r++) {
+        for(unsigned int b = 0; b < nBeams; b++) {
+            seed = 1664525*seed + 1013904223;
+            float v = 40.0f*std::exp(-0.01f*r) * (1.0f + std::sin(0.05f*b + 0.1f*index));
+            data[metadataSize + r*nBeams + b] = (uint8_t)(v + (seed >> 29));
+        }
+    }
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(100*index)));
+}
+
+template <class ReaderT>
+bool check_file(const std::string& filename, unsigned int count)
+{
+    ReaderT reader(filename);
+    unsigned int readCount = 0;
+    bool ok = true;
+    while(auto msg = reader.read_next_message()) {
+        auto expected = make_ping(readCount);
+        ok &= msg->data() == expected->data() && msg->timestamp() == expected->timestamp();
+        readCount++;
+    }
+    return ok && readCount == count;
+}
+
+int main()
+{
+    const unsigned int count = 20;
+    bool ok = true;
+
+    for(auto codec : {Codec::None, Codec::QCompress, Codec::LZ4, Codec::Zstd}) {
+        if(!codec_available(codec)) {
+            cout << codec_name(codec) << " : not available" << endl;
+            try {
+                Recorder().set_compression(codec);
+                ok = false;
+            }
+            catch(const std::runtime_error&) {}
+            continue;
+        }
+
+        std::string filename = std::string("compression_test_") + codec_name(codec) + ".oculus";
+        Recorder recorder;
+        recorder.open(filename, true);
+        recorder.set_compression(codec);
+        auto t0 = std::chrono::steady_clock::now();
+        for(unsigned int i = 0; i < count; i++) {
+            recorder.write(make_ping(i));
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        recorder.close();
+
+        bool fileOk = check_file<FileReader>(filename, count)
+                   && check_file<MappedFileReader>(filename, count);
+        cout << codec_name(codec) << " : " << recorder.compression_stats()
+             << ", " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+             << "ms" << (fileOk ? "" : " (read failed)") << endl;
+        ok &= fileOk;
+        if(codec != Codec::None) {
+            ok &= recorder.compression_stats().ratio() > 1.5;
+        }
+    }
+
+    if(codec_available(Codec::QCompress)) {
+        // Qt format : big-endian uncompressed size first
+        std::vector<uint8_t> src(1000, 7), dst;
+        ok &= compress(Codec::QCompress, src.data(), src.size(), dst);
+        ok &= dst[0] == 0 && dst[1] == 0 && dst[2] == 0x03 && dst[3] == 0xe8;
+        std::vector<uint8_t> res(src.size());
+        ok &= decompress(Codec::QCompress, dst.data(), dst.size(), res.data(), res.size());
+        ok &= res == src;
+        ok &= !decompress(Codec::QCompress, dst.data(), dst.size() / 2, res.data(), res.size());
+    }
+
+    if(!ok) {
+        cerr << "Compression test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
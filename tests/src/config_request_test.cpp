@@ -0,0 +1,81 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <future>
+#include <memory>
+using namespace std;
+
+#include <oculus_driver/AsyncService.h>
+#include <oculus_driver/SonarDriver.h>
+using namespace oculus;
+
+// Checks that the request failed with an Exception.
+template <class Exception>
+bool fails_with(std::future<SonarDriver::PingConfig>& future, const char* name)
+{
+    if(future.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+        cerr << name << " : request still pending" << endl;
+        return false;
+    }
+    try {
+        future.get();
+    }
+    catch(const Exception& e) {
+        cout << name << " : " << e.what() << endl;
+        return true;
+    }
+    catch(const std::exception& e) {
+        cerr << name << " : unexpected exception : " << e.what() << endl;
+        return false;
+    }
+    cerr << name << " : request succeeded" << endl;
+    return false;
+}
+
+int main()
+{
+    bool ok = true;
+    auto request = default_ping_config();
+
+    // No sonar connected : the request fails without waiting for the deadline.
+    {
+        AsyncService service;
+        SonarDriver driver(service.io_service());
+        service.start();
+        auto future = driver.request_ping_config_async(request);
+        ok &= fails_with<ConfigRequestSendError>(future, "not connected");
+        service.stop();
+    }
+
+    // The driver is destroyed while the request is pending (the io_service
+    // did not even start it).
+    {
+        AsyncService service;
+        auto driver = std::make_unique<SonarDriver>(service.io_service());
+        auto future = driver->request_ping_config_async(request);
+        driver = nullptr;
+        ok &= fails_with<ConfigRequestCancelled>(future, "driver destroyed");
+    }
+
+    if(!ok) {
+        cerr << "Config request test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -53,6 +53,20 @@ int main()
     //sonar.request_fire_config(default_fire_config());
     //sonar.request_fire_config(default_fire_config());
 
+    // Non-blocking config request, the loop below keeps running meanwhile.
+    auto request = default_ping_config();
+    request.gainPercent = 60.0;
+    auto feedback = sonar.request_ping_config_async(request);
+    while(feedback.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+        cout << "Waiting for config feedback..." << endl;
+    }
+    try {
+        cout << "Got config feedback, gain : " << feedback.get().gainPercent << endl;
+    }
+    catch(const ConfigRequestTimeout& e) {
+        cout << e.what() << endl;
+    }
+
     getchar();
 
     ioService.stop();
@@ -0,0 +1,200 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+#include <oculus_driver/FanRenderer.h>
+#include <oculus_driver/helpers.h>
+using namespace oculus;
+
+// 16 bits V2 ping without gains, with bearings denser at the center (as the
+// real sonars). Data value is 100*rangeIndex + bearingIndex.
+Message::ConstPtr make_ping(unsigned int index, double range = 40.0)
+{
+    const uint16_t nBeams = 256, nRanges = 512;
+    std::size_t metadataSize = sizeof(OculusSimplePingResult2) + nBeams*sizeof(int16_t);
+    std::vector<uint8_t> data(metadataSize + 2*nBeams*nRanges);
+
+    OculusSimplePingResult2 ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = 2;
+    header.payloadSize = data.size() - sizeof(header);
+    ping.fireMessage.flags        = 0x2;
+    ping.fireMessage.rangePercent = range;
+    ping.pingId      = index;
+    ping.dataSize    = dataSize16Bit;
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = 2*nBeams*nRanges;
+    ping.messageSize = data.size();
+    std::memcpy(data.data(), &ping, sizeof(ping));
+
+    auto bearings = (int16_t*)(data.data() + sizeof(ping));
+    for(unsigned int b = 0; b < nBeams; b++) {
+        // +- 65 degrees, in hundredth of degrees
+        bearings[b] = std::round(6500.0 * std::sin((M_PI / 2.0) * (2.0*b / (nBeams - 1) - 1.0)));
+    }
+    auto pingData = (uint16_t*)(data.data() + metadataSize);
+    for(unsigned int r = 0; r < nRanges; r++) {
+        for(unsigned int b = 0; b < nBeams; b++) {
+            pingData[nBeams*r + b] = 100*r + b + index;
+        }
+    }
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(100*index)));
+}
+
+int main()
+{
+    bool ok = true;
+    FanRenderer renderer(1024);
+    std::vector<float> image, reference;
+
+    auto ping = make_ping(0);
+    auto metadata = *reinterpret_cast<const OculusSimplePingResult2*>(ping->data().data());
+    auto shape    = renderer.render(ping->data(), image);
+    auto refShape = image_from_ping_data(metadata, ping->data(), reference);
+    cout << "image size : " << shape.first << "x" << shape.second << endl;
+    ok &= shape == refShape && image.size() == reference.size();
+
+    // Center column : bearing 0 (beam 127 or 128), range decreasing with rows.
+    auto bearings = get_ping_bearings(ping->data());
+    unsigned int centerBeam = std::abs(bearings[127]) < std::abs(bearings[128]) ? 127 : 128;
+    unsigned int width = shape.first, height = shape.second;
+    for(unsigned int h = 0; h < height; h++) {
+        float r = 40.0f * (height - 1 - h) / (height - 1);
+        float expected = 100*std::lround(511 * r / 40.0f) + centerBeam;
+        ok &= image[width*h + width / 2] == expected;
+    }
+    // Corners are outside of the fan.
+    ok &= image[0] == 0.0f && image[width - 1] == 0.0f && image[width*height - 1] == 0.0f;
+
+    // Rendering other pings with the same geometry reuses the pixel map.
+    const unsigned int count = 100;
+    std::vector<Message::ConstPtr> pings;
+    for(unsigned int i = 0; i < count; i++) {
+        pings.push_back(make_ping(i + 1));
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    for(const auto& p : pings) {
+        renderer.render(p->data(), image);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    auto t2 = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < 10; i++) {
+        image_from_ping_data(metadata, pings[i]->data(), reference);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    cout << "FanRenderer : "
+         << std::chrono::duration<double, std::milli>(t1 - t0).count() / count
+         << "ms per ping, image_from_ping_data : "
+         << std::chrono::duration<double, std::milli>(t3 - t2).count() / 10
+         << "ms per ping" << endl;
+    ok &= renderer.map_updates() == 1;
+    ok &= image[width*(height - 1) + width / 2] == 100 + centerBeam;
+
+    // A new range invalidates the pixel map.
+    renderer.render(make_ping(0, 20.0)->data(), image);
+    ok &= renderer.map_updates() == 2 && renderer.geometry().range == 20.0;
+
+    // The data is linear in range and bearing index, the bilinear
+    // interpolation gives it back (up to the weights precision) inside of the
+    // fan, Lanczos2 very nearly.
+    for(auto mode : {Interpolation::Bilinear, Interpolation::Lanczos2}) {
+        FanRenderer interpolated(1024, mode);
+        interpolated.render(ping->data(), image);
+        double maxError = 0.0;
+        for(unsigned int h = 0; h < height - 4; h++) {
+            float x = 40.0f * (height - 1 - h) / (height - 1);
+            for(unsigned int w = 0; w < width; w++) {
+                float y = 40.0f * (w - 0.5f*width) / (height - 1);
+                float range = std::sqrt(x*x + y*y), bearing = std::atan2(y, x);
+                if(range > 39.0f || bearing < bearings[2] || bearing > bearings[253]) continue;
+                auto it = std::upper_bound(bearings.begin(), bearings.end(), bearing);
+                unsigned int b1 = it - bearings.begin();
+                float bearingPos = b1 - 1 + (bearing - bearings[b1 - 1])
+                                          / (bearings[b1] - bearings[b1 - 1]);
+                float expected = 100.0f * 511 * range / 40.0f + bearingPos;
+                maxError = std::max<double>(maxError, std::abs(image[width*h + w] - expected));
+            }
+        }
+        ok &= maxError < (mode == Interpolation::Bilinear ? 0.1 : 5.0); // lanczos : 5% of a range step
+        ok &= image[0] == 0.0f && image[width - 1] == 0.0f;
+
+        auto t0 = std::chrono::steady_clock::now();
+        for(const auto& p : pings) {
+            interpolated.render(p->data(), image);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        cout << (mode == Interpolation::Bilinear ? "bilinear" : "lanczos2")
+             << " : " << std::chrono::duration<double, std::milli>(t1 - t0).count() / count
+             << "ms per ping, max error : " << maxError << endl;
+    }
+
+    // Rendering on a thread pool gives the same images.
+    ThreadPool pool(4);
+    ok &= get_ping_acoustic_data(ping->data(), &pool) == get_ping_acoustic_data(ping->data());
+    for(auto mode : {Interpolation::Nearest, Interpolation::Bilinear, Interpolation::Lanczos2}) {
+        FanRenderer serial(3840, mode), parallel(3840, mode);
+        parallel.set_thread_pool(&pool);
+        serial.render(ping->data(), reference);
+        parallel.render(ping->data(), image);
+        ok &= image == reference;
+
+        auto t0 = std::chrono::steady_clock::now();
+        for(unsigned int i = 0; i < 10; i++) {
+            serial.render(pings[i]->data(), reference);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for(unsigned int i = 0; i < 10; i++) {
+            parallel.render(pings[i]->data(), image);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        cout << "3840px, mode " << (int)mode << " : "
+             << std::chrono::duration<double, std::milli>(t1 - t0).count() / 10
+             << "ms per ping, with " << pool.thread_count() << " threads : "
+             << std::chrono::duration<double, std::milli>(t2 - t1).count() / 10
+             << "ms per ping" << endl;
+        ok &= image == reference;
+    }
+
+    // truncated ping
+    try {
+        renderer.render(MessageData(ping->data().data(), ping->data().size() - 1), image);
+        cerr << "Truncated ping rendered" << endl;
+        ok = false;
+    }
+    catch(const std::runtime_error&) {}
+
+    if(!ok) {
+        cerr << "FanRenderer test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+using namespace std;
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/MappedFileReader.h>
+#include <oculus_driver/FileIndex.h>
+using namespace oculus;
+
+Message::TimePoint stamp_of(unsigned int index)
+{
+    return Message::TimePoint(std::chrono::milliseconds(1000000 + 100*index));
+}
+
+// 8 bits V2 ping without gains (every 10th message is a dummy message).
+Message::ConstPtr make_message(unsigned int index)
+{
+    const uint16_t nBeams = 256, nRanges = 200;
+    std::size_t metadataSize = sizeof(OculusSimplePingResult2) + nBeams*sizeof(int16_t);
+    std::vector<uint8_t> data(metadataSize + nBeams*nRanges);
+
+    OculusSimplePingResult2 ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.payloadSize = data.size() - sizeof(header);
+    if(index % 10 == 9) {
+        header.msgId = messageDummy;
+        data.resize(sizeof(header));
+        header.payloadSize = 0;
+    }
+    else {
+        header.msgId      = messageSimplePingResult;
+        header.msgVersion = 2;
+        ping.fireMessage.masterMode   = 1 + index % 2;
+        ping.fireMessage.rangePercent = 10.0 + index % 7;
+        ping.pingId      = 5000 + index;
+        ping.dataSize    = dataSize8Bit;
+        ping.nBeams      = nBeams;
+        ping.nRanges     = nRanges;
+        ping.imageOffset = metadataSize;
+        ping.imageSize   = nBeams*nRanges;
+        ping.messageSize = data.size();
+    }
+    std::memcpy(data.data(), &ping, std::min(sizeof(ping), data.size()));
+    return Message::Create(data.size(), data.data(), stamp_of(index));
+}
+
+template <class ReaderT>
+bool check_seeks(ReaderT& reader, const char* name)
+{
+    bool ok = true;
+    // forward and backward jumps
+    for(unsigned int target : {1500u, 10u, 1999u, 0u, 1234u}) {
+        if(target % 10 == 9) continue;
+        ok &= reader.seek_to_ping(5000 + target);
+        auto ping = reader.read_next_ping();
+        ok &= ping && ping->ping_index() == 5000 + target
+                   && ping->timestamp() == stamp_of(target);
+
+        ok &= reader.seek_to_time(stamp_of(target) + std::chrono::milliseconds(50));
+        auto msg = reader.read_next_message();
+        ok &= msg && msg->timestamp() == stamp_of(target + 1);
+    }
+    ok &= !reader.seek_to_ping(4000);
+    ok &= !reader.seek_to_time(stamp_of(10000));
+    ok &= reader.seek_to_message(reader.message_count() - 1);
+    ok &= reader.read_next_message() && !reader.read_next_message();
+    if(!ok) {
+        cerr << name << " : seek failed" << endl;
+    }
+    return ok;
+}
+
+int main()
+{
+    const unsigned int count = 2000;
+    const std::string filename = "file_index_test.oculus";
+    {
+        Recorder recorder;
+        recorder.open(filename, true);
+        for(unsigned int i = 0; i < count; i++) {
+            recorder.write(make_message(i));
+        }
+    }
+    std::remove(FileIndex::sidecar_filename(filename).c_str());
+
+    bool ok = true;
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto index = FileIndex::load_or_build(filename);
+    auto t1 = std::chrono::steady_clock::now();
+    auto loaded = FileIndex::load_or_build(filename);
+    auto t2 = std::chrono::steady_clock::now();
+    cout << "build : " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+         << "ms, load : " << std::chrono::duration<double, std::milli>(t2 - t1).count()
+         << "ms" << endl;
+
+    ok &= index->message_count() == count;
+    ok &= index->ping_count() == count - count / 10;
+    ok &= loaded->message_count() == count
+       && std::memcmp(loaded->entries().data(), index->entries().data(),
+                      count*sizeof(FileIndex::Entry)) == 0;
+    const auto& entry = (*index)[index->find_ping(5003)];
+    ok &= entry.masterMode == 2 && entry.range == 13.0f
+       && entry.nBeams == 256 && entry.nRanges == 200;
+    if(!ok) {
+        cerr << "FileIndex : invalid index" << endl;
+    }
+
+    FileReader reader(filename);
+    ok &= check_seeks(reader, "FileReader");
+    MappedFileReader mappedReader(filename);
+    ok &= check_seeks(mappedReader, "MappedFileReader");
+
+    // The sidecar is rebuilt if the file changed.
+    {
+        Recorder recorder;
+        recorder.open(filename, true);
+        for(unsigned int i = 0; i < 10; i++) {
+            recorder.write(make_message(i));
+        }
+    }
+    ok &= !loaded->matches(filename);
+    ok &= FileReader(filename).message_count() == 10;
+
+    if(!ok) {
+        cerr << "FileIndex test failed" << endl;
+        return -1;
+    }
+    cout << "ok" << endl;
+    return 0;
+}
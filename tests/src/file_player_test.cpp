@@ -0,0 +1,161 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+using namespace std;
+
+#include <oculus_driver/AsyncService.h>
+#include <oculus_driver/SonarDriver.h>
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/FilePlayer.h>
+using namespace oculus;
+
+// V1 pings 100ms apart, the gain changes every 10 pings.
+Message::ConstPtr make_ping(unsigned int index)
+{
+    const uint16_t nBeams = 256, nRanges = 100;
+    std::size_t metadataSize = sizeof(OculusSimplePingResult) + nBeams*sizeof(int16_t);
+    std::vector<uint8_t> data(metadataSize + nBeams*nRanges);
+
+    OculusSimplePingResult ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = 1;
+    header.payloadSize = data.size() - sizeof(header);
+    ping.fireMessage.masterMode  = 1;
+    ping.fireMessage.range       = 10.0;
+    ping.fireMessage.gainPercent = 10.0*(index / 10);
+    ping.pingId      = index;
+    ping.dataSize    = dataSize8Bit;
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = nBeams*nRanges;
+    std::memcpy(data.data(), &ping, sizeof(ping));
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(100*index)));
+}
+
+int main()
+{
+    const int count = 50;
+    const std::string filename = "file_player_test.oculus";
+    {
+        Recorder recorder;
+        recorder.open(filename, true);
+        for(int i = 0; i < count; i++) {
+            recorder.write(make_ping(i));
+        }
+    }
+
+    AsyncService service;
+    SonarDriver driver(service.io_service()); // no sonar attached
+    std::atomic<int>  pingCount(0);
+    std::atomic<int>  configCount(0);
+    std::atomic<bool> inOrder(true);
+    std::atomic<int>  lastPingId(-1);
+    driver.add_ping_callback([&](const PingMessage::ConstPtr& ping) {
+        if((int)ping->ping_index() <= lastPingId) inOrder = false;
+        lastPingId = ping->ping_index();
+        pingCount++;
+    });
+    driver.add_config_callback([&](const SonarDriver::PingConfig&, const SonarDriver::PingConfig&) {
+        configCount++;
+    });
+    service.start();
+
+    bool ok = true;
+    {
+        FilePlayer player(driver, filename);
+        std::atomic<bool> ended(false);
+        player.set_end_callback([&]() { ended = true; });
+
+        // 5 seconds of data played at 10x
+        player.set_speed(10.0);
+        auto t0 = std::chrono::steady_clock::now();
+        player.play();
+        while(!ended && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(5)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        cout << "played " << pingCount << " pings in " << duration << "s at 10x, "
+             << configCount << " config changes" << endl;
+        ok &= pingCount == count && inOrder && player.finished();
+        ok &= duration > 0.45 && duration < 1.0;
+        ok &= configCount >= 4;
+
+        // pause / seek / play
+        pingCount  = 0;
+        lastPingId = 19;
+        ended      = false;
+        ok &= player.seek_to_ping(20);
+        player.set_speed(1.0);
+        player.play();
+        std::this_thread::sleep_for(std::chrono::milliseconds(350));
+        player.pause();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        int paused = pingCount;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        cout << "played " << paused << " pings before pause" << endl;
+        ok &= paused >= 3 && paused <= 5 && pingCount == paused && inOrder;
+        ok &= !player.seek_to_ping(1000);
+
+        // as fast as possible, with loop
+        pingCount = 0;
+        lastPingId = -1;
+        player.set_loop(true);
+        player.set_speed(0.0);
+        player.rewind();
+        player.play();
+        t0 = std::chrono::steady_clock::now();
+        while(pingCount < 3*count && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(5)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        cout << "looped " << pingCount << " pings" << endl;
+        ok &= pingCount >= 3*count && !ended;
+        // destroyed while playing
+    }
+    service.stop();
+
+    // Destroyed while the io_service is stopped : the handlers still queued
+    // must not touch the player when the io_service runs again.
+    pingCount = 0;
+    {
+        FilePlayer player(driver, filename);
+        player.set_speed(0.0);
+        player.play();
+        player.seek_to_message(10);
+    }
+    service.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    service.stop();
+    ok &= pingCount == 0;
+
+    if(!ok) {
+        cerr << "FilePlayer test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+#include <oculus_driver/GainKernels.h>
+#include <oculus_driver/helpers.h>
+using namespace oculus;
+
+// V2 ping with gains, more beams than ranges, sample value (r + 3*b) % 251.
+template <typename SampleT>
+Message::ConstPtr make_ping(uint16_t nBeams, uint16_t nRanges)
+{
+    std::size_t metadataSize = sizeof(OculusSimplePingResult2) + nBeams*sizeof(int16_t);
+    std::size_t rowSize = 4 + nBeams*sizeof(SampleT);
+    std::vector<uint8_t> data(metadataSize + rowSize*nRanges);
+
+    OculusSimplePingResult2 ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = 2;
+    header.payloadSize = data.size() - sizeof(header);
+    ping.fireMessage.flags = sizeof(SampleT) == 2 ? 0x6 : 0x4;
+    ping.dataSize    = sizeof(SampleT) == 2 ? dataSize16Bit : dataSize8Bit;
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = rowSize*nRanges;
+    ping.messageSize = data.size();
+    std::memcpy(data.data(), &ping, sizeof(ping));
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint8_t* row = data.data() + metadataSize + r*rowSize;
+        uint32_t gain = (r + 1)*(r + 1);
+        std::memcpy(row, &gain, sizeof(gain));
+        for(unsigned int b = 0; b < nBeams; b++) {
+            SampleT value = (r + 3*b) % 251;
+            std::memcpy(row + 4 + b*sizeof(SampleT), &value, sizeof(value));
+        }
+    }
+    return Message::Create(data.size(), data.data());
+}
+
+template <typename SampleT>
+bool check_layout()
+{
+    const uint16_t nBeams = 512, nRanges = 100;
+    auto ping = make_ping<SampleT>(nBeams, nRanges);
+    auto data = get_ping_acoustic_data(ping->data());
+    bool ok = data.size() == nBeams*nRanges;
+    for(unsigned int r = 0; r < nRanges; r++) {
+        for(unsigned int b = 0; b < nBeams; b++) {
+            ok &= data[nBeams*r + b] == (1.0f / (r + 1)) * ((r + 3*b) % 251);
+        }
+    }
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    std::vector<uint8_t>  src8(1 << 22);
+    std::vector<uint16_t> src16(1 << 22);
+    for(std::size_t i = 0; i < src8.size(); i++) {
+        src8[i]  = i * 2654435761u >> 24;
+        src16[i] = i * 2654435761u >> 16;
+    }
+    std::vector<float> reference8(src8.size()), reference16(src16.size()), dst(src8.size());
+    set_simd_level(SimdLevel::Scalar);
+    scale_to_float(src8.data(),  reference8.data(),  src8.size(),  0.37f);
+    scale_to_float(src16.data(), reference16.data(), src16.size(), 0.37f);
+
+    for(auto level : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2,
+                      SimdLevel::AVX512, SimdLevel::NEON})
+    {
+        if(!set_simd_level(level)) {
+            cout << simd_level_name(level) << " : not supported" << endl;
+            continue;
+        }
+        // all sizes and alignments around the vector widths
+        for(std::size_t offset = 0; offset < 4; offset++) {
+            for(std::size_t count = 0; count < 70; count++) {
+                std::fill(dst.begin(), dst.begin() + 80, -1.0f);
+                scale_to_float(src8.data() + offset, dst.data(), count, 0.37f);
+                ok &= std::equal(dst.begin(), dst.begin() + count, reference8.begin() + offset);
+                ok &= dst[count] == -1.0f;
+                scale_to_float(src16.data() + offset, dst.data(), count, 0.37f);
+                ok &= std::equal(dst.begin(), dst.begin() + count, reference16.begin() + offset);
+                ok &= dst[count] == -1.0f;
+            }
+        }
+        ok &= check_layout<uint8_t>() && check_layout<uint16_t>();
+
+        auto t0 = std::chrono::steady_clock::now();
+        for(int i = 0; i < 10; i++) {
+            scale_to_float(src8.data(), dst.data(), src8.size(), 0.37f);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for(int i = 0; i < 10; i++) {
+            scale_to_float(src16.data(), dst.data(), src16.size(), 0.37f);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        double samples = 10.0 * src8.size();
+        cout << simd_level_name(level)
+             << " : u8 " << 1.0e-6 * samples / std::chrono::duration<double>(t1 - t0).count()
+             << " Msamples/s, u16 " << 1.0e-6 * samples / std::chrono::duration<double>(t2 - t1).count()
+             << " Msamples/s" << endl;
+    }
+    ok &= set_simd_level(best_simd_level()) && simd_level() == best_simd_level();
+    cout << "using " << simd_level_name(simd_level()) << endl;
+
+    if(!ok) {
+        cerr << "GainKernels test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
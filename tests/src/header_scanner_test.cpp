@@ -0,0 +1,86 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <random>
+using namespace std;
+
+#include <oculus_driver/HeaderScanner.h>
+#include <oculus_driver/Clock.h>
+using namespace oculus;
+
+using ScannerFunction = std::size_t(*)(const uint8_t*, std::size_t, int);
+
+// Returns the positions of all the candidates found in data.
+std::vector<std::size_t> scan_all(ScannerFunction scan, const std::vector<uint8_t>& data,
+                                  int srcDeviceId)
+{
+    std::vector<std::size_t> res;
+    std::size_t pos = 0;
+    while(pos < data.size()) {
+        pos += scan(data.data() + pos, data.size() - pos, srcDeviceId);
+        if(data.size() - pos < (srcDeviceId < 0 ? 2 : 4))
+            break;
+        res.push_back(pos);
+        pos++;
+    }
+    return res;
+}
+
+int main()
+{
+    cout << "Selected implementation : " << header_scanner_implementation() << endl;
+
+    std::mt19937 gen(0);
+    std::vector<uint8_t> data(1 << 24);
+    for(auto& v : data) v = gen() % 80 + 0x20; // few random 0x53 0x4f
+    for(int i = 0; i < 100; i++) {
+        std::size_t pos = gen() % (data.size() - 4);
+        data[pos]     = 0x53; data[pos + 1] = 0x4f;
+        data[pos + 2] = 0x07; data[pos + 3] = 0x00;
+    }
+
+    std::vector<std::pair<const char*, ScannerFunction>> scanners = {
+        {"scalar", &detail::find_header_candidate_scalar},
+        #if defined(__x86_64__) || defined(__i386__)
+        {"sse2",   &detail::find_header_candidate_sse2},
+        {"avx2",   &detail::find_header_candidate_avx2},
+        #endif
+    };
+
+    auto reference = scan_all(scanners[0].second, data, -1);
+    auto reference7 = scan_all(scanners[0].second, data, 7);
+    for(auto& scanner : scanners) {
+        if(std::string(scanner.first) == "avx2" && !__builtin_cpu_supports("avx2"))
+            continue;
+        Clock clock;
+        std::size_t skipped = scanner.second(data.data(), data.size(), 0x1234);
+        double t = clock.interval();
+        cout << scanner.first << " : " << (data.size() / t) * 1.0e-9 << " GB/s ("
+             << skipped << " bytes skipped)" << endl;
+        if(scan_all(scanner.second, data, -1) != reference
+           || scan_all(scanner.second, data, 7) != reference7) {
+            cerr << "Mismatch with scalar implementation for " << scanner.first << endl;
+            return -1;
+        }
+    }
+    cout << "candidates : " << reference.size() << ", with device id : "
+         << reference7.size() << endl;
+    return 0;
+}
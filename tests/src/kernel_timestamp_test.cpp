@@ -0,0 +1,86 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+#include <oculus_driver/AsyncService.h>
+#include <oculus_driver/SonarDriver.h>
+#include <oculus_driver/SonarSimulator.h>
+using namespace oculus;
+
+int main()
+{
+    AsyncService simulatorService;
+    SonarSimulator simulator(simulatorService.io_service());
+    simulatorService.start();
+
+    AsyncService driverService;
+    SonarDriver driver(driverService.io_service());
+    if(!driver.enable_kernel_timestamps()) {
+        #ifdef __linux__
+        cerr << "Could not enable kernel timestamps" << endl;
+        return -1;
+        #else
+        cout << "Kernel timestamps not available, skipping" << endl;
+        return 0;
+        #endif
+    }
+
+    std::mutex mutex;
+    std::vector<std::pair<Message::TimePoint, Message::TimePoint>> stamps;
+    unsigned int missing = 0;
+    driver.add_message_callback([&](const Message::ConstPtr& msg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!msg->has_kernel_timestamp()) {
+            missing++;
+            return;
+        }
+        stamps.push_back(std::make_pair(msg->kernel_timestamp(), msg->timestamp()));
+    });
+    driverService.start();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    driverService.stop();
+    simulatorService.stop();
+
+    // The kernel stamp is taken when the data reaches the socket, before it
+    // is read by the io_service. It is never later than the user space
+    // stamp of the same message and the stamps follow the stream order.
+    bool ordered = true;
+    double maxDelay = 0.0;
+    for(std::size_t i = 0; i < stamps.size(); i++) {
+        auto delay = stamps[i].second - stamps[i].first;
+        if(delay.count() < 0) {
+            ordered = false;
+        }
+        maxDelay = std::max(maxDelay, std::chrono::duration<double>(delay).count());
+        if(i > 0 && stamps[i].first < stamps[i-1].first) {
+            ordered = false;
+        }
+    }
+    cout << "stamped messages : " << stamps.size() << ", missing : " << missing
+         << ", max kernel -> user delay : " << 1.0e6*maxDelay << "us" << endl;
+
+    if(stamps.size() < 5 || missing != 0 || !ordered || maxDelay > 1.0) {
+        cerr << "Kernel timestamp test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
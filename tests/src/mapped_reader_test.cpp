@@ -0,0 +1,114 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+using namespace std;
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/MappedFileReader.h>
+using namespace oculus;
+
+Message::ConstPtr make_message(unsigned int index, std::size_t size)
+{
+    std::vector<uint8_t> data(sizeof(OculusMessageHeader) + size + index % 100);
+    OculusMessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageDummy;
+    header.payloadSize = data.size() - sizeof(header);
+    std::memcpy(data.data(), &header, sizeof(header));
+    for(std::size_t i = sizeof(header); i < data.size(); i++) {
+        data[i] = (uint8_t)(index + i);
+    }
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(1000 + 100*index)));
+}
+
+int main()
+{
+    const unsigned int count = 500;
+    const std::size_t  size  = 128*1024; // about the size of a ping
+    {
+        Recorder recorder;
+        recorder.open("mapped_reader_test.oculus", true);
+        for(unsigned int i = 0; i < count; i++) {
+            recorder.write(make_message(i, size));
+        }
+    }
+
+    bool ok = true;
+    std::vector<std::pair<unsigned int, Message::ConstPtr>> kept;
+    {
+        MappedFileReader reader("mapped_reader_test.oculus");
+        FileReader       ref("mapped_reader_test.oculus");
+        unsigned int readCount   = 0;
+        unsigned int mappedCount = 0;
+        while(auto msg = reader.read_next_message()) {
+            auto expected = ref.read_next_message();
+            ok &= expected && msg->bytes() == expected->bytes();
+            ok &= msg->timestamp() == expected->timestamp();
+            // Unaligned items are copied.
+            ok &= reinterpret_cast<uintptr_t>(msg->bytes().data()) % MessageData::Alignment == 0;
+            if(msg->is_mapped()) {
+                if(mappedCount % 50 == 0) {
+                    kept.push_back(std::make_pair(readCount, msg));
+                }
+                mappedCount++;
+            }
+            readCount++;
+        }
+        ok &= readCount == count && mappedCount > 0 && !ref.read_next_message();
+        cout << "read " << readCount << " messages, "
+             << mappedCount << " mapped" << endl;
+    }
+    // The messages keep the mapping alive after the reader was destroyed.
+    for(const auto& k : kept) {
+        auto expected = make_message(k.first, size);
+        ok &= k.second->bytes() == expected->bytes();
+        ok &= k.second->data()  == expected->data(); // copied on first call
+        ok &= k.second->copy()->is_mapped();
+    }
+
+    // Read throughput (the file is in the page cache after the first read).
+    auto t0 = std::chrono::steady_clock::now();
+    std::size_t checksum = 0;
+    {
+        FileReader reader("mapped_reader_test.oculus");
+        while(auto msg = reader.read_next_message()) checksum += msg->bytes()[1000];
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    {
+        MappedFileReader reader("mapped_reader_test.oculus");
+        while(auto msg = reader.read_next_message()) checksum += msg->bytes()[1000];
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    cout << "FileReader       : "
+         << std::chrono::duration<double, std::milli>(t1 - t0).count() << "ms" << endl;
+    cout << "MappedFileReader : "
+         << std::chrono::duration<double, std::milli>(t2 - t1).count() << "ms" << endl;
+    cout << "(checksum " << checksum << ")" << endl;
+
+    if(!ok) {
+        cerr << "MappedFileReader test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <thread>
+using namespace std;
+
+#include <oculus_driver/MessagePool.h>
+using namespace oculus;
+
+int main()
+{
+    MessagePool pool(4);
+    cout << "capacity  : " << pool.capacity()  << endl;
+    cout << "available : " << pool.available() << endl;
+
+    // Keeping references on all the messages of the pool.
+    std::vector<Message::ConstPtr> kept;
+    for(int i = 0; i < 4; i++) {
+        kept.push_back(pool.acquire());
+    }
+    cout << "available after 4 acquire : " << pool.available() << endl;
+
+    // The pool is exhausted, this one is allocated outside of the pool.
+    auto extra = pool.acquire();
+    cout << "miss count : " << pool.miss_count() << endl;
+
+    // Releasing a message from another thread makes it available again.
+    const Message* released = kept[1].get();
+    std::thread([&]() { kept[1].reset(); }).join();
+    auto reused = pool.acquire();
+    cout << "reused released message : " << (reused.get() == released) << endl;
+
+    // Growing the pool makes room for more messages without a miss.
+    pool.grow(6);
+    auto grown = pool.acquire();
+    cout << "capacity after grow : " << pool.capacity() << endl;
+
+    if(pool.miss_count() != 1 || reused.get() != released || pool.capacity() != 6) {
+        cerr << "MessagePool test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <thread>
+using namespace std;
+
+#include <oculus_driver/Metrics.h>
+using namespace oculus;
+
+int main()
+{
+    // Log-normal durations around 100us recorded from several threads.
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    std::vector<std::vector<double>> values(4);
+    for(int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::mt19937 gen(t);
+            std::lognormal_distribution<double> dist(std::log(100.0e3), 0.8);
+            for(int i = 0; i < 100000; i++) {
+                double v = dist(gen);
+                values[t].push_back(1.0e-3*(uint64_t)v);
+                histogram.record((uint64_t)v);
+            }
+        }));
+    }
+    for(auto& t : threads) t.join();
+
+    std::vector<double> all;
+    for(auto& v : values) all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+    auto exact = [&](double p) { return all[(std::size_t)(p*all.size())]; };
+
+    auto snapshot = histogram.snapshot();
+    cout << "histogram : " << snapshot << endl;
+    cout << "exact     : p50 : " << exact(0.5) << "us, p99 : " << exact(0.99)
+         << "us, p999 : " << exact(0.999) << "us" << endl;
+
+    bool ok = snapshot.count == all.size();
+    for(auto p : {std::make_pair(0.5,   snapshot.p50),
+                  std::make_pair(0.99,  snapshot.p99),
+                  std::make_pair(0.999, snapshot.p999)}) {
+        // The bucket resolution is 1/16 of a power of two.
+        ok &= std::abs(p.second - exact(p.first)) < exact(p.first) / 16.0;
+    }
+    ok &= snapshot.min == all.front() && snapshot.max == all.back();
+
+    if(!ok) {
+        cerr << "Metrics test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
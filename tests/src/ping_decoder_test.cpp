@@ -0,0 +1,165 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+#include <oculus_driver/PingDecoder.h>
+#include <oculus_driver/helpers.h>
+using namespace oculus;
+
+uint32_t sample_value(unsigned int r, unsigned int b, unsigned int sampleSize)
+{
+    uint64_t maxValue = (1ull << (8*sampleSize)) - 1;
+    return (uint32_t)((2654435761ull*(r*1000 + b)) % (maxValue + 1));
+}
+
+template <class OculusPingResultType>
+Message::ConstPtr make_ping(uint8_t version, unsigned int sampleSize, bool gains,
+                            uint8_t dataSize, uint16_t nBeams = 200, uint16_t nRanges = 100,
+                            bool gainFlag = false)
+{
+    std::size_t metadataSize = sizeof(OculusPingResultType) + nBeams*sizeof(int16_t);
+    std::size_t rowSize      = (gains ? 4 : 0) + sampleSize*nBeams;
+    std::vector<uint8_t> data(metadataSize + rowSize*nRanges);
+
+    OculusPingResultType ping;
+    std::memset(&ping, 0, sizeof(ping));
+    auto& header = ping.fireMessage.head;
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageSimplePingResult;
+    header.msgVersion  = version;
+    header.payloadSize = data.size() - sizeof(header);
+    // gainFlag inverts the gain flag (unreliable in version 2 messages).
+    ping.fireMessage.flags = (gains != gainFlag ? 0x4 : 0) | (sampleSize == 2 ? 0x2 : 0);
+    ping.dataSize    = dataSize;
+    ping.nBeams      = nBeams;
+    ping.nRanges     = nRanges;
+    ping.imageOffset = metadataSize;
+    ping.imageSize   = rowSize*nRanges;
+    ping.messageSize = data.size();
+    std::memcpy(data.data(), &ping, sizeof(ping));
+    for(unsigned int r = 0; r < nRanges; r++) {
+        uint8_t* row = data.data() + metadataSize + r*rowSize;
+        if(gains) {
+            uint32_t gain = (r + 1)*(r + 1);
+            std::memcpy(row, &gain, sizeof(gain));
+            row += 4;
+        }
+        for(unsigned int b = 0; b < nBeams; b++) {
+            uint32_t value = sample_value(r, b, sampleSize);
+            std::memcpy(row + b*sampleSize, &value, sampleSize); // little endian
+        }
+    }
+    return Message::Create(data.size(), data.data());
+}
+
+bool check_decoded(const std::vector<float>& decoded, unsigned int sampleSize, bool gains,
+                   uint16_t nBeams = 200, uint16_t nRanges = 100)
+{
+    bool ok = decoded.size() == (std::size_t)nBeams*nRanges;
+    for(unsigned int r = 0; ok && r < nRanges; r++) {
+        float gain = gains ? 1.0f / (r + 1) : 1.0f;
+        for(unsigned int b = 0; b < nBeams; b++) {
+            ok &= decoded[nBeams*r + b] == gain * sample_value(r, b, sampleSize);
+        }
+    }
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+    const uint8_t dataSizes[] = {dataSize8Bit, dataSize16Bit, dataSize24Bit, dataSize32Bit};
+
+    ThreadPool pool(2);
+    for(uint8_t version : {1, 2})
+    for(unsigned int sampleSize = 1; sampleSize <= 4; sampleSize++)
+    for(bool gains : {false, true}) {
+        auto msg = version == 2 ?
+            make_ping<OculusSimplePingResult2>(version, sampleSize, gains, dataSizes[sampleSize - 1]) :
+            make_ping<OculusSimplePingResult> (version, sampleSize, gains, dataSizes[sampleSize - 1]);
+
+        auto format = PingFormat::resolve(msg->data());
+        bool caseOk = format.is_valid() && format.version == version
+                   && format.sampleSize == sampleSize && format.hasGains == gains;
+
+        std::vector<float> decoded;
+        decode_ping(msg->data(), decoded);
+        caseOk &= check_decoded(decoded, sampleSize, gains);
+        decode_ping(msg->data(), decoded, &pool);
+        caseOk &= check_decoded(decoded, sampleSize, gains);
+        // same result as the generic helper
+        std::vector<float> helper(decoded.size());
+        std::vector<double> helperDouble(decoded.size());
+        std::vector<int64_t> helperInt(decoded.size());
+        ping_data_to_array(helper.data(), msg->data());
+        ping_data_to_array(helperDouble.data(), msg->data(), pool);
+        ping_data_to_array(helperInt.data(), msg->data(), 0, format.nRanges);
+        caseOk &= helper == decoded
+               && std::equal(decoded.begin(), decoded.end(), helperDouble.begin())
+               && std::equal(decoded.begin(), decoded.end(), helperInt.begin(),
+                             [](float a, int64_t b) { return (int64_t)a == b; });
+        if(!caseOk) {
+            cerr << "V" << (int)version << ", " << 8*sampleSize << " bits, gains : "
+                 << gains << " failed" << endl;
+        }
+        ok &= caseOk;
+    }
+
+    // invalid dataSize, deduced from the image size
+    auto msg = make_ping<OculusSimplePingResult2>(2, 3, true, 0xff);
+    auto format = PingFormat::resolve(msg->data());
+    ok &= format.sampleSize == 3 && format.rowSize == 4 + 3*200;
+
+    // V2 gain flag disagreeing with the image size : the image size wins
+    for(bool gains : {false, true}) {
+        msg = make_ping<OculusSimplePingResult2>(2, 2, gains, dataSize16Bit, 200, 100, true);
+        format = PingFormat::resolve(msg->data());
+        std::vector<float> decoded;
+        decode_ping(msg->data(), decoded);
+        if(format.hasGains != gains || !check_decoded(decoded, 2, gains)) {
+            cerr << "V2 gains deduced from the flag instead of the image size" << endl;
+            ok = false;
+        }
+    }
+    // invalid dataSize without gains
+    msg = make_ping<OculusSimplePingResult2>(2, 2, false, 0xff, 200, 100, true);
+    format = PingFormat::resolve(msg->data());
+    ok &= format.sampleSize == 2 && !format.hasGains;
+
+    // truncated image
+    msg = make_ping<OculusSimplePingResult2>(2, 2, true, dataSize16Bit);
+    ok &= !PingFormat::resolve(MessageData(msg->data().data(), msg->data().size() - 1)).is_valid();
+    try {
+        std::vector<float> decoded;
+        decode_ping(MessageData(msg->data().data(), msg->data().size() - 1), decoded);
+        ok = false;
+    }
+    catch(const std::runtime_error&) {}
+
+    if(!ok) {
+        cerr << "PingDecoder test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+using namespace std;
+
+#include <oculus_driver/Recorder.h>
+#include <oculus_driver/PrefetchReader.h>
+using namespace oculus;
+
+Message::ConstPtr make_message(unsigned int index)
+{
+    std::vector<uint8_t> data(sizeof(OculusMessageHeader) + 64*1024 + index % 100);
+    OculusMessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.msgId       = messageDummy;
+    header.payloadSize = data.size() - sizeof(header);
+    std::memcpy(data.data(), &header, sizeof(header));
+    for(std::size_t i = sizeof(header); i < data.size(); i++) {
+        data[i] = (uint8_t)(index + i);
+    }
+    return Message::Create(data.size(), data.data(),
+        Message::TimePoint(std::chrono::milliseconds(1000 + 100*index)));
+}
+
+// Simulates some processing of the messages.
+void process(const Message::ConstPtr&)
+{
+    auto start = std::chrono::steady_clock::now();
+    while(std::chrono::steady_clock::now() - start < std::chrono::microseconds(200));
+}
+
+int main()
+{
+    const unsigned int count = 1000;
+    const std::string filename = "prefetch_reader_test.oculus";
+    {
+        Recorder recorder;
+        recorder.open(filename, true);
+        for(unsigned int i = 0; i < count; i++) {
+            recorder.write(make_message(i));
+        }
+    }
+
+    bool ok = true;
+    std::vector<Message::ConstPtr> kept;
+
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        FileReader reader(filename);
+        while(auto msg = reader.read_next_message()) process(msg);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    {
+        PrefetchReader reader(filename, 32);
+        unsigned int readCount = 0;
+        while(auto msg = reader.read_next_message()) {
+            process(msg);
+            ok &= msg->data() == make_message(readCount)->data();
+            ok &= msg->timestamp() == make_message(readCount)->timestamp();
+            kept.push_back(msg);
+            readCount++;
+        }
+        ok &= readCount == count;
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    cout << "FileReader     : " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+         << "ms" << endl;
+    cout << "PrefetchReader : " << std::chrono::duration<double, std::milli>(t2 - t1).count()
+         << "ms (includes the checks)" << endl;
+
+    // messages are not reused by the reader
+    for(unsigned int i = 0; i < kept.size(); i += 100) {
+        ok &= kept[i]->data() == make_message(i)->data();
+    }
+
+    {
+        PrefetchReader reader(filename, 8);
+        reader.read_next_message();
+        ok &= reader.seek_to_time(Message::TimePoint(std::chrono::milliseconds(1000 + 100*500)));
+        auto msg = reader.read_next_message();
+        ok &= msg && msg->data() == make_message(500)->data();
+        ok &= !reader.seek_to_time(Message::TimePoint(std::chrono::hours(1)));
+        msg = reader.read_next_message();
+        ok &= msg && msg->data() == make_message(501)->data();
+        reader.rewind();
+        msg = reader.read_next_message();
+        ok &= msg && msg->data() == make_message(0)->data();
+        // destroyed while the reader thread is waiting on a full queue
+    }
+
+    if(!ok) {
+        cerr << "PrefetchReader test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <cmath>
+using namespace std;
+
+#include <oculus_driver/AsyncService.h>
+#include <oculus_driver/SonarDriver.h>
+#include <oculus_driver/SonarSimulator.h>
+using namespace oculus;
+
+int main()
+{
+    // The simulator and the driver run in their own io_service.
+    AsyncService simulatorService;
+    SonarSimulator simulator(simulatorService.io_service());
+    simulatorService.start();
+
+    AsyncService driverService;
+    SonarDriver driver(driverService.io_service());
+    std::atomic<int> pingCount(0);
+    driver.add_ping_callback([&](const PingMessage::ConstPtr& ping) {
+        if(ping->range_count() == simulator.range_count()) {
+            pingCount++;
+        }
+    });
+    // A slow asynchronous subscriber keeps pooled messages alive in its
+    // queue. The message pool must grow so the reception does not allocate.
+    driver.add_async_ping_callback([](const PingMessage::ConstPtr&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+    std::atomic<int> asyncConfigCount(0);
+    auto asyncConfigId = driver.add_async_config_callback([&](const SonarDriver::PingConfig&,
+                                                              const SonarDriver::PingConfig& newConfig) {
+        if(std::abs(newConfig.gainPercent - 60.0) < 0.1) {
+            asyncConfigCount++;
+        }
+    });
+    driverService.start();
+
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    cout << "pings at normal rate : " << pingCount << endl;
+    bool ok = pingCount > 5;
+
+    auto request = default_ping_config();
+    request.pingRate    = pingRateHighest;
+    request.gainPercent = 60.0;
+    try {
+        auto feedback = driver.request_ping_config_async(request).get();
+        cout << "config feedback gain : " << feedback.gainPercent << endl;
+        ok &= std::abs(feedback.gainPercent - 60.0) < 0.1;
+    }
+    catch(const ConfigRequestTimeout& e) {
+        cout << e.what() << endl;
+        ok = false;
+    }
+
+    pingCount = 0;
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    cout << "pings at highest rate : " << pingCount << endl;
+    ok &= pingCount > 30;
+
+    cout << "Driver metrics :\n" << driver.metrics() << endl;
+
+    // The pool is only accessed in the driver io_service.
+    std::promise<std::pair<std::size_t, std::size_t>> poolState;
+    driver.io_service()->post([&]() {
+        poolState.set_value(std::make_pair(driver.message_pool().capacity(),
+                                           driver.message_pool().miss_count()));
+    });
+    auto pool = poolState.get_future().get();
+    cout << "message pool capacity : " << pool.first << ", misses : " << pool.second << endl;
+    cout << "async config callbacks : " << asyncConfigCount << endl;
+    ok &= pool.first > 16 + 16 && pool.second == 0 && asyncConfigCount > 0;
+
+    // The regular removal also closes the channel of an asynchronous callback.
+    ok &= driver.remove_config_callback(asyncConfigId)
+       && !driver.remove_async_config_callback(asyncConfigId);
+
+    driverService.stop();
+    simulatorService.stop();
+
+    if(!ok) {
+        cerr << "Simulator test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
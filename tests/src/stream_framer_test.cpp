@@ -0,0 +1,113 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstddef>
+using namespace std;
+
+#include <oculus_driver/StreamFramer.h>
+using namespace oculus;
+
+std::vector<uint8_t> make_frame(uint16_t msgId, uint32_t payloadSize)
+{
+    std::vector<uint8_t> frame(sizeof(OculusMessageHeader) + payloadSize);
+    OculusMessageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.oculusId    = OCULUS_CHECK_ID;
+    header.srcDeviceId = 7;
+    header.msgId       = msgId;
+    header.payloadSize = payloadSize;
+    std::memcpy(frame.data(), &header, sizeof(header));
+    for(uint32_t i = 0; i < payloadSize; i++) {
+        frame[sizeof(header) + i] = i;
+    }
+    return frame;
+}
+
+int main()
+{
+    // Building a stream of frames with some garbage in between.
+    std::mt19937 gen(0);
+    std::vector<uint8_t> stream;
+    unsigned int frameCount = 0;
+    for(int i = 0; i < 200; i++) {
+        auto frame = make_frame(messageSimplePingResult, gen() % 300000);
+        stream.insert(stream.end(), frame.begin(), frame.end());
+        frameCount++;
+        if(i % 10 == 5) {
+            // garbage, including the end of a frame (as when connecting in the
+            // middle of a message)
+            std::vector<uint8_t> garbage(gen() % 1000 + 1);
+            for(auto& v : garbage) v = gen();
+            auto truncated = make_frame(messageSimplePingResult, 1000);
+            stream.insert(stream.end(), truncated.begin() + 3, truncated.end());
+            // Corrupted header announcing an implausible payload size. This
+            // must not swallow the following frames.
+            auto bogus = make_frame(messageUserConfig, 0);
+            uint32_t bogusSize = 1 << 20;
+            std::memcpy(bogus.data() + offsetof(OculusMessageHeader, payloadSize),
+                        &bogusSize, sizeof(bogusSize));
+            stream.insert(stream.end(), bogus.begin(), bogus.end());
+            stream.insert(stream.end(), garbage.begin(), garbage.end());
+        }
+    }
+
+    StreamFramer framer;
+    framer.set_header_checker([](const OculusMessageHeader& header) {
+        return header.srcDeviceId == 7;
+    });
+
+    // Feeding the stream in random sized chunks.
+    unsigned int received = 0;
+    std::size_t pos = 0;
+    while(pos < stream.size()) {
+        uint8_t* dst = framer.write_handle();
+        std::size_t size = std::min<std::size_t>(
+            std::min<std::size_t>(gen() % 100000 + 1, framer.write_capacity()),
+            stream.size() - pos);
+        std::memcpy(dst, stream.data() + pos, size);
+        framer.commit(size);
+        pos += size;
+
+        while(const uint8_t* frame = framer.next_frame()) {
+            OculusMessageHeader header;
+            std::memcpy(&header, frame, sizeof(header));
+            for(uint32_t i = 0; i < header.payloadSize; i++) {
+                if(frame[sizeof(header) + i] != (uint8_t)i) {
+                    cerr << "Corrupted frame " << received << endl;
+                    return -1;
+                }
+            }
+            framer.consume_frame();
+            received++;
+        }
+    }
+
+    cout << "frames sent     : " << frameCount              << endl;
+    cout << "frames received : " << received                << endl;
+    cout << "resync count    : " << framer.resync_count()   << endl;
+    cout << "skipped bytes   : " << framer.skipped_bytes()  << endl;
+
+    if(received != frameCount) {
+        cerr << "StreamFramer test failed" << endl;
+        return -1;
+    }
+    return 0;
+}
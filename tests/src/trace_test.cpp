@@ -0,0 +1,73 @@
+/******************************************************************************
+ * oculus_driver driver library for Blueprint Subsea Oculus sonar.
+ * Copyright (C) 2020 ENSTA-Bretagne
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+using namespace std;
+
+#include <oculus_driver/Trace.h>
+using namespace oculus;
+
+double scope_cost(int count)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i = 0; i < count; i++) {
+        TraceScope scope("scope");
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / count;
+}
+
+int main()
+{
+    auto& tracer = Tracer::instance();
+    const int count = 1000000;
+
+    double disabledCost = scope_cost(count);
+    tracer.enable();
+    double enabledCost = scope_cost(count) / 2; // two events per scope
+    cout << "disabled scope cost : " << disabledCost << " ns" << endl;
+    cout << "event cost          : " << enabledCost  << " ns" << endl;
+
+    tracer.clear();
+    std::thread([]() {
+        TraceScope scope("other_thread");
+    }).join();
+    {
+        TraceScope scope("main_thread");
+    }
+    tracer.enable(false);
+    {
+        TraceScope scope("not_recorded");
+    }
+
+    std::ostringstream oss;
+    tracer.write_chrome_trace(oss);
+    cout << oss.str();
+
+    bool ok = tracer.event_count() == 4
+           && oss.str().find("other_thread") != std::string::npos
+           && oss.str().find("not_recorded") == std::string::npos;
+    if(!ok) {
+        cerr << "Trace test failed" << endl;
+        return -1;
+    }
+    return 0;
+}